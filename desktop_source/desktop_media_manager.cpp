@@ -20,11 +20,31 @@
  */
 #include "desktop_media_manager.h"
 #include "mirac-glib-logging.hpp"
+#include <algorithm>
 #include <cassert>
+#include <climits>
 
-DesktopMediaManager::DesktopMediaManager(const std::string& hostname)
+DesktopMediaManager::DesktopMediaManager(
+    const std::string& hostname, const wds::VideoFormatCostModel& cost_model,
+    const MiracEncoderProfile& encoder_profile)
   : hostname_(hostname),
-    format_() {
+    cost_model_(cost_model),
+    encoder_profile_(encoder_profile),
+    format_(),
+    video_codec_(WFD_VIDEO_H264),
+    pipeline_video_codec_(WFD_VIDEO_H264),
+    pipeline_prepared_(false),
+    idr_timer_(nullptr),
+    last_idr_time_(0) {
+  // Built when the sink connects, the formats and the sink port are
+  // set as they are negotiated.
+  CreatePipeline(0);
+  gst_pipeline_->SetState(GST_STATE_READY);
+  pipeline_prepared_ = true;
+}
+
+DesktopMediaManager::~DesktopMediaManager() {
+  CancelIDRRequests();
 }
 
 void DesktopMediaManager::Play() {
@@ -55,10 +75,120 @@ wds::SessionType DesktopMediaManager::GetSessionType() const {
 }
 
 void DesktopMediaManager::SetSinkRtpPorts(int port1, int port2) {
+  SetSinkRtpPortsAsync(port1, port2);
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::SetPipelineState(GstState state) {
+  // No keyframe is encoded before the pipeline plays again.
+  if (state != GST_STATE_PLAYING)
+    CancelIDRRequests();
+  wds::MediaCompletionPtr completion = wds::MediaCompletion::Create();
+  gst_pipeline_->SetState(state, [completion](bool success) {
+    completion->Complete(success);
+  });
+  return completion;
+}
+
+void DesktopMediaManager::CreatePipeline(int port) {
+  CancelIDRRequests();
+  gst_pipeline_.reset(
+      new MiracGstTestSource(WFD_DESKTOP, hostname_, port, video_codec_));
+  pipeline_video_codec_ = video_codec_;
+  if (first_packet_callback_)
+    gst_pipeline_->SetFirstPacketCallback(first_packet_callback_);
+}
+
+void DesktopMediaManager::SetFirstPacketCallback(
+    std::function<void(gint64)> callback) {
+  first_packet_callback_ = callback;
+  gst_pipeline_->SetFirstPacketCallback(callback);
+}
+
+namespace {
+
+// Maximum bitrates of the H.264 levels, in kbit/s, for the baseline
+// profile. The high profile allows 1.25 times more.
+const unsigned kH264LevelMaxBitrates[] = {14000, 20000, 20000, 50000, 50000};
+const char* const kH264LevelNames[] = {"3.1", "3.2", "4", "4.1", "4.2"};
+
+MiracVideoFormat CreateMiracVideoFormat(const wds::VideoModeInfo& mode,
+                                        double bits_per_pixel,
+                                        unsigned max_bitrate) {
+  MiracVideoFormat format;
+  format.width = mode.width;
+  format.height = mode.height;
+  // Interlaced modes are captured as frames of both fields.
+  format.framerate = std::max(1u, mode.interlaced ? mode.frame_rate / 2
+                                                  : mode.frame_rate);
+  unsigned bitrate = static_cast<unsigned>(
+      mode.width * mode.height * format.framerate * bits_per_pixel / 1000);
+  format.bitrate = std::max(1u, std::min(bitrate, max_bitrate));
+  return format;
+}
+
+}
+
+void DesktopMediaManager::ApplyVideoFormat() {
+  unsigned max_bitrate =
+      cost_model_.link_mbps ? cost_model_.link_mbps * 1000 : UINT_MAX;
+  MiracVideoFormat format;
+  if (video_codec_ == WFD_VIDEO_H265) {
+    format = CreateMiracVideoFormat(
+        wds::GetVideoModeInfo(h265_format_),
+        cost_model_.bits_per_pixel * cost_model_.h265_bitrate_ratio,
+        max_bitrate);
+    format.profile = h265_format_.profile == wds::H265Main10 ? "main-10"
+                                                             : "main";
+  } else {
+    unsigned level_max_bitrate = kH264LevelMaxBitrates[format_.level];
+    if (format_.profile == wds::CHP)
+      level_max_bitrate = level_max_bitrate * 5 / 4;
+    format = CreateMiracVideoFormat(
+        wds::GetVideoModeInfo(format_), cost_model_.bits_per_pixel,
+        std::min(max_bitrate, level_max_bitrate));
+    // There are no B-frames with tune=zerolatency, so the high profile
+    // stream is in the constrained high profile the sink expects.
+    format.profile = format_.profile == wds::CHP ? "high"
+                                                 : "constrained-baseline";
+    format.level = kH264LevelNames[format_.level];
+  }
+  gst_pipeline_->SetVideoFormat(format, encoder_profile_);
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::PlayAsync() {
+  assert(gst_pipeline_);
+  return SetPipelineState(GST_STATE_PLAYING);
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::PauseAsync() {
+  assert(gst_pipeline_);
+  return SetPipelineState(GST_STATE_PAUSED);
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::TeardownAsync() {
+  if (!gst_pipeline_)
+    return wds::MediaCompletion::Completed(true);
+  return SetPipelineState(GST_STATE_READY);
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::IsPausedAsync() {
+  return wds::MediaCompletion::Completed(
+      gst_pipeline_->GetTargetState() != GST_STATE_PLAYING);
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::SetSinkRtpPortsAsync(int port1,
+                                                                  int port2) {
   sink_port1_ = port1;
   sink_port2_ = port2;
-  gst_pipeline_.reset(new MiracGstTestSource(WFD_DESKTOP, hostname_, port1));
-  gst_pipeline_->SetState(GST_STATE_READY);
+  if (pipeline_prepared_ && pipeline_video_codec_ == video_codec_) {
+    pipeline_prepared_ = false;
+    gst_pipeline_->SetPort(port1);
+  } else {
+    pipeline_prepared_ = false;
+    CreatePipeline(port1);
+  }
+  ApplyVideoFormat();
+  return SetPipelineState(GST_STATE_READY);
 }
 
 std::pair<int, int> DesktopMediaManager::GetSinkRtpPorts() const {
@@ -71,26 +201,40 @@ int DesktopMediaManager::GetLocalRtpPort() const {
 
 namespace {
 
-std::vector<wds::H264VideoCodec> GetH264VideoCodecs() {
-  static std::vector<wds::H264VideoCodec> codecs;
-  if (codecs.empty()) {
-    wds::RateAndResolutionsBitmap cea_rr;
-    wds::RateAndResolutionsBitmap vesa_rr;
-    wds::RateAndResolutionsBitmap hh_rr;
-    wds::RateAndResolution i;
-    // declare that we support all resolutions, CHP and level 4.2
-    // gstreamer should handle all of it :)
-    for (i = wds::CEA640x480p60; i <= wds::CEA1920x1080p24; ++i)
-      cea_rr.set(i);
-    for (i = wds::VESA800x600p30; i <= wds::VESA1920x1200p30; ++i)
-      vesa_rr.set(i);
-    for (i = wds::HH800x480p30; i <= wds::HH848x480p60; ++i)
-      hh_rr.set(i);
-
-    wds::H264VideoCodec codec(wds::CHP, wds::k4_2, cea_rr, vesa_rr, hh_rr);
-    codecs.push_back(codec);
-  }
+std::vector<wds::H264VideoCodec> CreateH264VideoCodecs() {
+  wds::RateAndResolutionsBitmap cea_rr;
+  wds::RateAndResolutionsBitmap vesa_rr;
+  wds::RateAndResolutionsBitmap hh_rr;
+  wds::RateAndResolution i;
+  // declare that we support all resolutions, CHP and level 4.2
+  // gstreamer should handle all of it :)
+  for (i = wds::CEA640x480p60; i <= wds::CEA1920x1080p24; ++i)
+    cea_rr.set(i);
+  for (i = wds::VESA800x600p30; i <= wds::VESA1920x1200p30; ++i)
+    vesa_rr.set(i);
+  for (i = wds::HH800x480p30; i <= wds::HH848x480p60; ++i)
+    hh_rr.set(i);
+
+  return {wds::H264VideoCodec(wds::CHP, wds::k4_2, cea_rr, vesa_rr, hh_rr)};
+}
+
+std::vector<wds::H265VideoCodec> CreateH265VideoCodecs() {
+  // The same formats as in H.264, Main profile.
+  const wds::H264VideoCodec& h264 = CreateH264VideoCodecs().front();
+  return {wds::H265VideoCodec(wds::H265Main, wds::kH265_5_1,
+                              h264.cea_rr, h264.vesa_rr, h264.hh_rr)};
+}
 
+const std::vector<wds::H264VideoCodec>& GetH264VideoCodecs() {
+  // Initialized once, even when sessions run on several threads.
+  static const std::vector<wds::H264VideoCodec> codecs =
+      CreateH264VideoCodecs();
+  return codecs;
+}
+
+const std::vector<wds::H265VideoCodec>& GetH265VideoCodecs() {
+  static const std::vector<wds::H265VideoCodec> codecs =
+      CreateH265VideoCodecs();
   return codecs;
 }
 
@@ -100,31 +244,164 @@ bool DesktopMediaManager::InitOptimalVideoFormat(
     const wds::NativeVideoFormat& sink_native_format,
     const std::vector<wds::H264VideoCodec>& sink_supported_codecs) {
 
-  format_ = wds::FindOptimalVideoFormat(sink_native_format,
-                                        GetH264VideoCodecs(),
-                                        sink_supported_codecs);
-  return true;
+  bool success = false;
+  format_ = wds::SelectVideoFormat(sink_native_format, GetH264VideoCodecs(),
+                                   sink_supported_codecs, cost_model_,
+                                   &success);
+  sink_native_format_ = sink_native_format;
+  sink_h264_codecs_ = sink_supported_codecs;
+  video_codec_ = WFD_VIDEO_H264;
+  return success;
 }
 
 wds::H264VideoFormat DesktopMediaManager::GetOptimalVideoFormat() const {
   return format_;
 }
 
+bool DesktopMediaManager::IsH265Supported() const {
+  return MiracGstTestSource::IsVideoCodecAvailable(WFD_VIDEO_H265);
+}
+
+bool DesktopMediaManager::InitOptimalH265VideoFormat(
+    const wds::NativeVideoFormat& sink_native_format,
+    const std::vector<wds::H265VideoCodec>& sink_supported_codecs) {
+  wds::H264VideoFormat h264_format;
+  wds::H265VideoFormat h265_format;
+  if (wds::SelectVideoCodec(sink_native_format, GetH264VideoCodecs(),
+                            sink_h264_codecs_, GetH265VideoCodecs(),
+                            sink_supported_codecs, cost_model_,
+                            &h264_format, &h265_format) != wds::H265)
+    return false;
+
+  h265_format_ = h265_format;
+  video_codec_ = WFD_VIDEO_H265;
+  return true;
+}
+
+wds::H265VideoFormat DesktopMediaManager::GetOptimalH265VideoFormat() const {
+  return h265_format_;
+}
+
 bool DesktopMediaManager::InitOptimalAudioFormat(const std::vector<wds::AudioCodec>& sink_codecs) {
-  for (const auto& codec : sink_codecs) {
-     if (codec.format == wds::AAC && codec.modes.test(wds::AAC_48K_16B_2CH))
-       return true;
-  }
-  return false;
+  std::vector<wds::AudioCodec> local_codecs;
+  local_codecs.push_back(wds::AudioCodec(wds::LPCM, wds::AudioModes()
+      .set(wds::LPCM_44_1K_16B_2CH).set(wds::LPCM_48K_16B_2CH), 0));
+  local_codecs.push_back(wds::AudioCodec(wds::AAC,
+      wds::AudioModes().set(wds::AAC_48K_16B_2CH), 0));
+
+  // LPCM is passed through whenever the link can carry it.
+  wds::AudioCostModel audio_cost_model;
+  audio_cost_model.link_kbps = cost_model_.link_mbps * 1000;
+
+  bool success = false;
+  audio_codec_ = wds::FindOptimalAudioFormat(local_codecs, sink_codecs,
+                                             audio_cost_model, &success);
+  return success;
 }
 
 wds::AudioCodec DesktopMediaManager::GetOptimalAudioFormat() const {
-  wds::AudioModes audio_modes;
-  audio_modes.set(wds::AAC_48K_16B_2CH);
-
-  return wds::AudioCodec(wds::AAC, audio_modes, 0);
+  return audio_codec_;
 }
 
 void DesktopMediaManager::SendIDRPicture() {
-  WDS_WARNING("Unimplemented IDR picture request");
+  SendIDRPictureAsync();
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::SendIDRPictureAsync() {
+  if (!gst_pipeline_ || gst_pipeline_->GetTargetState() != GST_STATE_PLAYING)
+    return wds::MediaCompletion::Completed(false);
+
+  wds::MediaCompletionPtr completion = wds::MediaCompletion::Create();
+  idr_requests_.push_back(completion);
+  if (idr_requests_.size() > 1) {
+    // The sink repeats the request until the picture has recovered.
+    WDS_VLOG("IDR picture request coalesced with a pending one");
+    return completion;
+  }
+
+  gint64 wait = last_idr_time_ +
+      encoder_profile_.min_idr_interval * G_TIME_SPAN_MILLISECOND -
+      g_get_monotonic_time();
+  if (wait <= 0) {
+    ForceKeyUnit();
+    return completion;
+  }
+  idr_timer_ = g_timeout_source_new(wait / G_TIME_SPAN_MILLISECOND + 1);
+  g_source_set_callback(idr_timer_, OnIDRTimeout, this, nullptr);
+  g_source_attach(idr_timer_, g_main_context_get_thread_default());
+  return completion;
+}
+
+gboolean DesktopMediaManager::OnIDRTimeout(gpointer data) {
+  DesktopMediaManager* manager = static_cast<DesktopMediaManager*>(data);
+  g_source_unref(manager->idr_timer_);
+  manager->idr_timer_ = nullptr;
+  manager->ForceKeyUnit();
+  return G_SOURCE_REMOVE;
+}
+
+void DesktopMediaManager::ForceKeyUnit() {
+  // The callback is dropped with the pipeline.
+  gst_pipeline_->ForceKeyUnit([this](bool sent) {
+    if (sent)
+      last_idr_time_ = g_get_monotonic_time();
+    CompleteIDRRequests(sent);
+  });
+}
+
+void DesktopMediaManager::CompleteIDRRequests(bool sent) {
+  std::vector<wds::MediaCompletionPtr> requests;
+  requests.swap(idr_requests_);
+  for (const wds::MediaCompletionPtr& request : requests)
+    request->Complete(sent);
+}
+
+void DesktopMediaManager::CancelIDRRequests() {
+  if (idr_timer_) {
+    g_source_destroy(idr_timer_);
+    g_source_unref(idr_timer_);
+    idr_timer_ = nullptr;
+  }
+  CompleteIDRRequests(false);
+}
+
+void DesktopMediaManager::PrepareMedia(const wds::NegotiatedFormats& formats) {
+  // Rebuilt while M1-M3 are exchanged if the sink is likely to
+  // choose H.265 again.
+  video_codec_ = formats.has_h265 ? WFD_VIDEO_H265 : WFD_VIDEO_H264;
+  if (pipeline_video_codec_ == video_codec_)
+    return;
+  CreatePipeline(0);
+  gst_pipeline_->SetState(GST_STATE_READY);
+  pipeline_prepared_ = true;
+}
+
+wds::MediaCompletionPtr DesktopMediaManager::PrerollMediaAsync() {
+  // The sink may have rejected the formats of M3 in M4.
+  if (pipeline_video_codec_ != video_codec_)
+    CreatePipeline(sink_port1_);
+  ApplyVideoFormat();
+  // ximagesrc is live, so nothing is prerolled in PAUSED, but the
+  // elements are set up and PLAY only starts the capture.
+  return SetPipelineState(GST_STATE_PAUSED);
+}
+
+bool DesktopMediaManager::UseNegotiatedFormats(
+    const wds::NegotiatedFormats& formats) {
+  if (!formats.has_video)
+    return false;
+  // The link or the encoder may have changed since the formats were cached.
+  if (formats.has_h265 ? !wds::IsVideoFormatSustainable(formats.h265_format,
+                                                        cost_model_)
+                       : !wds::IsVideoFormatSustainable(formats.video_format,
+                                                        cost_model_)) {
+    WDS_LOG("The cached video format cannot be sustained any more");
+    return false;
+  }
+  format_ = formats.video_format;
+  h265_format_ = formats.h265_format;
+  video_codec_ = formats.has_h265 ? WFD_VIDEO_H265 : WFD_VIDEO_H264;
+  if (formats.has_audio)
+    audio_codec_ = formats.audio_codec;
+  return true;
 }
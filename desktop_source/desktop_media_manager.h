@@ -21,6 +21,7 @@
 #ifndef DESKTOP_MEDIA_MANAGER_H_
 #define DESKTOP_MEDIA_MANAGER_H_
 
+#include <functional>
 #include <memory>
 
 #include "libwds/public/media_manager.h"
@@ -28,7 +29,13 @@
 
 class DesktopMediaManager : public wds::SourceMediaManager {
  public:
-  explicit DesktopMediaManager(const std::string& hostname);
+  // The video format is chosen within the limits of |cost_model|, and
+  // encoded with the settings of |encoder_profile|.
+  explicit DesktopMediaManager(
+      const std::string& hostname,
+      const wds::VideoFormatCostModel& cost_model = wds::VideoFormatCostModel(),
+      const MiracEncoderProfile& encoder_profile = MiracEncoderProfile());
+  ~DesktopMediaManager() override;
   void Play() override;
   void Pause() override;
   void Teardown() override;
@@ -42,16 +49,67 @@ class DesktopMediaManager : public wds::SourceMediaManager {
   bool InitOptimalVideoFormat(const wds::NativeVideoFormat& sink_native_format,
       const std::vector<wds::H264VideoCodec>& sink_supported_codecs) override;
   wds::H264VideoFormat GetOptimalVideoFormat() const override;
+  bool IsH265Supported() const override;
+  bool InitOptimalH265VideoFormat(
+      const wds::NativeVideoFormat& sink_native_format,
+      const std::vector<wds::H265VideoCodec>& sink_supported_codecs) override;
+  wds::H265VideoFormat GetOptimalH265VideoFormat() const override;
   bool InitOptimalAudioFormat(const std::vector<wds::AudioCodec>& sink_supported_codecs) override;
   wds::AudioCodec GetOptimalAudioFormat() const override;
   void SendIDRPicture() override;
+  void PrepareMedia(const wds::NegotiatedFormats& formats) override;
+  bool UseNegotiatedFormats(const wds::NegotiatedFormats& formats) override;
+
+  // Pipeline state changes complete from the bus watch instead of
+  // blocking the session loop.
+  wds::MediaCompletionPtr PlayAsync() override;
+  wds::MediaCompletionPtr PauseAsync() override;
+  wds::MediaCompletionPtr TeardownAsync() override;
+  wds::MediaCompletionPtr IsPausedAsync() override;
+  wds::MediaCompletionPtr SetSinkRtpPortsAsync(int port1, int port2) override;
+  // Completes once the keyframe has left the encoder.
+  wds::MediaCompletionPtr SendIDRPictureAsync() override;
+  // Sets the negotiated formats and takes the pipeline to PAUSED.
+  wds::MediaCompletionPtr PrerollMediaAsync() override;
+
+  // |callback| gets the monotonic time the first RTP packet of the
+  // stream was sent, see wds::TimelineEvent::FirstMediaPacket.
+  void SetFirstPacketCallback(std::function<void(gint64)> callback);
 
  private:
+  wds::MediaCompletionPtr SetPipelineState(GstState state);
+  void CreatePipeline(int port);
+  // Constrains the pipeline to the negotiated video format.
+  void ApplyVideoFormat();
+  void ForceKeyUnit();
+  static gboolean OnIDRTimeout(gpointer data);
+  void CompleteIDRRequests(bool sent);
+  // Drops the keyframe request, e.g. when the pipeline stops.
+  void CancelIDRRequests();
+
   std::string hostname_;
+  wds::VideoFormatCostModel cost_model_;
+  MiracEncoderProfile encoder_profile_;
   std::unique_ptr<MiracGstTestSource> gst_pipeline_;
+  std::function<void(gint64)> first_packet_callback_;
   int sink_port1_;
   int sink_port2_;
   wds::H264VideoFormat format_;
+  wds::H265VideoFormat h265_format_;
+  wds::NativeVideoFormat sink_native_format_;
+  std::vector<wds::H264VideoCodec> sink_h264_codecs_;
+  // The codec the video is encoded with, and the one of |gst_pipeline_|.
+  wfd_video_codec_t video_codec_;
+  wfd_video_codec_t pipeline_video_codec_;
+  wds::AudioCodec audio_codec_;
+  // The pipeline was built ahead and waits for the sink port.
+  bool pipeline_prepared_;
+  // IDR requests answered by the next keyframe.
+  std::vector<wds::MediaCompletionPtr> idr_requests_;
+  // Delays the keyframe to keep the minimum interval of the profile.
+  GSource* idr_timer_;
+  // When the last requested keyframe left the encoder, monotonic time.
+  gint64 last_idr_time_;
 };
 
 #endif // DESKTOP_MEDIA_MANAGER_H_
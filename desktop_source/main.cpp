@@ -22,6 +22,7 @@
 #include <glib.h>
 #include <glib-unix.h>
 #include <gst/gst.h>
+#include <algorithm>
 #include <iostream>
 
 #include "source-app.h"
@@ -39,10 +40,22 @@ static gboolean _sig_handler (gpointer data_ptr)
     return G_SOURCE_CONTINUE;
 }
 
+// session commands apply to every connected sink, each on the
+// thread running its session
+static bool call_sources(SourceApp *app, bool (wds::Peer::*method)()) {
+    if (app->sessions()->session_count() == 0)
+        return false;
+
+    app->sessions()->foreach_source([method](wds::Source* source) {
+        if (!(source->*method)())
+            std::cout << "This command cannot be executed now." << std::endl;
+    });
+    return true;
+}
+
 static void parse_input_and_call_source(
     const std::string& command, SourceApp *app) {
 
-    auto source = app->source()->wfd_source();
     bool status = true;
 
     if (command == "scan\n") {
@@ -50,11 +63,11 @@ static void parse_input_and_call_source(
     } else if (command.find("connect ") == 0) {
         app->connect(std::stoi(command.substr(8)));
     } else if (command == "teardown\n") {
-        status = source && source->Teardown();
+        status = call_sources(app, &wds::Peer::Teardown);
     } else if (command == "pause\n") {
-        status = source && source->Pause();
+        status = call_sources(app, &wds::Peer::Pause);
     } else if (command == "play\n") {
-        status = source && source->Play();
+        status = call_sources(app, &wds::Peer::Play);
     } else {
         std::cout << "Received unknown command: " << command << std::endl;
     }
@@ -93,10 +106,24 @@ int main (int argc, char *argv[])
 {
     InitGlibLogging();
     int port = 7236;
+    int shards = g_get_num_processors();
+    gboolean io_thread = FALSE;
+    gchar* trace_file = NULL;
+    int log_buffer = 0;
+    int encoder_mpps = 0;
+    gchar* encoder_profile_name = NULL;
+    int idr_interval = -1;
 
     GOptionEntry main_entries[] =
     {
         { "rtsp_port", 0, 0, G_OPTION_ARG_INT, &(port), "Specify optional RTSP port number, 7236 by default", "rtsp_port"},
+        { "shards", 0, 0, G_OPTION_ARG_INT, &(shards), "Number of event loop threads serving sessions, one per CPU by default", "shards"},
+        { "io_thread", 0, 0, G_OPTION_ARG_NONE, &(io_thread), "Do the RTSP socket I/O on a dedicated thread", NULL},
+        { "trace", 0, 0, G_OPTION_ARG_FILENAME, &(trace_file), "Write the session setup timeline to a Chrome trace file on exit", "file"},
+        { "log_buffer", 0, 0, G_OPTION_ARG_INT, &(log_buffer), "Keep the last KiB of log messages, verbose ones included, in memory and print them on SIGUSR1", "KiB"},
+        { "encoder_mpps", 0, 0, G_OPTION_ARG_INT, &(encoder_mpps), "Megapixels per second the video encoder keeps up with, the video format is chosen within it. Unlimited by default", "mpps"},
+        { "encoder_profile", 0, 0, G_OPTION_ARG_STRING, &(encoder_profile_name), "Video encoder settings: default, low-latency (sliced threads, a keyframe every second) or intra-refresh (low-latency with a periodic intra refresh instead of keyframes)", "(default|low-latency|intra-refresh)"},
+        { "idr_interval", 0, 0, G_OPTION_ARG_INT, &(idr_interval), "Minimum time between the keyframes sent on IDR requests of the sink, 500 ms by default", "ms"},
         { NULL }
     };
 
@@ -112,7 +139,25 @@ int main (int argc, char *argv[])
     }
     g_option_context_free(context);
 
-    SourceApp app(port);
+    if (log_buffer > 0)
+        EnableLogRingBuffer(log_buffer * 1024);
+
+    MiracEncoderProfile encoder_profile;
+    if (encoder_profile_name &&
+        !mirac_encoder_profile(encoder_profile_name, &encoder_profile)) {
+        WDS_ERROR ("unknown encoder profile: %s", encoder_profile_name);
+        exit (1);
+    }
+    g_free(encoder_profile_name);
+    if (idr_interval >= 0)
+        encoder_profile.min_idr_interval = idr_interval;
+
+    SourceApp app(port, std::max(shards, 1), io_thread,
+                  trace_file ? trace_file : "");
+    g_free(trace_file);
+    if (encoder_mpps > 0)
+        app.sessions()->set_encoder_pixel_rate(encoder_mpps * 1000000);
+    app.sessions()->set_encoder_profile(encoder_profile);
 
     GMainLoop *main_loop =  g_main_loop_new(NULL, TRUE);
     g_unix_signal_add(SIGINT, _sig_handler, main_loop);
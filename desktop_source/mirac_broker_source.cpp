@@ -19,6 +19,7 @@
  * 02110-1301 USA
  */
 
+#include <fstream>
 #include <iostream>
 
 #include "desktop_media_manager.h"
@@ -26,19 +27,45 @@
 
 #include "libwds/public/source.h"
 
-MiracBrokerSource::MiracBrokerSource(int rtsp_port)
-  : MiracBroker(std::to_string(rtsp_port)) {
+MiracBrokerSource::MiracBrokerSource(MiracNetwork* connection,
+                                     MiracSourceSessionManager* manager)
+  : MiracBroker(connection),
+    manager_(manager) {
 }
 
-MiracBrokerSource::~MiracBrokerSource() {}
+MiracBrokerSource::~MiracBrokerSource() {
+  if (manager_ && !timeline_.empty())
+    manager_->add_trace(session_name_, timeline_);
+}
 
 void MiracBrokerSource::got_message(const std::string& message) {
   wfd_source_->RTSPDataReceived(message);
 }
 
 void MiracBrokerSource::on_connected() {
-  media_manager_.reset(new DesktopMediaManager(get_peer_address()));
-  wfd_source_.reset(wds::Source::Create(this, media_manager_.get()));
+  session_name_ = get_peer_address();
+  // Building the pipeline below is part of the setup, the peer only
+  // reports the start once it is created.
+  if (manager_ && manager_->records_trace()) {
+    timeline_.push_back({wds::TimelineEvent::SessionStarted, 0, 0, nullptr,
+                         wds::TimelineTimestamp()});
+  }
+  DesktopMediaManager* media_manager = new DesktopMediaManager(session_name_,
+      manager_ ? manager_->video_cost_model(session_name_)
+               : wds::VideoFormatCostModel(),
+      manager_ ? manager_->encoder_profile() : MiracEncoderProfile());
+  if (manager_ && manager_->records_trace()) {
+    // Ends the setup shown in the trace.
+    media_manager->SetFirstPacketCallback([this](gint64 timestamp) {
+      timeline_.push_back({wds::TimelineEvent::FirstMediaPacket, 0, 0,
+                           nullptr, static_cast<uint64_t>(timestamp)});
+    });
+  }
+  media_manager_.reset(media_manager);
+  wfd_source_.reset(wds::Source::Create(this, media_manager_.get(), this));
+  if (manager_)
+    wfd_source_->SetCapabilityCache(manager_->capability_cache(),
+                                    session_name_);
   wfd_source_->Start();
 }
 
@@ -58,3 +85,102 @@ void MiracBrokerSource::on_connection_failure(ConnectionFailure failure) {
 wds::Peer* MiracBrokerSource::Peer() const {
   return wfd_source_.get();
 }
+
+// The session and its pipeline are released right away rather than when
+// the sink closes the connection.
+void MiracBrokerSource::ErrorOccurred(wds::ErrorType error) {
+  std::cout << "* Session with " << session_name_ << " failed" << std::endl;
+  close_session();
+}
+
+void MiracBrokerSource::SessionCompleted() {
+  close_session();
+}
+
+void MiracBrokerSource::TimelineEventOccurred(
+    const wds::TimelineEvent& event) {
+  if (manager_ && manager_->records_trace())
+    timeline_.push_back(event);
+}
+
+MiracSourceSessionManager::MiracSourceSessionManager(
+    int rtsp_port, uint shards, bool io_thread, const std::string& trace_file)
+  : MiracSessionManager(std::to_string(rtsp_port), shards, io_thread),
+    trace_file_(trace_file),
+    encoder_pixel_rate_(0) {
+}
+
+MiracSourceSessionManager::~MiracSourceSessionManager() {
+  stop_shards();
+  if (records_trace())
+    write_trace();
+}
+
+MiracBroker* MiracSourceSessionManager::create_session(
+    MiracNetwork* connection) {
+  return new MiracBrokerSource(connection, this);
+}
+
+void MiracSourceSessionManager::add_trace(
+    const std::string& session_name,
+    const std::vector<wds::TimelineEvent>& timeline) {
+  std::lock_guard<std::mutex> lock(trace_mutex_);
+  trace_.AddSession(session_name, timeline);
+}
+
+void MiracSourceSessionManager::set_encoder_pixel_rate(
+    unsigned pixels_per_second) {
+  std::lock_guard<std::mutex> lock(cost_mutex_);
+  encoder_pixel_rate_ = pixels_per_second;
+}
+
+void MiracSourceSessionManager::set_link_throughput(
+    const std::string& address, unsigned mbps) {
+  std::lock_guard<std::mutex> lock(cost_mutex_);
+  link_throughput_[address] = mbps;
+}
+
+wds::VideoFormatCostModel MiracSourceSessionManager::video_cost_model(
+    const std::string& address) {
+  std::lock_guard<std::mutex> lock(cost_mutex_);
+  wds::VideoFormatCostModel cost_model;
+  auto it = link_throughput_.find(address);
+  if (it != link_throughput_.end())
+    cost_model.link_mbps = it->second;
+  unsigned pixel_rate = encoder_pixel_rate_;
+  if (pixel_rate > 0) {
+    cost_model.encoder_fps = [pixel_rate](unsigned width, unsigned height) {
+      return pixel_rate / (width * height);
+    };
+  }
+  return cost_model;
+}
+
+void MiracSourceSessionManager::set_encoder_profile(
+    const MiracEncoderProfile& profile) {
+  std::lock_guard<std::mutex> lock(cost_mutex_);
+  encoder_profile_ = profile;
+}
+
+MiracEncoderProfile MiracSourceSessionManager::encoder_profile() {
+  std::lock_guard<std::mutex> lock(cost_mutex_);
+  return encoder_profile_;
+}
+
+void MiracSourceSessionManager::write_trace() {
+  std::ofstream file(trace_file_);
+  file << trace_.ToString();
+  if (!file)
+    std::cout << "* Cannot write trace to " << trace_file_ << std::endl;
+  else
+    std::cout << "* Session trace written to " << trace_file_ << std::endl;
+}
+
+void MiracSourceSessionManager::foreach_source(
+    const std::function<void(wds::Source*)>& func) {
+  foreach_session([func](MiracBroker* session) {
+    auto source = static_cast<MiracBrokerSource*>(session)->wfd_source();
+    if (source)
+      func(source);
+  });
+}
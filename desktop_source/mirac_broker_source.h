@@ -22,18 +22,34 @@
 #ifndef MIRAC_BROKER_SOURCE_H_
 #define MIRAC_BROKER_SOURCE_H_
 
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "mirac-broker.hpp"
+#include "mirac-gst-test-source.hpp"
+#include "mirac-session-manager.hpp"
+
+#include "libwds/public/capability_cache.h"
+#include "libwds/public/timeline.h"
+#include "libwds/public/video_format.h"
 
 namespace wds {
 class SourceMediaManager;
 class Source;
 }
 
-class MiracBrokerSource : public MiracBroker {
+class MiracSourceSessionManager;
+
+class MiracBrokerSource : public MiracBroker, public wds::Peer::Observer {
  public:
-  explicit MiracBrokerSource(int rtsp_port);
+  // The session timeline is handed to |manager| on destruction if it
+  // records a trace.
+  MiracBrokerSource(MiracNetwork* connection,
+                    MiracSourceSessionManager* manager = nullptr);
   ~MiracBrokerSource();
 
   wds::Source* wfd_source() { return wfd_source_.get(); }
@@ -44,8 +60,68 @@ class MiracBrokerSource : public MiracBroker {
   void on_connection_failure(ConnectionFailure failure) override;
   virtual wds::Peer* Peer() const override;
 
+  // wds::Peer::Observer
+  void ErrorOccurred(wds::ErrorType error) override;
+  void SessionCompleted() override;
+  void TimelineEventOccurred(const wds::TimelineEvent& event) override;
+
+  MiracSourceSessionManager* manager_;
+  std::string session_name_;
+  std::vector<wds::TimelineEvent> timeline_;
   std::unique_ptr<wds::SourceMediaManager> media_manager_;
   std::unique_ptr<wds::Source> wfd_source_;
 };
 
+// Serves every sink connecting to |rtsp_port| with its own
+// MiracBrokerSource, spread over |shards| event loops. With |io_thread|
+// the socket I/O of all sessions is done on a dedicated thread.
+//
+// With a non-empty |trace_file| the setup timeline of every session is
+// written there as a Chrome trace (see wds::ChromeTraceWriter) on exit.
+//
+// The formats negotiated with each sink are remembered by its address so
+// that the pipeline is built right away when it reconnects. The video
+// format is chosen within what the encoder and the link to the sink
+// sustain.
+class MiracSourceSessionManager : public MiracSessionManager {
+ public:
+  MiracSourceSessionManager(int rtsp_port, uint shards, bool io_thread,
+                            const std::string& trace_file = std::string());
+  ~MiracSourceSessionManager();
+
+  // |func| runs on the thread of each session, see foreach_session().
+  void foreach_source(const std::function<void(wds::Source*)>& func);
+
+  bool records_trace() const { return !trace_file_.empty(); }
+  // Shared by the sessions of all the threads.
+  wds::CapabilityCache* capability_cache() { return &capability_cache_; }
+  // Called from the session threads.
+  void add_trace(const std::string& session_name,
+                 const std::vector<wds::TimelineEvent>& timeline);
+
+  // 0 for no limit.
+  void set_encoder_pixel_rate(unsigned pixels_per_second);
+  // |mbps| as advertised in the WFD IE of the sink at |address|.
+  void set_link_throughput(const std::string& address, unsigned mbps);
+  // Called from the session threads.
+  wds::VideoFormatCostModel video_cost_model(const std::string& address);
+
+  void set_encoder_profile(const MiracEncoderProfile& profile);
+  // Called from the session threads.
+  MiracEncoderProfile encoder_profile();
+
+ private:
+  MiracBroker* create_session(MiracNetwork* connection) override;
+  void write_trace();
+
+  std::string trace_file_;
+  std::mutex trace_mutex_;
+  wds::ChromeTraceWriter trace_;
+  wds::CapabilityCache capability_cache_;
+  std::mutex cost_mutex_;
+  unsigned encoder_pixel_rate_;
+  std::map<std::string, unsigned> link_throughput_;
+  MiracEncoderProfile encoder_profile_;
+};
+
 #endif // MIRAC_BROKER_SOURCE_H_
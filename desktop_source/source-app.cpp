@@ -80,9 +80,12 @@ void SourceApp::on_availability_changed(P2P::Peer *peer)
         return;
 
     std::cout << "* Connected to " << peer->remote_host()  << std::endl;
+    sessions_->set_link_throughput(peer->remote_host(),
+                                   peer->maximum_throughput());
 }
 
-SourceApp::SourceApp(int port) :
+SourceApp::SourceApp(int port, uint shards, bool io_thread,
+                     const std::string& trace_file) :
     peer_index_(0)
 {
     // Create a information element for a simple WFD Source
@@ -103,7 +106,8 @@ SourceApp::SourceApp(int port) :
     auto array = ie.serialize ();
     p2p_client_.reset(new P2P::Client(array, this));
 
-    source_.reset(new MiracBrokerSource(port));
+    sessions_.reset(new MiracSourceSessionManager(port, shards, io_thread,
+                                                  trace_file));
 }
 
 SourceApp::~SourceApp()
@@ -30,10 +30,11 @@
 
 class SourceApp: public P2P::Client::Observer, public P2P::Peer::Observer {
   public:
-    SourceApp(int port);
+    SourceApp(int port, uint shards, bool io_thread,
+              const std::string& trace_file);
     ~SourceApp();
 
-    MiracBrokerSource* source() { return source_.get(); }
+    MiracSourceSessionManager* sessions() { return sessions_.get(); }
 
     void on_peer_added(P2P::Client *client, std::shared_ptr<P2P::Peer> peer) override;
     void on_peer_removed(P2P::Client *client, std::shared_ptr<P2P::Peer> peer) override;
@@ -47,7 +48,7 @@ class SourceApp: public P2P::Client::Observer, public P2P::Peer::Observer {
 
   private:
     std::unique_ptr<P2P::Client> p2p_client_;
-    std::unique_ptr<MiracBrokerSource> source_;
+    std::unique_ptr<MiracSourceSessionManager> sessions_;
     std::map<uint, P2P::Peer*>peers_;
     uint peer_index_;
 };
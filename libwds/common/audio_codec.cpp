@@ -0,0 +1,143 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "libwds/public/audio_codec.h"
+
+#include "libwds/public/logging.h"
+
+namespace wds {
+
+namespace {
+
+// The latency field of 'wfd-audio-codecs' is in units of 5 ms.
+const unsigned kLatencyUnitMs = 5;
+
+const AudioModeInfo lpcm_modes[] = {
+  AudioModeInfo(44100, 2, 1411, 0, 0),  // LPCM_44_1K_16B_2CH
+  AudioModeInfo(48000, 2, 1536, 0, 0),  // LPCM_48K_16B_2CH
+};
+
+const AudioModeInfo aac_modes[] = {
+  AudioModeInfo(48000, 2, 128, 2, 43),  // AAC_48K_16B_2CH
+  AudioModeInfo(48000, 4, 256, 4, 43),  // AAC_48K_16B_4CH
+  AudioModeInfo(48000, 6, 384, 6, 43),  // AAC_48K_16B_6CH
+  AudioModeInfo(48000, 8, 512, 8, 43),  // AAC_48K_16B_8CH
+};
+
+const AudioModeInfo ac3_modes[] = {
+  AudioModeInfo(48000, 2, 192, 1, 32),  // AC3_48K_16B_2CH
+  AudioModeInfo(48000, 4, 384, 2, 32),  // AC3_48K_16B_4CH
+  AudioModeInfo(48000, 6, 448, 3, 32),  // AC3_48K_16B_6CH
+};
+
+template <size_t N>
+AudioModeInfo mode_info(const AudioModeInfo (&modes)[N], unsigned mode) {
+  return mode < N ? modes[mode] : AudioModeInfo();
+}
+
+struct Candidate {
+  Candidate() : cost(0) {}
+
+  AudioCodec codec;
+  AudioModeInfo info;
+  double cost;
+};
+
+double cost(const AudioModeInfo& info, unsigned remote_latency,
+            const AudioCostModel& cost_model) {
+  return info.codec_latency_ms + remote_latency * kLatencyUnitMs +
+      cost_model.encode_cost_weight * info.encode_cost +
+      cost_model.bitrate_weight * info.bitrate_kbps;
+}
+
+bool is_better(const Candidate& candidate, const Candidate& best,
+               const AudioCostModel& cost_model) {
+  bool fits = !cost_model.link_kbps ||
+      candidate.info.bitrate_kbps <= cost_model.link_kbps;
+  bool best_fits = !cost_model.link_kbps ||
+      best.info.bitrate_kbps <= cost_model.link_kbps;
+  if (fits != best_fits)
+    return fits;
+  if (!fits)
+    return candidate.info.bitrate_kbps < best.info.bitrate_kbps;
+  if (candidate.info.channels != best.info.channels)
+    return candidate.info.channels > best.info.channels;
+  return candidate.cost < best.cost;
+}
+
+}  // namespace
+
+AudioModeInfo GetAudioModeInfo(AudioFormats format, unsigned mode) {
+  switch (format) {
+    case LPCM:
+      return mode_info(lpcm_modes, mode);
+    case AAC:
+      return mode_info(aac_modes, mode);
+    case AC3:
+      return mode_info(ac3_modes, mode);
+  }
+  return AudioModeInfo();
+}
+
+AudioCodec FindOptimalAudioFormat(
+    const std::vector<AudioCodec>& local_codecs,
+    const std::vector<AudioCodec>& remote_codecs,
+    const AudioCostModel& cost_model,
+    bool* success) {
+  bool found = false;
+  Candidate best;
+  for (const AudioCodec& local : local_codecs) {
+    for (const AudioCodec& remote : remote_codecs) {
+      if (local.format != remote.format)
+        continue;
+      AudioModes common = local.modes & remote.modes;
+      for (unsigned mode = 0; mode < common.size(); ++mode) {
+        if (!common.test(mode))
+          continue;
+        Candidate candidate;
+        candidate.info = GetAudioModeInfo(remote.format, mode);
+        if (!candidate.info.channels)
+          continue;
+        if (cost_model.max_channels &&
+            candidate.info.channels > cost_model.max_channels)
+          continue;
+        candidate.codec = AudioCodec(remote.format,
+            AudioModes().set(mode), remote.latency);
+        candidate.cost = cost(candidate.info, remote.latency, cost_model);
+        if (!found || is_better(candidate, best, cost_model)) {
+          best = candidate;
+          found = true;
+        }
+      }
+    }
+  }
+
+  if (success)
+    *success = found;
+  if (!found)
+    return AudioCodec();
+  if (cost_model.link_kbps && best.info.bitrate_kbps > cost_model.link_kbps)
+    WDS_WARNING("No audio format fits the link, using the lowest bitrate one.");
+  return best.codec;
+}
+
+}  // namespace wds
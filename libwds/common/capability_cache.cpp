@@ -0,0 +1,73 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "libwds/public/capability_cache.h"
+
+namespace wds {
+
+CapabilityCache::CapabilityCache(size_t capacity)
+  : capacity_(capacity) {
+}
+
+bool CapabilityCache::Lookup(const std::string& peer_id,
+                             NegotiatedFormats* formats) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(peer_id);
+  if (it == index_.end())
+    return false;
+
+  entries_.splice(entries_.begin(), entries_, it->second);
+  *formats = it->second->second;
+  return true;
+}
+
+void CapabilityCache::Store(const std::string& peer_id,
+                            const NegotiatedFormats& formats) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(peer_id);
+  if (it != index_.end()) {
+    entries_.splice(entries_.begin(), entries_, it->second);
+    it->second->second = formats;
+    return;
+  }
+
+  if (capacity_ == 0)
+    return;
+  if (entries_.size() == capacity_) {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  entries_.emplace_front(peer_id, formats);
+  index_[peer_id] = entries_.begin();
+}
+
+void CapabilityCache::Remove(const std::string& peer_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(peer_id);
+  if (it == index_.end())
+    return;
+
+  entries_.erase(it->second);
+  index_.erase(it);
+}
+
+}  // namespace wds
@@ -0,0 +1,48 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef LIBWDS_COMMON_LOG_SCOPE_H_
+#define LIBWDS_COMMON_LOG_SCOPE_H_
+
+#include "libwds/public/logging.h"
+
+namespace wds {
+
+// Routes the messages logged by the current thread to the given peer
+// log handler while in scope. A null |func| falls back to LogSystem.
+// Peers create one on every entry point so that nested calls into
+// another peer (e.g. from a delegate) restore the outer handler.
+class ScopedLogHandler {
+ public:
+  ScopedLogHandler(SessionLogFunction func, void* user_data);
+  ~ScopedLogHandler();
+
+ private:
+  ScopedLogHandler(const ScopedLogHandler&) = delete;
+  ScopedLogHandler& operator=(const ScopedLogHandler&) = delete;
+
+  SessionLogFunction previous_func_;
+  void* previous_user_data_;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_COMMON_LOG_SCOPE_H_
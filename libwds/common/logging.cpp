@@ -21,44 +21,467 @@
 
 #include "libwds/public/logging.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "libwds/common/log_scope.h"
+
 namespace wds {
 
-static void Dummy(const char*, ...) {}
-LogSystem::LogFunction LogSystem::log_func_ = &Dummy;
-LogSystem::LogFunction LogSystem::vlog_func_ = &Dummy;
-LogSystem::LogFunction LogSystem::warning_func_ = &Dummy;
-LogSystem::LogFunction LogSystem::error_func_ = &Dummy;
+namespace {
+
+void Dummy(const char*, ...) {}
+
+std::atomic<LogSystem::LogFunction> log_func_(&Dummy);
+std::atomic<LogSystem::LogFunction> vlog_func_(&Dummy);
+std::atomic<LogSystem::LogFunction> warning_func_(&Dummy);
+std::atomic<LogSystem::LogFunction> error_func_(&Dummy);
+std::atomic<LogLevel> log_level_(LogLevelVerbose);
+// One more than the most verbose level kept in the ring buffer, 0 when
+// the buffer is disabled.
+std::atomic<int> ring_buffer_levels_(0);
+
+struct SessionLogHandler {
+  SessionLogFunction func;
+  void* user_data;
+};
+
+thread_local SessionLogHandler current_handler = {nullptr, nullptr};
+
+bool IsDummy(LogSystem::LogFunction func) {
+  return func == nullptr || func == &Dummy;
+}
+
+// Formats a single printf() conversion |spec| with the given argument.
+// The length modifiers of |spec| are replaced to match the stored type.
+void FormatArg(std::string spec, const LogArg& arg, std::string* out) {
+  char conversion = spec.back();
+  spec.pop_back();
+  while (!spec.empty() && strchr("hljztL", spec.back()))
+    spec.pop_back();
+
+  bool is_integer = arg.type == LogArg::Signed || arg.type == LogArg::Unsigned;
+  std::string integer_spec = spec + "ll" + conversion;
+  spec += conversion;
+
+  char buffer[128];
+  int length = -1;
+  switch (conversion) {
+  case 'd': case 'i':
+    if (is_integer)
+      length = snprintf(buffer, sizeof(buffer), integer_spec.c_str(),
+                        arg.value.s);
+    break;
+  case 'u': case 'o': case 'x': case 'X':
+    if (is_integer)
+      length = snprintf(buffer, sizeof(buffer), integer_spec.c_str(),
+                        arg.value.u);
+    break;
+  case 'c':
+    if (is_integer)
+      length = snprintf(buffer, sizeof(buffer), spec.c_str(),
+                        static_cast<int>(arg.value.s));
+    break;
+  case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a':
+  case 'A':
+    if (arg.type == LogArg::Double)
+      length = snprintf(buffer, sizeof(buffer), spec.c_str(), arg.value.d);
+    break;
+  case 'p':
+    if (arg.type == LogArg::Pointer)
+      length = snprintf(buffer, sizeof(buffer), spec.c_str(), arg.value.ptr);
+    break;
+  case 's':
+    if (arg.type == LogArg::String) {
+      // Plain %s is not limited by the size of |buffer|.
+      if (spec == "%s") {
+        *out += arg.value.str;
+        return;
+      }
+      length = snprintf(buffer, sizeof(buffer), spec.c_str(), arg.value.str);
+    }
+    break;
+  }
+
+  if (length < 0)
+    *out += "<?>";
+  else
+    out->append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+// Same as vsnprintf() but with the arguments stored by the ring buffer.
+std::string FormatMessage(const char* format, const std::vector<LogArg>& args) {
+  std::string message;
+  size_t next_arg = 0;
+  for (const char* p = format; *p; ++p) {
+    if (*p != '%') {
+      message += *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      message += '%';
+      ++p;
+      continue;
+    }
+    // Flags, width, precision and length, '*' is not supported.
+    const char* end = p + 1;
+    while (*end && strchr("-+ #0123456789.hljztL", *end))
+      ++end;
+    if (!*end || !strchr("diouxXcfFeEgGaAps", *end) ||
+        next_arg == args.size()) {
+      message += '%';
+      continue;
+    }
+    FormatArg(std::string(p, end + 1), args[next_arg++], &message);
+    p = end;
+  }
+  return message;
+}
+
+// Orders the records of all the threads when the buffers are dumped.
+std::atomic<uint64_t> ring_buffer_sequence_(0);
+
+// Circular byte buffer of variable length records:
+//   uint32_t size, uint64_t sequence, uint8_t level, uint8_t arg count,
+//   const char* format,
+// followed by every argument as uint8_t type and either its 8 byte value
+// or, for strings, uint32_t length and the characters. The oldest records
+// are dropped to make room for new ones. Every thread appends to a buffer
+// of its own, the lock is only contended by a dump.
+class RingBuffer {
+ public:
+  explicit RingBuffer(size_t size)
+    : buffer_(size), head_(0), tail_(0), used_(0) {}
+
+  void Resize(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<char>(size).swap(buffer_);
+    head_ = tail_ = used_ = 0;
+  }
+
+  void Append(LogLevel level, const char* format,
+              const LogArg* args, int arg_count) {
+    uint32_t size = sizeof(uint32_t) + sizeof(uint64_t) + 2 + sizeof(format);
+    for (int i = 0; i < arg_count; ++i)
+      size += 1 + (args[i].type == LogArg::String ?
+          sizeof(uint32_t) + StringLength(args[i]) : sizeof(args[i].value));
+    uint64_t sequence =
+        ring_buffer_sequence_.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size > buffer_.size())
+      return;
+    while (buffer_.size() - used_ < size)
+      DropOldest();
+
+    uint8_t header[] = {static_cast<uint8_t>(level),
+                        static_cast<uint8_t>(arg_count)};
+    Write(&size, sizeof(size));
+    Write(&sequence, sizeof(sequence));
+    Write(header, sizeof(header));
+    Write(&format, sizeof(format));
+    for (int i = 0; i < arg_count; ++i) {
+      uint8_t type = args[i].type;
+      Write(&type, sizeof(type));
+      if (args[i].type == LogArg::String) {
+        uint32_t length = StringLength(args[i]);
+        Write(&length, sizeof(length));
+        Write(args[i].value.str ? args[i].value.str : "(null)", length);
+      } else {
+        Write(&args[i].value, sizeof(args[i].value));
+      }
+    }
+  }
+
+  // Appends the records, oldest first, to |records|. Only the raw bytes
+  // are copied under the lock, see FormatRecords().
+  void Copy(std::vector<char>* records) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (used_ == 0)
+      return;
+    size_t offset = records->size();
+    records->resize(offset + used_);
+    Read(tail_, &(*records)[offset], used_);
+  }
+
+ private:
+  // Longer strings are truncated.
+  static const uint32_t kMaxStringLength = 4096;
+
+  static uint32_t StringLength(const LogArg& arg) {
+    const char* str = arg.value.str ? arg.value.str : "(null)";
+    return strnlen(str, kMaxStringLength);
+  }
+
+  void DropOldest() {
+    uint32_t size;
+    Read(tail_, &size, sizeof(size));
+    tail_ = (tail_ + size) % buffer_.size();
+    used_ -= size;
+  }
+
+  void Write(const void* data, size_t size) {
+    size_t first = std::min(size, buffer_.size() - head_);
+    memcpy(&buffer_[head_], data, first);
+    memcpy(&buffer_[0], static_cast<const char*>(data) + first, size - first);
+    head_ = (head_ + size) % buffer_.size();
+    used_ += size;
+  }
+
+  size_t Read(size_t offset, void* data, size_t size) const {
+    size_t first = std::min(size, buffer_.size() - offset);
+    memcpy(data, &buffer_[offset], first);
+    memcpy(static_cast<char*>(data) + first, &buffer_[0], size - first);
+    return (offset + size) % buffer_.size();
+  }
+
+  std::mutex mutex_;
+  std::vector<char> buffer_;
+  size_t head_;
+  size_t tail_;
+  size_t used_;
+};
+
+struct RingBufferMessage {
+  uint64_t sequence;
+  LogLevel level;
+  std::string text;
+};
+
+const char* ReadRecord(const char* pos, void* data, size_t size) {
+  memcpy(data, pos, size);
+  return pos + size;
+}
+
+// Formats the records copied by RingBuffer::Copy().
+void FormatRecords(const std::vector<char>& records,
+                   std::vector<RingBufferMessage>* messages) {
+  for (size_t offset = 0; offset < records.size();) {
+    uint32_t size;
+    uint64_t sequence;
+    uint8_t header[2];
+    const char* format;
+    const char* pos = &records[offset];
+    pos = ReadRecord(pos, &size, sizeof(size));
+    pos = ReadRecord(pos, &sequence, sizeof(sequence));
+    pos = ReadRecord(pos, header, sizeof(header));
+    pos = ReadRecord(pos, &format, sizeof(format));
+
+    // The strings are kept in |storage| until formatted.
+    std::vector<LogArg> args(header[1]);
+    std::vector<std::string> storage(header[1]);
+    for (size_t i = 0; i < args.size(); ++i) {
+      uint8_t type;
+      pos = ReadRecord(pos, &type, sizeof(type));
+      args[i].type = static_cast<LogArg::Type>(type);
+      if (args[i].type == LogArg::String) {
+        uint32_t length;
+        pos = ReadRecord(pos, &length, sizeof(length));
+        storage[i].assign(pos, length);
+        pos += length;
+        args[i].value.str = storage[i].c_str();
+      } else {
+        pos = ReadRecord(pos, &args[i].value, sizeof(args[i].value));
+      }
+    }
+    messages->push_back({sequence, static_cast<LogLevel>(header[0]),
+                         FormatMessage(format, args)});
+    offset += size;
+  }
+}
+
+// The ring buffers of all the threads. The buffer of a thread that exits
+// is kept, together with its messages, and handed to the next new thread,
+// so there are as many buffers as threads logging at the same time.
+class RingBufferSet {
+ public:
+  RingBufferSet() : size_(0) {}
+
+  void Resize(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_ = size;
+    for (const auto& buffer : buffers_)
+      buffer->Resize(size);
+  }
+
+  RingBuffer* Acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_.empty()) {
+      RingBuffer* buffer = free_.back();
+      free_.pop_back();
+      return buffer;
+    }
+    buffers_.emplace_back(new RingBuffer(size_));
+    return buffers_.back().get();
+  }
+
+  void Release(RingBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(buffer);
+  }
+
+  void Dump(RingBufferDumpFunction func, void* user_data) {
+    std::vector<char> records;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto& buffer : buffers_)
+        buffer->Copy(&records);
+    }
+    std::vector<RingBufferMessage> messages;
+    FormatRecords(records, &messages);
+    std::sort(messages.begin(), messages.end(),
+              [](const RingBufferMessage& a, const RingBufferMessage& b) {
+                return a.sequence < b.sequence;
+              });
+    // |func| may log, so it is called without holding any lock.
+    for (const auto& message : messages)
+      func(user_data, message.level, message.text.c_str());
+  }
+
+ private:
+  std::mutex mutex_;
+  size_t size_;
+  std::vector<std::unique_ptr<RingBuffer>> buffers_;
+  std::vector<RingBuffer*> free_;
+};
+
+RingBufferSet ring_buffers;
+
+// Ring buffer of the current thread, taken on its first message.
+class ThreadRingBuffer {
+ public:
+  ThreadRingBuffer() : buffer_(nullptr) {}
+  ~ThreadRingBuffer() {
+    if (buffer_)
+      ring_buffers.Release(buffer_);
+  }
+
+  RingBuffer* get() {
+    if (!buffer_)
+      buffer_ = ring_buffers.Acquire();
+    return buffer_;
+  }
+
+ private:
+  RingBuffer* buffer_;
+};
+
+thread_local ThreadRingBuffer thread_ring_buffer;
+
+}  // namespace
 
 void LogSystem::set_log_func(LogFunction func) {
-  log_func_ = func;
+  log_func_.store(func, std::memory_order_relaxed);
 }
 
 LogSystem::LogFunction LogSystem::log_func() {
-  return log_func_;
+  return log_func_.load(std::memory_order_relaxed);
 }
 
 void LogSystem::set_vlog_func(LogFunction func) {
-  vlog_func_ = func;
+  vlog_func_.store(func, std::memory_order_relaxed);
 }
 
 LogSystem::LogFunction LogSystem::vlog_func() {
-  return vlog_func_;
+  return vlog_func_.load(std::memory_order_relaxed);
 }
 
 void LogSystem::set_warning_func(LogFunction func) {
-  warning_func_ = func;
+  warning_func_.store(func, std::memory_order_relaxed);
 }
 
 LogSystem::LogFunction LogSystem::warning_func() {
-  return warning_func_;
+  return warning_func_.load(std::memory_order_relaxed);
 }
 
 void LogSystem::set_error_func(LogFunction func) {
-  error_func_ = func;
+  error_func_.store(func, std::memory_order_relaxed);
 }
 
 LogSystem::LogFunction LogSystem::error_func() {
-  return error_func_;
+  return error_func_.load(std::memory_order_relaxed);
+}
+
+void LogSystem::set_log_level(LogLevel level) {
+  log_level_.store(level, std::memory_order_relaxed);
+}
+
+LogLevel LogSystem::log_level() {
+  return log_level_.load(std::memory_order_relaxed);
+}
+
+void LogSystem::set_ring_buffer(size_t size, LogLevel level) {
+  ring_buffer_levels_.store(0, std::memory_order_relaxed);
+  ring_buffers.Resize(size);
+  if (size > 0)
+    ring_buffer_levels_.store(level + 1, std::memory_order_relaxed);
+}
+
+void LogSystem::dump_ring_buffer(RingBufferDumpFunction func,
+                                 void* user_data) {
+  ring_buffers.Dump(func, user_data);
+}
+
+bool LogSystem::is_enabled(LogLevel level) {
+  return ring_buffer_enabled(level) || output_enabled(level);
+}
+
+bool LogSystem::output_enabled(LogLevel level) {
+  if (level > log_level())
+    return false;
+  if (has_session_handler())
+    return true;
+
+  switch (level) {
+  case LogLevelError:
+    return !IsDummy(error_func());
+  case LogLevelWarning:
+    return !IsDummy(warning_func());
+  case LogLevelInfo:
+    return !IsDummy(log_func());
+  case LogLevelVerbose:
+    return !IsDummy(vlog_func());
+  }
+  return false;
+}
+
+bool LogSystem::ring_buffer_enabled(LogLevel level) {
+  return level < ring_buffer_levels_.load(std::memory_order_relaxed);
+}
+
+void LogSystem::ring_buffer_log(LogLevel level, const char* format,
+                                const LogArg* args, int arg_count) {
+  thread_ring_buffer.get()->Append(level, format, args, arg_count);
+}
+
+bool LogSystem::has_session_handler() {
+  return current_handler.func != nullptr;
+}
+
+void LogSystem::session_log(LogLevel level, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  current_handler.func(current_handler.user_data, level, format, args);
+  va_end(args);
+}
+
+ScopedLogHandler::ScopedLogHandler(SessionLogFunction func, void* user_data)
+  : previous_func_(current_handler.func),
+    previous_user_data_(current_handler.user_data) {
+  current_handler.func = func;
+  current_handler.user_data = user_data;
+}
+
+ScopedLogHandler::~ScopedLogHandler() {
+  current_handler.func = previous_func_;
+  current_handler.user_data = previous_user_data_;
 }
 
 }  // namespace wds
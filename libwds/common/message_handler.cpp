@@ -30,12 +30,65 @@ using rtsp::Message;
 using rtsp::Request;
 using rtsp::Reply;
 
-bool MessageHandler::HandleTimeoutEvent(unsigned timer_id) const {
+bool MessageHandler::HandleTimeoutEvent(unsigned timer_id) {
   return false;
 }
 
 MessageHandler::~MessageHandler() {}
 
+void MessageHandler::Await(MediaCompletionPtr completion,
+                           CompletionCallback callback) {
+  assert(completion);
+  std::weak_ptr<MessageHandler> weak_this = shared_from_this();
+  unsigned generation = await_generation_;
+  completion->Then([weak_this, generation, callback](bool result) {
+    auto handler = weak_this.lock();
+    if (handler && handler->await_generation_ == generation)
+      callback(result);
+  });
+}
+
+void MessageHandler::AwaitMediaCall(
+    rtsp::Request::ID id, const char* name,
+    const std::function<MediaCompletionPtr()>& call,
+    CompletionCallback callback) {
+  WDS_TRACE3(media__call__entry, peer_, id, name);
+  if (timeline_)
+    timeline_->Record(TimelineEvent::MediaCallEntered, id, 0, name);
+  TimelineRecorder* timeline = timeline_;
+  const Peer* peer = peer_;
+  Await(call(), [timeline, peer, id, name, callback](bool result) {
+    WDS_TRACE3(media__call__return, peer, id, name);
+    if (timeline)
+      timeline->Record(TimelineEvent::MediaCallReturned, id, 0, name);
+    callback(result);
+  });
+}
+
+void MessageHandler::RecordTimelineEvent(TimelineEvent::Type type,
+                                         rtsp::Request::ID id, int cseq) {
+  switch (type) {
+  case TimelineEvent::RequestSent:
+    WDS_TRACE3(request__sent, peer_, cseq, id);
+    break;
+  case TimelineEvent::RequestReceived:
+    WDS_TRACE3(request__received, peer_, cseq, id);
+    break;
+  case TimelineEvent::ReplySent:
+    WDS_TRACE3(reply__sent, peer_, cseq, id);
+    break;
+  case TimelineEvent::ReplyReceived:
+    WDS_TRACE3(reply__received, peer_, cseq, id);
+    break;
+  default:
+    break;
+  }
+  if (timeline_)
+    timeline_->Record(type, id, cseq);
+  if (stats_)
+    stats_->CountMessage(type, id);
+}
+
 MessageSequenceHandler::MessageSequenceHandler(const InitParams& init_params)
   : MessageHandler(init_params),
     current_handler_(nullptr) {
@@ -48,6 +101,7 @@ void MessageSequenceHandler::Start() {
   if (current_handler_) {
     return;
   }
+  WDS_TRACE2(handler__start, peer_, this);
   current_handler_ = handlers_.front();
   current_handler_->Start();
 }
@@ -88,6 +142,7 @@ void MessageSequenceHandler::AddSequencedHandler(MessageHandlerPtr handler) {
 
 void MessageSequenceHandler::OnCompleted(MessageHandlerPtr handler) {
   assert(handler == current_handler_);
+  WDS_TRACE2(handler__completed, peer_, handler.get());
   current_handler_->Reset();
 
   auto it = std::find(handlers_.begin(), handlers_.end(), handler);
@@ -103,11 +158,12 @@ void MessageSequenceHandler::OnCompleted(MessageHandlerPtr handler) {
 
 void MessageSequenceHandler::OnError(MessageHandlerPtr handler) {
   assert(handler == current_handler_);
+  WDS_TRACE2(handler__error, peer_, handler.get());
   handler->Reset();
   observer_->OnError(shared_from_this());
 }
 
-bool MessageSequenceHandler::HandleTimeoutEvent(unsigned timer_id) const {
+bool MessageSequenceHandler::HandleTimeoutEvent(unsigned timer_id) {
   return current_handler_->HandleTimeoutEvent(timer_id);
 }
 
@@ -198,6 +254,7 @@ void MessageSequenceWithOptionalSetHandler::OnCompleted(MessageHandlerPtr handle
   auto it = std::find(
       optional_handlers_.begin(), optional_handlers_.end(), handler);
   if (it != optional_handlers_.end()) {
+    WDS_TRACE2(handler__completed, peer_, handler.get());
     handler->Reset();
     handler->Start();
     return;
@@ -206,11 +263,12 @@ void MessageSequenceWithOptionalSetHandler::OnCompleted(MessageHandlerPtr handle
 }
 
 void MessageSequenceWithOptionalSetHandler::OnError(MessageHandlerPtr handler) {
+  WDS_TRACE2(handler__error, peer_, handler.get());
   handler->Reset();
   observer_->OnError(shared_from_this());
 }
 
-bool MessageSequenceWithOptionalSetHandler::HandleTimeoutEvent(unsigned timer_id) const {
+bool MessageSequenceWithOptionalSetHandler::HandleTimeoutEvent(unsigned timer_id) {
   for (MessageHandlerPtr handler : optional_handlers_)
     if (handler->HandleTimeoutEvent(timer_id))
       return true;
@@ -229,10 +287,26 @@ bool MessageReceiverBase::CanHandle(Message* message) const {
   return wait_for_message_;
 }
 
-void MessageReceiverBase::Start() { wait_for_message_ = true; }
-void MessageReceiverBase::Reset() { wait_for_message_ = false; }
+void MessageReceiverBase::Start() {
+  WDS_TRACE2(handler__start, peer_, this);
+  wait_for_message_ = true;
+}
+void MessageReceiverBase::Reset() {
+  wait_for_message_ = false;
+  CancelAwaited();
+}
 bool MessageReceiverBase::CanSend(Message* message) const { return false; }
 void MessageReceiverBase::Send(std::unique_ptr<Message> message) {}
+
+std::unique_ptr<Reply> MessageReceiverBase::HandleMessage(Message* message) {
+  return nullptr;
+}
+
+void MessageReceiverBase::HandleMessageAsync(
+    Message* message, const ReplyCallback& reply_callback) {
+  reply_callback(HandleMessage(message));
+}
+
 void MessageReceiverBase::Handle(std::unique_ptr<Message> message) {
   assert(message);
   if (!CanHandle(message.get())) {
@@ -240,13 +314,25 @@ void MessageReceiverBase::Handle(std::unique_ptr<Message> message) {
     return;
   }
   wait_for_message_ = false;
-  std::unique_ptr<Reply> reply = HandleMessage(message.get());
+  int cseq = message->cseq();
+  Request::ID id = message->is_request() ? ToRequest(message.get())->id()
+                                         : Request::UNKNOWN;
+  RecordTimelineEvent(TimelineEvent::RequestReceived, id, cseq);
+  HandleMessageAsync(message.get(),
+      [this, id, cseq](std::unique_ptr<Reply> reply) {
+        SendReply(id, cseq, std::move(reply));
+      });
+}
+
+void MessageReceiverBase::SendReply(Request::ID id, int cseq,
+                                    std::unique_ptr<Reply> reply) {
   if (!reply) {
     observer_->OnError(shared_from_this());
     return;
   }
-  reply->header().set_cseq(message->cseq());
+  reply->header().set_cseq(cseq);
   sender_->SendRTSPData(reply->ToString());
+  RecordTimelineEvent(TimelineEvent::ReplySent, id, cseq);
   observer_->OnCompleted(shared_from_this());
 }
 
@@ -260,6 +346,7 @@ MessageSenderBase::~MessageSenderBase() {
 }
 
 void MessageSenderBase::Reset() {
+  CancelAwaited();
   while (!parcel_queue_.empty()) {
     sender_->ReleaseTimer(parcel_queue_.front().timer_id);
     parcel_queue_.pop_front();
@@ -272,9 +359,12 @@ void MessageSenderBase::Send(std::unique_ptr<Message> message) {
     observer_->OnError(shared_from_this());
     return;
   }
-  parcel_queue_.push_back(
-      {message->cseq(), sender_->CreateTimer(GetResponseTimeout())});
+  Request::ID id = ToRequest(message.get())->id();
+  parcel_queue_.push_back({message->cseq(),
+                           sender_->CreateTimer(GetResponseTimeout()), id,
+                           stats_ ? MonotonicMicroseconds() : 0});
   sender_->SendRTSPData(message->ToString());
+  RecordTimelineEvent(TimelineEvent::RequestSent, id, message->cseq());
 }
 
 bool MessageSenderBase::CanHandle(Message* message) const {
@@ -289,10 +379,24 @@ void MessageSenderBase::Handle(std::unique_ptr<Message> message) {
     observer_->OnError(shared_from_this());
     return;
   }
-  sender_->ReleaseTimer(parcel_queue_.front().timer_id);
+  const ParcelData& parcel = parcel_queue_.front();
+  RecordTimelineEvent(TimelineEvent::ReplyReceived, parcel.id, parcel.cseq);
+  if (stats_)
+    stats_->round_trip_time().Record(MonotonicMicroseconds() - parcel.sent_us);
+  sender_->ReleaseTimer(parcel.timer_id);
   parcel_queue_.pop_front();
 
-  if (!HandleReply(static_cast<Reply*>(message.get()))) {
+  HandleReplyAsync(static_cast<Reply*>(message.get()),
+      [this](bool success) { OnReplyHandled(success); });
+}
+
+void MessageSenderBase::HandleReplyAsync(Reply* reply,
+                                         const CompletionCallback& done) {
+  done(HandleReply(reply));
+}
+
+void MessageSenderBase::OnReplyHandled(bool success) {
+  if (!success) {
     observer_->OnError(shared_from_this());
     return;
   }
@@ -302,7 +406,7 @@ void MessageSenderBase::Handle(std::unique_ptr<Message> message) {
   }
 }
 
-bool MessageSenderBase::HandleTimeoutEvent(unsigned timer_id) const {
+bool MessageSenderBase::HandleTimeoutEvent(unsigned timer_id) {
   for (const ParcelData& data : parcel_queue_)
     if (data.timer_id == timer_id)
       return true;
@@ -323,6 +427,11 @@ SequencedMessageSender::~SequencedMessageSender() {
 }
 
 void SequencedMessageSender::Start() {
+  WDS_TRACE2(handler__start, peer_, this);
+  Resend();
+}
+
+void SequencedMessageSender::Resend() {
   auto message = CreateMessage();
   to_be_send_ = message.get();
   Send(std::move(message));
@@ -23,14 +23,19 @@
 #define LIBWDS_COMMON_MESSAGE_HANDLER_H_
 
 #include <cassert>
+#include <functional>
 #include <list>
 #include <vector>
 #include <memory>
 #include <utility>
 
+#include "libwds/common/stats_recorder.h"
+#include "libwds/common/timeline.h"
+#include "libwds/common/tracepoints.h"
 #include "libwds/rtsp/message.h"
 #include "libwds/rtsp/reply.h"
 #include "libwds/public/logging.h"
+#include "libwds/public/media_completion.h"
 #include "libwds/public/peer.h"
 
 namespace wds {
@@ -64,6 +69,10 @@ class MessageHandler : public std::enable_shared_from_this<MessageHandler> {
     Peer::Delegate* sender;
     MediaManager* manager;
     Observer* observer;
+    TimelineRecorder* timeline;
+    StatsRecorder* stats;
+    // Passed to the trace probes.
+    const Peer* peer;
   };
 
   virtual ~MessageHandler();
@@ -77,8 +86,10 @@ class MessageHandler : public std::enable_shared_from_this<MessageHandler> {
   virtual bool CanHandle(rtsp::Message* message) const = 0;
   virtual void Handle(std::unique_ptr<rtsp::Message> message) = 0;
 
-  // For handlers that require timeout
-  virtual bool HandleTimeoutEvent(unsigned timer_id) const;
+  // For handlers that require timeout, returns true if |timer_id| belongs
+  // to the handler and the session cannot go on without the awaited
+  // reply. A handler may also give up the reply and return false.
+  virtual bool HandleTimeoutEvent(unsigned timer_id);
 
   void set_observer(Observer* observer) {
     assert(observer);
@@ -86,18 +97,59 @@ class MessageHandler : public std::enable_shared_from_this<MessageHandler> {
   }
 
 protected:
+  using CompletionCallback = std::function<void(bool result)>;
+
   explicit MessageHandler(const InitParams& init_params)
     : sender_(init_params.sender),
       manager_(init_params.manager),
-      observer_(init_params.observer) {
+      observer_(init_params.observer),
+      timeline_(init_params.timeline),
+      stats_(init_params.stats),
+      peer_(init_params.peer),
+      await_generation_(0) {
     assert(sender_);
     assert(manager_);
     assert(observer_);
   }
 
+  // Calls |callback| once the media manager operation has completed,
+  // unless the handler is reset or destroyed in the meantime.
+  void Await(MediaCompletionPtr completion, CompletionCallback callback);
+  // Same for the operation started by |call|, which is also recorded on
+  // the session timeline as |name| during the |id| message exchange.
+  void AwaitMediaCall(rtsp::Request::ID id, const char* name,
+                      const std::function<MediaCompletionPtr()>& call,
+                      CompletionCallback callback);
+  // Makes the synchronous media manager call |call| while handling the
+  // |id| message, firing the media call trace probes around it.
+  template <typename Call>
+  auto TraceMediaCall(rtsp::Request::ID id, const char* name, Call call)
+      -> decltype(call()) {
+    struct ReturnProbe {
+      ~ReturnProbe() { WDS_TRACE3(media__call__return, peer, id, name); }
+      const Peer* peer;
+      rtsp::Request::ID id;
+      const char* name;
+    } return_probe = {peer_, id, name};
+    WDS_TRACE3(media__call__entry, peer_, id, name);
+    return call();
+  }
+  // Reports the message exchange step on the timeline, in the stats and
+  // to the trace probes.
+  void RecordTimelineEvent(TimelineEvent::Type type, rtsp::Request::ID id,
+                           int cseq);
+  // Drops the callbacks of all pending Await() calls.
+  void CancelAwaited() { ++await_generation_; }
+
   Peer::Delegate* sender_;
   MediaManager* manager_;
   Observer* observer_;
+  TimelineRecorder* timeline_;
+  StatsRecorder* stats_;
+  const Peer* peer_;
+
+ private:
+  unsigned await_generation_;
 };
 
 class MessageSequenceHandler : public MessageHandler,
@@ -114,7 +166,7 @@ class MessageSequenceHandler : public MessageHandler,
   bool CanHandle(rtsp::Message* message) const override;
   void Handle(std::unique_ptr<rtsp::Message> message) override;
 
-  bool HandleTimeoutEvent(unsigned timer_id) const override;
+  bool HandleTimeoutEvent(unsigned timer_id) override;
 
  protected:
   void AddSequencedHandler(MessageHandlerPtr handler);
@@ -137,7 +189,7 @@ class MessageSequenceWithOptionalSetHandler : public MessageSequenceHandler {
   bool CanHandle(rtsp::Message* message) const override;
   void Handle(std::unique_ptr<rtsp::Message> message) override;
 
-  bool HandleTimeoutEvent(unsigned timer_id) const override;
+  bool HandleTimeoutEvent(unsigned timer_id) override;
 
  protected:
   void AddOptionalHandler(MessageHandlerPtr handler);
@@ -156,13 +208,23 @@ class MessageSequenceWithOptionalSetHandler : public MessageSequenceHandler {
 // 2. We wait for the message and reply ourselves.
 // class Handler : public MessageReceiver<type of the message
 // we're waiting for>
+//
+// Handlers that have to wait for the media manager implement the *Async
+// variants of HandleMessage / HandleReply instead and report the outcome
+// from an Await() callback.
 class MessageReceiverBase : public MessageHandler {
  public:
   explicit MessageReceiverBase(const InitParams& init_params);
   ~MessageReceiverBase() override;
 
  protected:
-  virtual std::unique_ptr<wds::rtsp::Reply> HandleMessage(rtsp::Message* message) = 0;
+  using ReplyCallback = std::function<void(std::unique_ptr<rtsp::Reply>)>;
+
+  virtual std::unique_ptr<wds::rtsp::Reply> HandleMessage(rtsp::Message* message);
+  // The reply is sent once passed to |reply_callback|; the default
+  // implementation replies with HandleMessage() right away.
+  virtual void HandleMessageAsync(rtsp::Message* message,
+                                  const ReplyCallback& reply_callback);
   bool CanHandle(rtsp::Message* message) const override;
   void Handle(std::unique_ptr<rtsp::Message> message) override;
 
@@ -172,6 +234,9 @@ class MessageReceiverBase : public MessageHandler {
   bool CanSend(rtsp::Message* message) const override;
   void Send(std::unique_ptr<rtsp::Message> message) override;
 
+  void SendReply(rtsp::Request::ID id, int cseq,
+                 std::unique_ptr<rtsp::Reply> reply);
+
   bool wait_for_message_;
 };
 
@@ -194,20 +259,26 @@ class MessageSenderBase : public MessageHandler {
 
  protected:
   virtual bool HandleReply(rtsp::Reply* reply) = 0;
+  // |done| receives the outcome of handling the reply; the default
+  // implementation passes the result of HandleReply() right away.
+  virtual void HandleReplyAsync(rtsp::Reply* reply,
+                                const CompletionCallback& done);
   void Send(std::unique_ptr<rtsp::Message> message) override;
   void Reset() override;
-  bool HandleTimeoutEvent(unsigned timer_id) const override;
-
-
- private:
+  bool HandleTimeoutEvent(unsigned timer_id) override;
   bool CanHandle(rtsp::Message* message) const override;
   void Handle(std::unique_ptr<rtsp::Message> message) override;
 
+ private:
+  void OnReplyHandled(bool success);
+
   virtual int GetResponseTimeout() const;
 
   struct ParcelData {
     int cseq;
     unsigned timer_id;
+    rtsp::Request::ID id;
+    uint64_t sent_us;
   };
   std::list<ParcelData> parcel_queue_;
 };
@@ -236,6 +307,9 @@ class SequencedMessageSender : public MessageSenderBase {
 
  protected:
   virtual std::unique_ptr<rtsp::Message> CreateMessage() = 0;
+  // Sends a new message from CreateMessage(), e.g. to retry the request
+  // after an error reply.
+  void Resend();
 
  private:
   void Start() override;
@@ -0,0 +1,91 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "libwds/common/output_batch.h"
+
+#include <cassert>
+
+#include "libwds/common/tracepoints.h"
+
+namespace wds {
+
+BufferedDelegate::BufferedDelegate(Peer::Delegate* delegate,
+                                   StatsRecorder* stats,
+                                   const Peer* peer)
+  : delegate_(delegate),
+    stats_(stats),
+    peer_(peer),
+    batch_depth_(0) {
+  assert(delegate_);
+}
+
+BufferedDelegate::~BufferedDelegate() {
+  assert(!batch_depth_);
+}
+
+void BufferedDelegate::BeginBatch() {
+  ++batch_depth_;
+}
+
+void BufferedDelegate::EndBatch() {
+  assert(batch_depth_);
+  if (--batch_depth_ || pending_data_.empty())
+    return;
+
+  std::string data;
+  data.swap(pending_data_);
+  Flush(data);
+}
+
+void BufferedDelegate::SendRTSPData(const std::string& data) {
+  if (batch_depth_)
+    pending_data_ += data;
+  else
+    Flush(data);
+}
+
+void BufferedDelegate::Flush(const std::string& data) {
+  if (stats_)
+    stats_->CountBytesSent(data.size());
+  WDS_TRACE2(send__data, peer_, data.size());
+  delegate_->SendRTSPData(data);
+}
+
+std::string BufferedDelegate::GetLocalIPAddress() const {
+  return delegate_->GetLocalIPAddress();
+}
+
+unsigned BufferedDelegate::CreateTimer(int seconds) {
+  unsigned timer_id = delegate_->CreateTimer(seconds);
+  WDS_TRACE3(timer__create, peer_, timer_id, seconds);
+  return timer_id;
+}
+
+void BufferedDelegate::ReleaseTimer(unsigned timer_id) {
+  delegate_->ReleaseTimer(timer_id);
+}
+
+int BufferedDelegate::GetNextCSeq(int* initial_peer_cseq) const {
+  return delegate_->GetNextCSeq(initial_peer_cseq);
+}
+
+}  // namespace wds
@@ -0,0 +1,85 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef LIBWDS_COMMON_OUTPUT_BATCH_H_
+#define LIBWDS_COMMON_OUTPUT_BATCH_H_
+
+#include <string>
+
+#include "libwds/common/stats_recorder.h"
+#include "libwds/public/peer.h"
+
+namespace wds {
+
+// Peer::Delegate wrapper which holds back the RTSP data sent while a batch
+// is open, so that all the replies and requests produced by one call into
+// the peer reach the client delegate with a single SendRTSPData() call
+// (i.e. a single write on the connection). Everything else is forwarded.
+class BufferedDelegate final : public Peer::Delegate {
+ public:
+  // |stats| counts the bytes sent, may be null. |peer| is passed to the
+  // trace probes.
+  BufferedDelegate(Peer::Delegate* delegate, StatsRecorder* stats,
+                   const Peer* peer);
+  ~BufferedDelegate() override;
+
+  // Batches nest, the data is flushed when the outermost one ends.
+  void BeginBatch();
+  void EndBatch();
+
+  // Peer::Delegate
+  void SendRTSPData(const std::string& data) override;
+  std::string GetLocalIPAddress() const override;
+  unsigned CreateTimer(int seconds) override;
+  void ReleaseTimer(unsigned timer_id) override;
+  int GetNextCSeq(int* initial_peer_cseq = nullptr) const override;
+
+ private:
+  void Flush(const std::string& data);
+
+  Peer::Delegate* delegate_;
+  StatsRecorder* stats_;
+  const Peer* peer_;
+  unsigned batch_depth_;
+  std::string pending_data_;
+};
+
+// Keeps a batch open on the given delegate while in scope. Peers create
+// one on every entry point.
+class ScopedOutputBatch {
+ public:
+  explicit ScopedOutputBatch(BufferedDelegate* delegate)
+    : delegate_(delegate) {
+    delegate_->BeginBatch();
+  }
+  ~ScopedOutputBatch() { delegate_->EndBatch(); }
+
+ private:
+  ScopedOutputBatch(const ScopedOutputBatch&) = delete;
+  ScopedOutputBatch& operator=(const ScopedOutputBatch&) = delete;
+
+  BufferedDelegate* delegate_;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_COMMON_OUTPUT_BATCH_H_
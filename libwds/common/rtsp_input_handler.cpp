@@ -21,6 +21,9 @@
 
 #include "rtsp_input_handler.h"
 
+#include "libwds/common/stats_recorder.h"
+#include "libwds/common/timeline.h"
+#include "libwds/common/tracepoints.h"
 #include "libwds/rtsp/driver.h"
 #include "libwds/rtsp/message.h"
 
@@ -31,6 +34,12 @@ namespace wds {
 using rtsp::Message;
 using rtsp::Driver;
 
+RTSPInputHandler::RTSPInputHandler(const Peer* peer, StatsRecorder* stats)
+  : peer_(peer),
+    stats_(stats),
+    parse_time_us_(0) {
+}
+
 RTSPInputHandler::~RTSPInputHandler() {
 }
 
@@ -66,7 +75,7 @@ bool RTSPInputHandler::ParsePayload() {
   assert(message_);
   unsigned content_length = message_->header().content_length();
   if (content_length == 0) {
-    MessageParsed(std::move(message_));
+    DispatchMessage();
     return true;
   }
 
@@ -78,13 +87,36 @@ bool RTSPInputHandler::ParsePayload() {
   if (!Parse(payload))
     return false;
 
-  MessageParsed(std::move(message_));
+  DispatchMessage();
   return true;
 }
 
+void RTSPInputHandler::DispatchMessage() {
+  if (!stats_) {
+    MessageParsed(std::move(message_));
+    return;
+  }
+
+  stats_->parse_time().Record(parse_time_us_);
+  parse_time_us_ = 0;
+  uint64_t start = MonotonicMicroseconds();
+  MessageParsed(std::move(message_));
+  stats_->handler_time().Record(MonotonicMicroseconds() - start);
+}
+
 bool RTSPInputHandler::Parse(const std::string& input) {
+  // The header and the payload of a message are parsed separately.
+  uint64_t start = stats_ ? MonotonicMicroseconds() : 0;
+  WDS_TRACE2(parse__start, peer_, input.size());
   Driver::Parse(input, message_);
+  WDS_TRACE3(parse__done, peer_, message_ ? message_->cseq() : 0,
+             message_ != nullptr);
+  if (stats_)
+    parse_time_us_ += MonotonicMicroseconds() - start;
   if (!message_) {
+    parse_time_us_ = 0;
+    if (stats_)
+      stats_->CountParseError();
     ParserErrorOccurred(rtsp_input_buffer_);
     rtsp_input_buffer_.clear();
     return false;
@@ -22,6 +22,7 @@
 #ifndef LIBWDS_COMMON_RTSP_INPUT_HANDLER_H_
 #define LIBWDS_COMMON_RTSP_INPUT_HANDLER_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -31,10 +32,16 @@ namespace rtsp {
 class Message;
 }  // namespace rtsp
 
+class Peer;
+class StatsRecorder;
+
 // An aux class used to obtain Message object from the given raw input.
 class RTSPInputHandler {
  protected:
-  RTSPInputHandler() = default;
+  // |peer| is passed to the trace probes, |stats| records the parse and
+  // handler times, both may be null.
+  explicit RTSPInputHandler(const Peer* peer = nullptr,
+                            StatsRecorder* stats = nullptr);
   virtual ~RTSPInputHandler();
 
   void AddInput(const std::string& input);
@@ -47,9 +54,13 @@ class RTSPInputHandler {
   bool ParseHeader();
   bool ParsePayload();
   bool Parse(const std::string& input);
+  void DispatchMessage();
 
+  const Peer* peer_;
+  StatsRecorder* stats_;
   std::string rtsp_input_buffer_;
   std::unique_ptr<rtsp::Message> message_;
+  uint64_t parse_time_us_;
 };
 
 }
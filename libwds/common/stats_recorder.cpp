@@ -0,0 +1,149 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "libwds/common/stats_recorder.h"
+
+#include <cmath>
+
+namespace wds {
+
+namespace {
+
+// Four buckets per power of two.
+const int kSubBucketBits = 2;
+const int kSubBucketCount = 1 << kSubBucketBits;
+
+void Load(const std::atomic<uint64_t>* counters, uint64_t* values, int count) {
+  for (int i = 0; i < count; ++i)
+    values[i] = counters[i].load(std::memory_order_relaxed);
+}
+
+void Clear(std::atomic<uint64_t>* counters, int count) {
+  for (int i = 0; i < count; ++i)
+    counters[i].store(0, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+int LatencyHistogram::BucketIndex(uint64_t value_us) {
+  if (value_us < kSubBucketCount)
+    return value_us;
+  int exponent = 63 - __builtin_clzll(value_us);
+  int sub_bucket = (value_us >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1);
+  int index = (exponent - kSubBucketBits + 1) * kSubBucketCount + sub_bucket;
+  return index < kBucketCount ? index : kBucketCount - 1;
+}
+
+uint64_t LatencyHistogram::BucketLowerBound(int index) {
+  if (index < kSubBucketCount)
+    return index;
+  int exponent = index / kSubBucketCount - 1 + kSubBucketBits;
+  uint64_t sub_bucket = index % kSubBucketCount;
+  return (kSubBucketCount + sub_bucket) << (exponent - kSubBucketBits);
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const {
+  if (!count)
+    return 0;
+  uint64_t rank = std::ceil(count * percentile / 100);
+  uint64_t seen = 0;
+  for (int i = 0; i < kBucketCount - 1; ++i) {
+    seen += buckets[i];
+    if (seen >= rank && seen) {
+      uint64_t upper_bound = BucketLowerBound(i + 1) - 1;
+      return upper_bound < max_us ? upper_bound : max_us;
+    }
+  }
+  return max_us;
+}
+
+StatsRecorder::Histogram::Histogram() {
+  Clear(&count_, 1);
+  Clear(&total_us_, 1);
+  Clear(&max_us_, 1);
+  Clear(buckets_, LatencyHistogram::kBucketCount);
+}
+
+void StatsRecorder::Histogram::Record(uint64_t value_us) {
+  Add(&count_, 1);
+  Add(&total_us_, value_us);
+  if (value_us > max_us_.load(std::memory_order_relaxed))
+    max_us_.store(value_us, std::memory_order_relaxed);
+  Add(&buckets_[LatencyHistogram::BucketIndex(value_us)], 1);
+}
+
+void StatsRecorder::Histogram::Snapshot(LatencyHistogram* histogram) const {
+  histogram->count = count_.load(std::memory_order_relaxed);
+  histogram->total_us = total_us_.load(std::memory_order_relaxed);
+  histogram->max_us = max_us_.load(std::memory_order_relaxed);
+  Load(buckets_, histogram->buckets, LatencyHistogram::kBucketCount);
+}
+
+StatsRecorder::StatsRecorder() {
+  Clear(requests_received_, PeerStats::kMessageTypes);
+  Clear(requests_sent_, PeerStats::kMessageTypes);
+  Clear(replies_received_, PeerStats::kMessageTypes);
+  Clear(replies_sent_, PeerStats::kMessageTypes);
+  Clear(&parse_errors_, 1);
+  Clear(&timeouts_, 1);
+  Clear(&bytes_received_, 1);
+  Clear(&bytes_sent_, 1);
+}
+
+void StatsRecorder::CountMessage(TimelineEvent::Type type,
+                                 rtsp::Request::ID id) {
+  switch (type) {
+  case TimelineEvent::RequestReceived:
+    Add(&requests_received_[id], 1);
+    break;
+  case TimelineEvent::RequestSent:
+    Add(&requests_sent_[id], 1);
+    break;
+  case TimelineEvent::ReplyReceived:
+    Add(&replies_received_[id], 1);
+    break;
+  case TimelineEvent::ReplySent:
+    Add(&replies_sent_[id], 1);
+    break;
+  default:
+    break;
+  }
+}
+
+PeerStats StatsRecorder::Snapshot() const {
+  PeerStats stats;
+  Load(requests_received_, stats.requests_received, PeerStats::kMessageTypes);
+  Load(requests_sent_, stats.requests_sent, PeerStats::kMessageTypes);
+  Load(replies_received_, stats.replies_received, PeerStats::kMessageTypes);
+  Load(replies_sent_, stats.replies_sent, PeerStats::kMessageTypes);
+  stats.parse_errors = parse_errors_.load(std::memory_order_relaxed);
+  stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+  stats.bytes_received = bytes_received_.load(std::memory_order_relaxed);
+  stats.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+  parse_time_.Snapshot(&stats.parse_time);
+  handler_time_.Snapshot(&stats.handler_time);
+  round_trip_time_.Snapshot(&stats.round_trip_time);
+  idr_latency_.Snapshot(&stats.idr_latency);
+  return stats;
+}
+
+}  // namespace wds
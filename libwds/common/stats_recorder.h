@@ -0,0 +1,93 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef LIBWDS_COMMON_STATS_RECORDER_H_
+#define LIBWDS_COMMON_STATS_RECORDER_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "libwds/public/peer_stats.h"
+#include "libwds/public/timeline.h"
+#include "libwds/rtsp/message.h"
+
+namespace wds {
+
+// Keeps the counters of a peer. They are only updated by the thread
+// driving the peer, so no read-modify-write is needed; other threads can
+// take a Snapshot() at any time, which only does relaxed loads.
+class StatsRecorder {
+ public:
+  class Histogram {
+   public:
+    Histogram();
+    void Record(uint64_t value_us);
+    void Snapshot(LatencyHistogram* histogram) const;
+
+   private:
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> total_us_;
+    std::atomic<uint64_t> max_us_;
+    std::atomic<uint64_t> buckets_[LatencyHistogram::kBucketCount];
+  };
+
+  StatsRecorder();
+
+  // Counts the message of the given timeline step.
+  void CountMessage(TimelineEvent::Type type, rtsp::Request::ID id);
+  void CountParseError() { Add(&parse_errors_, 1); }
+  void CountTimeout() { Add(&timeouts_, 1); }
+  void CountBytesReceived(uint64_t bytes) { Add(&bytes_received_, bytes); }
+  void CountBytesSent(uint64_t bytes) { Add(&bytes_sent_, bytes); }
+
+  Histogram& parse_time() { return parse_time_; }
+  Histogram& handler_time() { return handler_time_; }
+  Histogram& round_trip_time() { return round_trip_time_; }
+  Histogram& idr_latency() { return idr_latency_; }
+
+  PeerStats Snapshot() const;
+
+  static void Add(std::atomic<uint64_t>* counter, uint64_t value) {
+    counter->store(counter->load(std::memory_order_relaxed) + value,
+                   std::memory_order_relaxed);
+  }
+
+ private:
+  typedef std::atomic<uint64_t> MessageCounters[PeerStats::kMessageTypes];
+
+  MessageCounters requests_received_;
+  MessageCounters requests_sent_;
+  MessageCounters replies_received_;
+  MessageCounters replies_sent_;
+  std::atomic<uint64_t> parse_errors_;
+  std::atomic<uint64_t> timeouts_;
+  std::atomic<uint64_t> bytes_received_;
+  std::atomic<uint64_t> bytes_sent_;
+  Histogram parse_time_;
+  Histogram handler_time_;
+  Histogram round_trip_time_;
+  Histogram idr_latency_;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_COMMON_STATS_RECORDER_H_
@@ -0,0 +1,218 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "libwds/common/timeline.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <list>
+
+namespace wds {
+
+uint64_t MonotonicMicroseconds() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+uint64_t TimelineTimestamp() {
+  return MonotonicMicroseconds();
+}
+
+void TimelineRecorder::Record(TimelineEvent::Type type, rtsp::Request::ID id,
+                              int cseq, const char* media_call) {
+  if (!observer_)
+    return;
+
+  TimelineEvent event;
+  event.type = type;
+  event.message = id;
+  event.cseq = cseq;
+  event.media_call = media_call;
+  event.timestamp_us = MonotonicMicroseconds();
+  observer_->TimelineEventOccurred(event);
+}
+
+namespace {
+
+// Trace "threads" of a session.
+const int kMessageTrack = 1;
+const int kMediaTrack = 2;
+const int kSetupTrack = 3;
+
+std::string EscapeJSON(const std::string& input) {
+  std::string output;
+  for (char c : input) {
+    if (c == '"' || c == '\\') {
+      output += '\\';
+      output += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      output += escaped;
+    } else {
+      output += c;
+    }
+  }
+  return output;
+}
+
+std::string EventName(const TimelineEvent& event) {
+  if (event.type == TimelineEvent::SessionStarted)
+    return "SessionStarted";
+  if (event.type == TimelineEvent::FirstMediaPacket)
+    return "FirstMediaPacket";
+  if (event.media_call)
+    return event.media_call;
+  return event.message ? "M" + std::to_string(event.message) : "RTSP";
+}
+
+bool IsStart(TimelineEvent::Type type) {
+  return type == TimelineEvent::RequestSent ||
+         type == TimelineEvent::RequestReceived ||
+         type == TimelineEvent::MediaCallEntered;
+}
+
+bool IsMarker(TimelineEvent::Type type) {
+  return type == TimelineEvent::SessionStarted ||
+         type == TimelineEvent::FirstMediaPacket;
+}
+
+bool Matches(const TimelineEvent& start, const TimelineEvent& end) {
+  switch (end.type) {
+  case TimelineEvent::ReplyReceived:
+    return start.type == TimelineEvent::RequestSent && start.cseq == end.cseq;
+  case TimelineEvent::ReplySent:
+    return start.type == TimelineEvent::RequestReceived &&
+           start.cseq == end.cseq;
+  case TimelineEvent::MediaCallReturned:
+    return start.type == TimelineEvent::MediaCallEntered &&
+           start.message == end.message &&
+           !strcmp(start.media_call, end.media_call);
+  default:
+    return false;
+  }
+}
+
+std::string EventArgs(const TimelineEvent& event) {
+  if (event.media_call)
+    return "{\"message\":" + std::to_string(event.message) + "}";
+  bool outgoing = event.type == TimelineEvent::RequestSent;
+  return "{\"cseq\":" + std::to_string(event.cseq) +
+         ",\"direction\":\"" + (outgoing ? "out" : "in") + "\"}";
+}
+
+}  // namespace
+
+ChromeTraceWriter::ChromeTraceWriter()
+  : session_count_(0) {
+}
+
+void ChromeTraceWriter::AddSession(const std::string& session_name,
+                                   const std::vector<TimelineEvent>& events) {
+  const std::string pid = std::to_string(++session_count_);
+  AddEvent("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid +
+           ",\"args\":{\"name\":\"" + EscapeJSON(session_name) + "\"}}");
+  AddEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid +
+           ",\"tid\":" + std::to_string(kMessageTrack) +
+           ",\"args\":{\"name\":\"RTSP\"}}");
+  AddEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid +
+           ",\"tid\":" + std::to_string(kMediaTrack) +
+           ",\"args\":{\"name\":\"MediaManager\"}}");
+  AddEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid +
+           ",\"tid\":" + std::to_string(kSetupTrack) +
+           ",\"args\":{\"name\":\"Setup\"}}");
+
+  auto add_event = [this, &pid](const TimelineEvent& start,
+                                const TimelineEvent* end) {
+    std::string tid =
+        std::to_string(start.media_call ? kMediaTrack : kMessageTrack);
+    std::string event = "{\"name\":\"" + EscapeJSON(EventName(start)) +
+        "\",\"cat\":\"" + (start.media_call ? "media" : "rtsp") +
+        "\",\"pid\":" + pid + ",\"tid\":" + tid +
+        ",\"ts\":" + std::to_string(start.timestamp_us);
+    if (end) {
+      event += ",\"ph\":\"X\",\"dur\":" +
+               std::to_string(end->timestamp_us - start.timestamp_us);
+    } else {
+      // Never finished, e.g. the session was torn down meanwhile.
+      event += ",\"ph\":\"i\",\"s\":\"t\"";
+    }
+    AddEvent(event + ",\"args\":" + EventArgs(start) + "}");
+  };
+
+  const TimelineEvent* session_started = nullptr;
+  const TimelineEvent* first_packet = nullptr;
+  std::list<TimelineEvent> open_events;
+  for (const TimelineEvent& event : events) {
+    if (IsMarker(event.type)) {
+      const TimelineEvent** marker =
+          event.type == TimelineEvent::SessionStarted ? &session_started
+                                                      : &first_packet;
+      if (!*marker)
+        *marker = &event;
+      AddEvent("{\"name\":\"" + EventName(event) +
+               "\",\"cat\":\"session\",\"pid\":" + pid +
+               ",\"tid\":" + std::to_string(kSetupTrack) +
+               ",\"ts\":" + std::to_string(event.timestamp_us) +
+               ",\"ph\":\"i\",\"s\":\"p\"}");
+      continue;
+    }
+    if (IsStart(event.type)) {
+      open_events.push_back(event);
+      continue;
+    }
+    for (auto it = open_events.begin(); it != open_events.end(); ++it) {
+      if (Matches(*it, event)) {
+        add_event(*it, &event);
+        open_events.erase(it);
+        break;
+      }
+    }
+  }
+  for (const TimelineEvent& event : open_events)
+    add_event(event, nullptr);
+
+  // From the connection to the first media packet.
+  if (session_started && first_packet &&
+      first_packet->timestamp_us >= session_started->timestamp_us) {
+    AddEvent("{\"name\":\"Setup\",\"cat\":\"session\",\"pid\":" + pid +
+             ",\"tid\":" + std::to_string(kSetupTrack) +
+             ",\"ts\":" + std::to_string(session_started->timestamp_us) +
+             ",\"ph\":\"X\",\"dur\":" +
+             std::to_string(first_packet->timestamp_us -
+                            session_started->timestamp_us) + "}");
+  }
+}
+
+std::string ChromeTraceWriter::ToString() const {
+  return "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" + trace_events_ +
+         "\n]}\n";
+}
+
+void ChromeTraceWriter::AddEvent(const std::string& event) {
+  if (!trace_events_.empty())
+    trace_events_ += ',';
+  trace_events_ += "\n" + event;
+}
+
+}  // namespace wds
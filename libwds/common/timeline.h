@@ -0,0 +1,51 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef LIBWDS_COMMON_TIMELINE_H_
+#define LIBWDS_COMMON_TIMELINE_H_
+
+#include "libwds/public/peer.h"
+#include "libwds/public/timeline.h"
+#include "libwds/rtsp/message.h"
+
+namespace wds {
+
+// Microseconds since an arbitrary point, from a monotonic clock, the
+// same as TimelineTimestamp().
+uint64_t MonotonicMicroseconds();
+
+// Timestamps the steps of a session and reports them to the peer
+// observer. Does nothing if the peer has no observer.
+class TimelineRecorder {
+ public:
+  explicit TimelineRecorder(Peer::Observer* observer) : observer_(observer) {}
+
+  void Record(TimelineEvent::Type type, rtsp::Request::ID id, int cseq,
+              const char* media_call = nullptr);
+
+ private:
+  Peer::Observer* observer_;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_COMMON_TIMELINE_H_
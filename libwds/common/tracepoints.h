@@ -0,0 +1,66 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+
+#ifndef LIBWDS_COMMON_TRACEPOINTS_H_
+#define LIBWDS_COMMON_TRACEPOINTS_H_
+
+// Static tracepoints (USDT) in the "wds" provider, e.g. for bpftrace:
+//   bpftrace -e 'usdt:libwds.so:wds:request__received { ... }'
+// With sys/sdt.h each probe is a single NOP until a tracer attaches to
+// it, without it the probes are compiled out. The first argument of every
+// probe is the wds::Peer the event belongs to.
+//
+//   parse__start(peer, bytes)              before rtsp::Driver::Parse()
+//   parse__done(peer, cseq, ok)            after rtsp::Driver::Parse()
+//   message__parsed(peer, cseq, id)        message passed to the peer
+//   request__sent(peer, cseq, id)
+//   request__received(peer, cseq, id)
+//   reply__sent(peer, cseq, id)
+//   reply__received(peer, cseq, id)        id of the request answered
+//   handler__start(peer, handler)
+//   handler__completed(peer, handler)
+//   handler__error(peer, handler)
+//   send__data(peer, bytes)                Delegate::SendRTSPData() call
+//   timer__create(peer, timer_id, seconds)
+//   timer__fire(peer, timer_id)
+//   media__call__entry(peer, id, name)     MediaManager call made while
+//   media__call__return(peer, id, name)    handling message |id|
+//
+// |id| is the rtsp::Request::ID, e.g. 7 for M7, 0 when not known.
+
+#ifdef WDS_HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define WDS_TRACE1(name, a1) DTRACE_PROBE1(wds, name, a1)
+#define WDS_TRACE2(name, a1, a2) DTRACE_PROBE2(wds, name, a1, a2)
+#define WDS_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(wds, name, a1, a2, a3)
+#define WDS_TRACE4(name, a1, a2, a3, a4) \
+  DTRACE_PROBE4(wds, name, a1, a2, a3, a4)
+#else
+#define WDS_TRACE1(name, a1) ((void)0)
+#define WDS_TRACE2(name, a1, a2) ((void)0)
+#define WDS_TRACE3(name, a1, a2, a3) ((void)0)
+#define WDS_TRACE4(name, a1, a2, a3, a4) ((void)0)
+#endif
+
+#endif  // LIBWDS_COMMON_TRACEPOINTS_H_
@@ -19,227 +19,473 @@
  * 02110-1301 USA
  */
 
+
 #include "libwds/public/media_manager.h"
 
 #include <assert.h>
 
 #include <algorithm>
+#include <utility>
 
 #include "libwds/public/logging.h"
 
 namespace wds {
 
 namespace {
-// Quality weight is calculated using following formula:
-// width * height * fps * 2 for progressive or 1 for interlaced frames
-struct QualityInfo {
-  unsigned width;
-  unsigned height;
-  unsigned weight;
+
+struct VideoModeData {
+  VideoModeInfo info;
+  // Index of the width and height among the resolutions of all the types,
+  // modes of the same resolution but another type have other indices.
+  unsigned resolution;
 };
 
-const QualityInfo cea_info_table[] = {
-  {640, 480, 640*480*60*2},     // CEA640x480p60
-  {720, 480, 720*480*60*2},     // CEA720x480p60
-  {720, 480, 720*480*60},       // CEA720x480i60
-  {720, 576, 720*576*50*2},     // CEA720x576p50
-  {720, 576, 720*576*50},       // CEA720x576i50
-  {1280, 720, 1280*720*30*2},   // CEA1280x720p30
-  {1280, 720, 1280*720*60*2},   // CEA1280x720p60
-  {1920, 1080, 1920*1080*30*2}, // CEA1920x1080p30
-  {1920, 1080, 1920*1080*60*2}, // CEA1920x1080p60
-  {1920, 1080, 1920*1080*60},   // CEA1920x1080i60
-  {1280, 720, 1280*720*25*2},   // CEA1280x720p25
-  {1280, 720, 1280*720*50*2},   // CEA1280x720p50
-  {1920, 1080, 1920*1080*25*2}, // CEA1920x1080p25
-  {1920, 1080, 1920*1080*50*2}, // CEA1920x1080p50
-  {1920, 1080, 1920*1080*50},   // CEA1920x1080i50
-  {1280, 720, 1280*720*24*2},   // CEA1280x720p24
-  {1920, 1080, 1920*1080*24*2}  // CEA1920x1080p24
+const size_t kResolutionCount = 26;
+
+struct VideoMode {
+  ResolutionType type;
+  RateAndResolution rate_resolution;
 };
 
-#define CEA_TABLE_LENGTH  sizeof(cea_info_table) / sizeof(QualityInfo)
-
-const QualityInfo vesa_info_table[] = {
-  {800, 600, 800*600*30*2},        // VESA800x600p30
-  {800, 600, 800*600*60*2},        // VESA800x600p60
-  {1024, 768, 1024*768*30*2},      // VESA1024x768p30
-  {1024, 768, 1024*768*60*2},      // VESA1024x768p60
-  {1152, 864, 1152*864*30*2},      // VESA1152x864p30
-  {1152, 864, 1152*864*60*2},      // VESA1152x864p60
-  {1280, 768, 1280*768*30*2},      // VESA1280x768p30
-  {1280, 768, 1280*768*60*2},      // VESA1280x768p60
-  {1280, 800, 1280*800*30*2},      // VESA1280x800p30
-  {1280, 800, 1280*800*60*2},      // VESA1280x800p60
-  {1360, 768, 1360*768*30*2},      // VESA1360x768p30
-  {1360, 768, 1360*768*60*2},      // VESA1360x768p60
-  {1366, 768, 1366*768*30*2},      // VESA1366x768p30
-  {1366, 768, 1366*768*60*2},      // VESA1366x768p60
-  {1280, 1024, 1280*1024*30*2},    // VESA1280x1024p30
-  {1280, 1024, 1280*1024*60*2},    // VESA1280x1024p60
-  {1400, 1050, 1400*1050*30*2},    // VESA1400x1050p30
-  {1400, 1050, 1400*1050*60*2},    // VESA1400x1050p60
-  {1440, 900, 1440*900*30*2},      // VESA1440x900p30
-  {1440, 900, 1440*900*60*2},      // VESA1440x900p60
-  {1600, 900, 1600*900*30*2},      // VESA1600x900p30
-  {1600, 900, 1600*900*60*2},      // VESA1600x900p60
-  {1600, 1200, 1600*1200*30*2},    // VESA1600x1200p30
-  {1600, 1200, 1600*1200*60*2},    // VESA1600x1200p60
-  {1680, 1024, 1680*1024*30*2},    // VESA1680x1024p30
-  {1680, 1024, 1680*1024*60*2},    // VESA1680x1024p60
-  {1680, 1050, 1680*1050*30*2},    // VESA1680x1050p30
-  {1680, 1050, 1680*1050*60*2},    // VESA1680x1050p60
-  {1920, 1200, 1920*1200*30*2}     // VESA1920x1200p30
+constexpr VideoModeData cea_modes[] = {
+  {{640, 480, 60, false}, 0},       // CEA640x480p60
+  {{720, 480, 60, false}, 1},       // CEA720x480p60
+  {{720, 480, 60, true}, 1},        // CEA720x480i60
+  {{720, 576, 50, false}, 2},       // CEA720x576p50
+  {{720, 576, 50, true}, 2},        // CEA720x576i50
+  {{1280, 720, 30, false}, 3},      // CEA1280x720p30
+  {{1280, 720, 60, false}, 3},      // CEA1280x720p60
+  {{1920, 1080, 30, false}, 4},     // CEA1920x1080p30
+  {{1920, 1080, 60, false}, 4},     // CEA1920x1080p60
+  {{1920, 1080, 60, true}, 4},      // CEA1920x1080i60
+  {{1280, 720, 25, false}, 3},      // CEA1280x720p25
+  {{1280, 720, 50, false}, 3},      // CEA1280x720p50
+  {{1920, 1080, 25, false}, 4},     // CEA1920x1080p25
+  {{1920, 1080, 50, false}, 4},     // CEA1920x1080p50
+  {{1920, 1080, 50, true}, 4},      // CEA1920x1080i50
+  {{1280, 720, 24, false}, 3},      // CEA1280x720p24
+  {{1920, 1080, 24, false}, 4}      // CEA1920x1080p24
 };
 
-#define VESA_TABLE_LENGTH  sizeof(vesa_info_table) / sizeof(QualityInfo)
-
-const QualityInfo hh_info_table[] = {
-  {800, 480, 800*480*30*2},         // HH800x480p30
-  {800, 480, 800*480*60*2},         // HH800x480p60
-  {854, 480, 854*480*30*2},         // HH854x480p30
-  {854, 480, 854*480*60*2},         // HH854x480p60
-  {864, 480, 864*480*30*2},         // HH864x480p30
-  {864, 480, 864*480*60*2},         // HH864x480p60
-  {640, 360, 640*360*30*2},         // HH640x360p30
-  {640, 360, 640*360*60*2},         // HH640x360p60
-  {960, 540, 960*540*30*2},         // HH960x540p30
-  {960, 540, 960*540*60*2},         // HH960x540p60
-  {848, 480, 848*480*30*2},         // HH848x480p30
-  {848, 480, 848*480*60*2}          // HH848x480p60
+constexpr VideoModeData vesa_modes[] = {
+  {{800, 600, 30, false}, 5},       // VESA800x600p30
+  {{800, 600, 60, false}, 5},       // VESA800x600p60
+  {{1024, 768, 30, false}, 6},      // VESA1024x768p30
+  {{1024, 768, 60, false}, 6},      // VESA1024x768p60
+  {{1152, 864, 30, false}, 7},      // VESA1152x864p30
+  {{1152, 864, 60, false}, 7},      // VESA1152x864p60
+  {{1280, 768, 30, false}, 8},      // VESA1280x768p30
+  {{1280, 768, 60, false}, 8},      // VESA1280x768p60
+  {{1280, 800, 30, false}, 9},      // VESA1280x800p30
+  {{1280, 800, 60, false}, 9},      // VESA1280x800p60
+  {{1360, 768, 30, false}, 10},     // VESA1360x768p30
+  {{1360, 768, 60, false}, 10},     // VESA1360x768p60
+  {{1366, 768, 30, false}, 11},     // VESA1366x768p30
+  {{1366, 768, 60, false}, 11},     // VESA1366x768p60
+  {{1280, 1024, 30, false}, 12},    // VESA1280x1024p30
+  {{1280, 1024, 60, false}, 12},    // VESA1280x1024p60
+  {{1400, 1050, 30, false}, 13},    // VESA1400x1050p30
+  {{1400, 1050, 60, false}, 13},    // VESA1400x1050p60
+  {{1440, 900, 30, false}, 14},     // VESA1440x900p30
+  {{1440, 900, 60, false}, 14},     // VESA1440x900p60
+  {{1600, 900, 30, false}, 15},     // VESA1600x900p30
+  {{1600, 900, 60, false}, 15},     // VESA1600x900p60
+  {{1600, 1200, 30, false}, 16},    // VESA1600x1200p30
+  {{1600, 1200, 60, false}, 16},    // VESA1600x1200p60
+  {{1680, 1024, 30, false}, 17},    // VESA1680x1024p30
+  {{1680, 1024, 60, false}, 17},    // VESA1680x1024p60
+  {{1680, 1050, 30, false}, 18},    // VESA1680x1050p30
+  {{1680, 1050, 60, false}, 18},    // VESA1680x1050p60
+  {{1920, 1200, 30, false}, 19}     // VESA1920x1200p30
 };
 
-#define HH_TABLE_LENGTH  sizeof(hh_info_table) / sizeof(QualityInfo)
+constexpr VideoModeData hh_modes[] = {
+  {{800, 480, 30, false}, 20},      // HH800x480p30
+  {{800, 480, 60, false}, 20},      // HH800x480p60
+  {{854, 480, 30, false}, 21},      // HH854x480p30
+  {{854, 480, 60, false}, 21},      // HH854x480p60
+  {{864, 480, 30, false}, 22},      // HH864x480p30
+  {{864, 480, 60, false}, 22},      // HH864x480p60
+  {{640, 360, 30, false}, 23},      // HH640x360p30
+  {{640, 360, 60, false}, 23},      // HH640x360p60
+  {{960, 540, 30, false}, 24},      // HH960x540p30
+  {{960, 540, 60, false}, 24},      // HH960x540p60
+  {{848, 480, 30, false}, 25},      // HH848x480p30
+  {{848, 480, 60, false}, 25}       // HH848x480p60
+};
 
-QualityInfo get_cea_info(const H264VideoFormat& format) {
-  assert(format.rate_resolution < CEA_TABLE_LENGTH);
-  return cea_info_table[format.rate_resolution];
+// Modes in the order of quality weight, then type and rate and resolution.
+constexpr VideoMode modes_by_weight[] = {
+  {HH, HH640x360p30},
+  {CEA, CEA720x480i60},
+  {CEA, CEA720x576i50},
+  {HH, HH800x480p30},
+  {HH, HH848x480p30},
+  {HH, HH854x480p30},
+  {HH, HH864x480p30},
+  {HH, HH640x360p60},
+  {VESA, VESA800x600p30},
+  {HH, HH960x540p30},
+  {CEA, CEA640x480p60},
+  {CEA, CEA720x480p60},
+  {CEA, CEA720x576p50},
+  {CEA, CEA1280x720p24},
+  {CEA, CEA1280x720p25},
+  {HH, HH800x480p60},
+  {VESA, VESA1024x768p30},
+  {HH, HH848x480p60},
+  {HH, HH854x480p60},
+  {HH, HH864x480p60},
+  {CEA, CEA1280x720p30},
+  {VESA, VESA800x600p60},
+  {VESA, VESA1280x768p30},
+  {VESA, VESA1152x864p30},
+  {VESA, VESA1280x800p30},
+  {HH, HH960x540p60},
+  {VESA, VESA1360x768p30},
+  {VESA, VESA1366x768p30},
+  {VESA, VESA1440x900p30},
+  {VESA, VESA1280x1024p30},
+  {VESA, VESA1600x900p30},
+  {VESA, VESA1400x1050p30},
+  {CEA, CEA1280x720p50},
+  {VESA, VESA1024x768p60},
+  {CEA, CEA1920x1080p24},
+  {VESA, VESA1680x1024p30},
+  {CEA, CEA1920x1080p25},
+  {CEA, CEA1920x1080i50},
+  {VESA, VESA1680x1050p30},
+  {CEA, CEA1280x720p60},
+  {VESA, VESA1600x1200p30},
+  {VESA, VESA1280x768p60},
+  {VESA, VESA1152x864p60},
+  {VESA, VESA1280x800p60},
+  {CEA, CEA1920x1080p30},
+  {CEA, CEA1920x1080i60},
+  {VESA, VESA1360x768p60},
+  {VESA, VESA1366x768p60},
+  {VESA, VESA1920x1200p30},
+  {VESA, VESA1440x900p60},
+  {VESA, VESA1280x1024p60},
+  {VESA, VESA1600x900p60},
+  {VESA, VESA1400x1050p60},
+  {VESA, VESA1680x1024p60},
+  {CEA, CEA1920x1080p50},
+  {VESA, VESA1680x1050p60},
+  {VESA, VESA1600x1200p60},
+  {CEA, CEA1920x1080p60}
+};
+
+const size_t kModeCount = sizeof(modes_by_weight) / sizeof(VideoMode);
+
+constexpr bool is_known_mode(ResolutionType type, RateAndResolution rr) {
+  return (type == CEA && rr <= CEA1920x1080p24) ||
+         (type == VESA && rr <= VESA1920x1200p30) ||
+         (type == HH && rr <= HH848x480p60);
 }
 
-QualityInfo get_vesa_info(const H264VideoFormat& format) {
-  assert(format.rate_resolution < VESA_TABLE_LENGTH);
-  return vesa_info_table[format.rate_resolution];
+constexpr const VideoModeData& mode_data(const VideoMode& mode) {
+  return mode.type == CEA ? cea_modes[mode.rate_resolution] :
+         mode.type == VESA ? vesa_modes[mode.rate_resolution] :
+         hh_modes[mode.rate_resolution];
 }
 
-QualityInfo get_hh_info(const H264VideoFormat& format) {
-  assert(format.rate_resolution < HH_TABLE_LENGTH);
-  return hh_info_table[format.rate_resolution];
+// Quality weight is calculated using following formula:
+// width * height * fps * 2 for progressive or 1 for interlaced frames
+constexpr unsigned weight(const VideoMode& mode) {
+  return mode_data(mode).info.width * mode_data(mode).info.height *
+         mode_data(mode).info.frame_rate *
+         (mode_data(mode).info.interlaced ? 1 : 2);
 }
 
-QualityInfo get_quality_info(const H264VideoFormat& format) {
-  QualityInfo info;
-  switch (format.type) {
-  case CEA:
-    info = get_cea_info(format);
-    break;
+constexpr bool is_ordered(const VideoMode& a, const VideoMode& b) {
+  return weight(a) < weight(b) ||
+         (weight(a) == weight(b) &&
+          (a.type < b.type ||
+           (a.type == b.type && a.rate_resolution < b.rate_resolution)));
+}
+
+constexpr bool is_ordered_by_weight(size_t i) {
+  return i + 1 >= kModeCount ||
+         (is_ordered(modes_by_weight[i], modes_by_weight[i + 1]) &&
+          is_ordered_by_weight(i + 1));
+}
+
+static_assert(kModeCount == CEA1920x1080p24 + VESA1920x1200p30 +
+                            HH848x480p60 + 3,
+              "Every mode must be in modes_by_weight");
+static_assert(is_ordered_by_weight(0), "modes_by_weight must be sorted");
+
+template <typename Codec>
+const RateAndResolutionsBitmap& get_bitmap(const Codec& codec,
+                                           ResolutionType type) {
+  switch (type) {
   case VESA:
-    info = get_vesa_info(format);
-    break;
+    return codec.vesa_rr;
   case HH:
-    info = get_hh_info(format);
-    break;
+    return codec.hh_rr;
   default:
-    assert(false);
-    break;
+    return codec.cea_rr;
   }
-  return info;
 }
 
-std::pair<unsigned, unsigned> get_resolution(const H264VideoFormat& format) {
-  QualityInfo info = get_quality_info(format);
-  return std::pair<unsigned, unsigned>(info.width, info.height);
-}
-
-bool video_format_sort_func(const H264VideoFormat& a, const H264VideoFormat& b) {
-  if (get_quality_info(a).weight != get_quality_info(b).weight)
-    return get_quality_info(a).weight < get_quality_info(b).weight;
-  if (a.profile != b.profile)
-    return a.profile < b.profile;
-  return a.level < b.level;
+// Finds the first of the formats of |codecs| accepted by |filter| when
+// they are ordered by quality weight, profile, level, type and rate and
+// resolution.
+template <typename Codec, typename Format, typename Filter>
+bool find_first_format(const std::vector<Codec>& codecs,
+                       Filter filter, Format* format) {
+  bool found = false;
+  for (const VideoMode& mode : modes_by_weight) {
+    // The modes of the same weight are ordered by profile and level first.
+    if (found && weight(mode) != weight({format->type,
+                                         format->rate_resolution}))
+      break;
+    if (!filter(mode))
+      continue;
+    for (const Codec& codec : codecs) {
+      if (!get_bitmap(codec, mode.type).test(mode.rate_resolution))
+        continue;
+      if (found && std::make_pair(codec.profile, codec.level) >=
+                   std::make_pair(format->profile, format->level))
+        continue;
+      format->profile = codec.profile;
+      format->level = codec.level;
+      format->type = mode.type;
+      format->rate_resolution = mode.rate_resolution;
+      format->params = codec.params;
+      found = true;
+    }
+  }
+  return found;
 }
 
-template <typename RREnum>
-void PopulateVideoFormatList(
-    H264Profile profile,
-    H264Level level,
-    const RateAndResolutionsBitmap& bitmap,
-    RREnum max_value,
-    std::vector<H264VideoFormat>& formats) {
-  if (bitmap.none())
-    return;
-
-  for (RateAndResolution rr = 0; rr <= static_cast<RateAndResolution>(max_value); ++rr) {
-    if (bitmap.test(rr))
-      formats.push_back(H264VideoFormat(profile, level, static_cast<RREnum>(rr)));
+// Finds the highest profile and level of the |codecs| supporting |mode|.
+template <typename Codec, typename Format>
+bool find_best_codec(const std::vector<Codec>& codecs,
+                     const VideoMode& mode, Format* format) {
+  bool found = false;
+  for (const Codec& codec : codecs) {
+    if (!get_bitmap(codec, mode.type).test(mode.rate_resolution))
+      continue;
+    if (found && std::make_pair(codec.profile, codec.level) <=
+                 std::make_pair(format->profile, format->level))
+      continue;
+    format->profile = codec.profile;
+    format->level = codec.level;
+    format->params = codec.params;
+    found = true;
   }
+  format->type = mode.type;
+  format->rate_resolution = mode.rate_resolution;
+  return found;
 }
 
-}  // namespace
+// Finds the format both sides support in |mode| with the highest profile
+// and level they have in common, and the parameters of the remote codec.
+template <typename Codec, typename Format>
+bool find_common_format(const std::vector<Codec>& local_codecs,
+                        const std::vector<Codec>& remote_codecs,
+                        const VideoMode& mode, Format* format) {
+  Format remote_format;
+  if (!find_best_codec(local_codecs, mode, format) ||
+      !find_best_codec(remote_codecs, mode, &remote_format))
+    return false;
+  format->profile = std::min(format->profile, remote_format.profile);
+  format->level = std::min(format->level, remote_format.level);
+  format->params = remote_format.params;
+  return true;
+}
 
-void PopulateVideoFormatList(
-    const H264VideoCodec& codec, std::vector<H264VideoFormat>& formats) {
-  PopulateVideoFormatList<CEARatesAndResolutions>(
-      codec.profile, codec.level, codec.cea_rr, CEA1920x1080p24, formats);
-  PopulateVideoFormatList<VESARatesAndResolutions>(
-      codec.profile, codec.level, codec.vesa_rr, VESA1920x1200p30, formats);
-  PopulateVideoFormatList<HHRatesAndResolutions>(
-      codec.profile, codec.level, codec.hh_rr, HH848x480p60, formats);
+bool is_sustainable(const VideoMode& mode,
+                    const VideoFormatCostModel& cost_model) {
+  const VideoModeInfo& info = mode_data(mode).info;
+  // Two fields make up a frame of an interlaced mode.
+  unsigned frame_rate = info.interlaced ? info.frame_rate / 2
+                                        : info.frame_rate;
+  if (cost_model.link_mbps > 0 &&
+      double(info.width) * info.height * frame_rate *
+          cost_model.bits_per_pixel > cost_model.link_mbps * 1e6)
+    return false;
+  return !cost_model.encoder_fps ||
+         cost_model.encoder_fps(info.width, info.height) >= frame_rate;
 }
 
-H264VideoFormat FindOptimalVideoFormat(
-    const NativeVideoFormat& native,
-    const std::vector<H264VideoCodec>& local_codecs,
-    const std::vector<H264VideoCodec>& remote_codecs,
-    bool* success) {
-  std::vector<H264VideoFormat> local_formats, remote_formats;
-  for (const auto& codec : local_codecs)
-    PopulateVideoFormatList(codec, local_formats);
-  for (const auto& codec : remote_codecs)
-    PopulateVideoFormatList(codec, remote_formats);
-
-  std::sort(local_formats.begin(), local_formats.end(),
-      video_format_sort_func);
-  std::sort(remote_formats.begin(), remote_formats.end(),
-      video_format_sort_func);
-
-  auto it = local_formats.begin();
-  auto end = local_formats.end();
-
-  H264VideoFormat format;
-
-  while(it != end) {
-    auto match = std::find_if(
-        remote_formats.begin(),
-        remote_formats.end(),
-        [&it] (const H264VideoFormat& format) {
-            return ((*it).type == format.type) &&
-                   (get_resolution(*it) == get_resolution(format));
-        });
-
-    if (match != remote_formats.end()) {
-      format = *match;
-      break;
+template <typename Codec, typename Format>
+Format find_optimal_format(const NativeVideoFormat& native,
+                           const std::vector<Codec>& local_codecs,
+                           const std::vector<Codec>& remote_codecs,
+                           bool* success) {
+  // Local and remote modes match when their resolutions do,
+  // the frame rates may differ.
+  std::bitset<kResolutionCount> remote_resolutions;
+  for (const VideoMode& mode : modes_by_weight) {
+    for (const Codec& codec : remote_codecs) {
+      if (get_bitmap(codec, mode.type).test(mode.rate_resolution)) {
+        remote_resolutions.set(mode_data(mode).resolution);
+        break;
+      }
     }
-    ++it;
   }
 
-  // Should not happen, 640x480p60 should be always supported!
-  if (it == end) {
+  Format local_format;
+  if (!find_first_format(local_codecs,
+      [&remote_resolutions](const VideoMode& mode) {
+        return remote_resolutions.test(mode_data(mode).resolution);
+      }, &local_format)) {
+    // Should not happen, 640x480p60 should be always supported!
     WDS_ERROR("Failed to find compatible video format.");
     if (success)
       *success = false;
-    return format;
+    return Format();
   }
 
+  unsigned resolution =
+      mode_data({local_format.type, local_format.rate_resolution}).resolution;
+  Format format;
+  find_first_format(remote_codecs,
+      [resolution](const VideoMode& mode) {
+        return mode_data(mode).resolution == resolution;
+      }, &format);
+
   // if remote device supports higher codec profile / level
   // downgrade them to what we support locally.
-  if (format.profile > (*it).profile)
-    format.profile = (*it).profile;
-  if (format.level > (*it).level)
-    format.level = (*it).level;
+  if (format.profile > local_format.profile)
+    format.profile = local_format.profile;
+  if (format.level > local_format.level)
+    format.level = local_format.level;
   if (success)
     *success = true;
   return format;
 }
 
+template <typename Codec, typename Format>
+Format select_format(const NativeVideoFormat& native,
+                     const std::vector<Codec>& local_codecs,
+                     const std::vector<Codec>& remote_codecs,
+                     const VideoFormatCostModel& cost_model,
+                     bool* success) {
+  Format format;
+  VideoMode native_mode = {native.type, native.rate_resolution};
+  if (cost_model.prefer_native &&
+      is_known_mode(native.type, native.rate_resolution) &&
+      is_sustainable(native_mode, cost_model) &&
+      find_common_format(local_codecs, remote_codecs, native_mode, &format)) {
+    if (success)
+      *success = true;
+    return format;
+  }
+
+  for (size_t i = kModeCount; i > 0; --i) {
+    const VideoMode& mode = modes_by_weight[i - 1];
+    if (is_sustainable(mode, cost_model) &&
+        find_common_format(local_codecs, remote_codecs, mode, &format)) {
+      if (success)
+        *success = true;
+      return format;
+    }
+  }
+
+  WDS_WARNING("No video format can be sustained, using the lowest one.");
+  return find_optimal_format<Codec, Format>(native, local_codecs,
+                                            remote_codecs, success);
+}
+
+VideoFormatCostModel h265_cost_model(const VideoFormatCostModel& cost_model) {
+  VideoFormatCostModel h265_cost_model = cost_model;
+  h265_cost_model.bits_per_pixel *= cost_model.h265_bitrate_ratio;
+  return h265_cost_model;
+}
+
+}  // namespace
+
+VideoModeInfo GetVideoModeInfo(ResolutionType type,
+                               RateAndResolution rate_resolution) {
+  if (!is_known_mode(type, rate_resolution))
+    return VideoModeInfo();
+  return mode_data({type, rate_resolution}).info;
+}
+
+void PopulateVideoFormatList(
+    const H264VideoCodec& codec, std::vector<H264VideoFormat>& formats) {
+  H264VideoFormatRange range(codec);
+  formats.insert(formats.end(), range.begin(), range.end());
+}
+
+H264VideoFormat FindOptimalVideoFormat(
+    const NativeVideoFormat& native,
+    const std::vector<H264VideoCodec>& local_codecs,
+    const std::vector<H264VideoCodec>& remote_codecs,
+    bool* success) {
+  return find_optimal_format<H264VideoCodec, H264VideoFormat>(
+      native, local_codecs, remote_codecs, success);
+}
+
+H265VideoFormat FindOptimalVideoFormat(
+    const NativeVideoFormat& native,
+    const std::vector<H265VideoCodec>& local_codecs,
+    const std::vector<H265VideoCodec>& remote_codecs,
+    bool* success) {
+  return find_optimal_format<H265VideoCodec, H265VideoFormat>(
+      native, local_codecs, remote_codecs, success);
+}
+
+bool IsVideoFormatSustainable(const H264VideoFormat& format,
+                              const VideoFormatCostModel& cost_model) {
+  return is_known_mode(format.type, format.rate_resolution) &&
+         is_sustainable({format.type, format.rate_resolution}, cost_model);
+}
+
+bool IsVideoFormatSustainable(const H265VideoFormat& format,
+                              const VideoFormatCostModel& cost_model) {
+  return is_known_mode(format.type, format.rate_resolution) &&
+         is_sustainable({format.type, format.rate_resolution},
+                        h265_cost_model(cost_model));
+}
+
+H264VideoFormat SelectVideoFormat(
+    const NativeVideoFormat& native,
+    const std::vector<H264VideoCodec>& local_codecs,
+    const std::vector<H264VideoCodec>& remote_codecs,
+    const VideoFormatCostModel& cost_model,
+    bool* success) {
+  return select_format<H264VideoCodec, H264VideoFormat>(
+      native, local_codecs, remote_codecs, cost_model, success);
+}
+
+H265VideoFormat SelectVideoFormat(
+    const NativeVideoFormat& native,
+    const std::vector<H265VideoCodec>& local_codecs,
+    const std::vector<H265VideoCodec>& remote_codecs,
+    const VideoFormatCostModel& cost_model,
+    bool* success) {
+  return select_format<H265VideoCodec, H265VideoFormat>(
+      native, local_codecs, remote_codecs, h265_cost_model(cost_model),
+      success);
+}
+
+VideoCodecType SelectVideoCodec(
+    const NativeVideoFormat& native,
+    const std::vector<H264VideoCodec>& local_h264_codecs,
+    const std::vector<H264VideoCodec>& remote_h264_codecs,
+    const std::vector<H265VideoCodec>& local_h265_codecs,
+    const std::vector<H265VideoCodec>& remote_h265_codecs,
+    const VideoFormatCostModel& cost_model,
+    H264VideoFormat* h264_format,
+    H265VideoFormat* h265_format) {
+  *h264_format = SelectVideoFormat(native, local_h264_codecs,
+                                   remote_h264_codecs, cost_model);
+  if (local_h265_codecs.empty() || remote_h265_codecs.empty())
+    return H264;
+
+  bool success = false;
+  *h265_format = SelectVideoFormat(native, local_h265_codecs,
+                                   remote_h265_codecs, cost_model, &success);
+  if (!success ||
+      weight({h265_format->type, h265_format->rate_resolution}) <
+      weight({h264_format->type, h264_format->rate_resolution}))
+    return H264;
+  return H265;
+}
+
 }  // namespace wds
@@ -23,6 +23,9 @@
 #define LIBWDS_PUBLIC_AUDIO_CODEC_H_
 
 #include <bitset>
+#include <vector>
+
+#include "wds_export.h"
 
 namespace wds {
 
@@ -68,6 +71,80 @@ struct AudioCodec {
   unsigned latency;
 };
 
+/**
+ * Properties of an audio mode.
+ */
+struct AudioModeInfo {
+  AudioModeInfo()
+  : sample_rate(0), channels(0), bitrate_kbps(0), encode_cost(0),
+    codec_latency_ms(0) {}
+  AudioModeInfo(unsigned sample_rate, unsigned channels,
+                unsigned bitrate_kbps, unsigned encode_cost,
+                unsigned codec_latency_ms)
+  : sample_rate(sample_rate), channels(channels), bitrate_kbps(bitrate_kbps),
+    encode_cost(encode_cost), codec_latency_ms(codec_latency_ms) {}
+
+  unsigned sample_rate;
+  unsigned channels;
+  /// Typical bitrate of the encoded stream.
+  unsigned bitrate_kbps;
+  /// Relative CPU cost of encoding, 0 for LPCM.
+  unsigned encode_cost;
+  /// Latency the encoder and decoder add, not counting the latency
+  /// the device reports in @c AudioCodec::latency.
+  unsigned codec_latency_ms;
+};
+
+/**
+ * Gets the properties of an audio mode.
+ *
+ * @param format audio format
+ * @param mode LPCM, AAC or AC3 mode, depending on @a format
+ * @return the mode info, all zeros for an unknown mode
+ */
+WDS_EXPORT AudioModeInfo GetAudioModeInfo(AudioFormats format, unsigned mode);
+
+/**
+ * What it costs to stream an audio mode, @see FindOptimalAudioFormat.
+ *
+ * The cost of a mode is its latency in ms (@c AudioModeInfo::codec_latency_ms
+ * and @c AudioCodec::latency of the remote device), plus its encode cost
+ * and bitrate turned into ms by the weights below.
+ */
+struct AudioCostModel {
+  AudioCostModel()
+  : link_kbps(0), max_channels(2), encode_cost_weight(5),
+    bitrate_weight(0.001) {}
+
+  /// Throughput of the link to the remote device available for audio,
+  /// modes of higher bitrate are not used. 0 if unknown.
+  unsigned link_kbps;
+  /// Most channels worth streaming, modes with more channels are preferred
+  /// up to it. 0 for no limit.
+  unsigned max_channels;
+  /// Cost of a unit of @c AudioModeInfo::encode_cost.
+  double encode_cost_weight;
+  /// Cost of a kbps of bitrate.
+  double bitrate_weight;
+};
+
+/**
+ * Finds the cheapest audio mode that both devices support with the
+ * given cost model, among those with the most channels. Uncompressed
+ * LPCM is picked whenever the link allows it.
+ *
+ * @param local_codecs list of audio codecs supported by local device
+ * @param remote_codecs list of audio codecs supported by remote device
+ * @param cost_model link limit and cost weights
+ * @param success set to false if there is no common mode
+ * @return optimal audio codec with a single mode
+ */
+WDS_EXPORT AudioCodec FindOptimalAudioFormat(
+    const std::vector<AudioCodec>& local_codecs,
+    const std::vector<AudioCodec>& remote_codecs,
+    const AudioCostModel& cost_model = AudioCostModel(),
+    bool* success = nullptr);
+
 }  // namespace wds
 
 #endif  // LIBWDS_PUBLIC_AUDIO_CODEC_H_
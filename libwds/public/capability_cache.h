@@ -0,0 +1,110 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+
+#ifndef LIBWDS_PUBLIC_CAPABILITY_CACHE_H_
+#define LIBWDS_PUBLIC_CAPABILITY_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "audio_codec.h"
+#include "video_format.h"
+#include "wds_export.h"
+
+namespace wds {
+
+/**
+ * Formats a source negotiated with a sink during the capability exchange
+ * (M3), @see CapabilityCache
+ */
+struct NegotiatedFormats {
+  NegotiatedFormats() : has_video(false), has_h265(false), has_audio(false),
+                        capabilities_digest(0) {}
+
+  bool has_video;
+  H264VideoFormat video_format;
+  /// Set if the video is streamed in @c h265_format instead of @c video_format.
+  bool has_h265;
+  H265VideoFormat h265_format;
+  bool has_audio;
+  AudioCodec audio_codec;
+  /// Digest of the sink capabilities the formats were chosen from.
+  uint64_t capabilities_digest;
+};
+
+/**
+ * Remembers the formats negotiated with the sinks that connected recently,
+ * so that a reconnecting sink does not need a new format selection and
+ * the media pipeline can be prepared while the capabilities are exchanged.
+ *
+ * The sinks are identified by a key chosen by the client, e.g. the P2P
+ * device address or a hash of the EDID. The cache can be shared by the
+ * sources of all the sessions, it is safe to use from several threads.
+ * @see Source::SetCapabilityCache
+ */
+class WDS_EXPORT CapabilityCache {
+ public:
+  /**
+   * @param capacity number of sinks remembered, the least recently used
+   * are forgotten first
+   */
+  explicit CapabilityCache(size_t capacity = 64);
+
+  /**
+   * Looks up the formats negotiated with the given sink.
+   * @param peer_id sink key
+   * @param formats set to the cached formats if found
+   * @return true if the sink is in the cache
+   */
+  bool Lookup(const std::string& peer_id, NegotiatedFormats* formats);
+
+  /**
+   * Stores the formats negotiated with the given sink.
+   * @param peer_id sink key
+   * @param formats negotiated formats
+   */
+  void Store(const std::string& peer_id, const NegotiatedFormats& formats);
+
+  /**
+   * Forgets the given sink, e.g. when its formats turned out to be unusable.
+   * @param peer_id sink key
+   */
+  void Remove(const std::string& peer_id);
+
+ private:
+  typedef std::list<std::pair<std::string, NegotiatedFormats>> EntryList;
+
+  size_t capacity_;
+  std::mutex mutex_;
+  // Most recently used first.
+  EntryList entries_;
+  std::map<std::string, EntryList::iterator> index_;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_PUBLIC_CAPABILITY_CACHE_H_
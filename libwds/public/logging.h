@@ -23,13 +23,76 @@
 #define LIBWDS_PUBLIC_LOGGING_H_
 
 #include <cstdarg>
+#include <cstddef>
 
 #include "wds_export.h"
 
 namespace wds {
 
+enum LogLevel {
+  LogLevelError,
+  LogLevelWarning,
+  LogLevelInfo,
+  LogLevelVerbose
+};
+
+/**
+ * Log function that can be assigned to a single peer.
+ * @see Peer::SetLogHandler
+ *
+ * @param user_data pointer given together with the function
+ * @param level message level
+ * @param format printf() like format string
+ * @param args format arguments
+ */
+typedef void (*SessionLogFunction)(void* user_data, LogLevel level,
+                                   const char* format, va_list args);
+
+/**
+ * Function receiving the messages kept in the log ring buffer.
+ * @see LogSystem::dump_ring_buffer
+ *
+ * @param user_data pointer given together with the function
+ * @param level message level
+ * @param message formatted message
+ */
+typedef void (*RingBufferDumpFunction)(void* user_data, LogLevel level,
+                                       const char* message);
+
+/**
+ * Log message argument as kept in the log ring buffer.
+ */
+struct LogArg {
+  enum Type { None, Signed, Unsigned, Double, String, Pointer };
+
+  LogArg() : type(None) { value.s = 0; }
+  LogArg(int v) : type(Signed) { value.s = v; }
+  LogArg(long v) : type(Signed) { value.s = v; }
+  LogArg(long long v) : type(Signed) { value.s = v; }
+  LogArg(unsigned v) : type(Unsigned) { value.u = v; }
+  LogArg(unsigned long v) : type(Unsigned) { value.u = v; }
+  LogArg(unsigned long long v) : type(Unsigned) { value.u = v; }
+  LogArg(double v) : type(Double) { value.d = v; }
+  LogArg(const char* v) : type(String) { value.str = v; }
+  LogArg(const void* v) : type(Pointer) { value.ptr = v; }
+
+  Type type;
+  union {
+    long long s;
+    unsigned long long u;
+    double d;
+    const char* str;
+    const void* ptr;
+  } value;
+};
+
 /**
  * WFD logging subsystem.
+ *
+ * The functions set here are shared by all the peers in the process,
+ * they can be changed at any time and must be callable from any thread
+ * that drives a peer. Messages logged by a peer that has its own
+ * handler (@see Peer::SetLogHandler) are passed to that handler instead.
  */
 class WDS_EXPORT LogSystem {
  public:
@@ -79,21 +142,109 @@ class WDS_EXPORT LogSystem {
    */
   static LogFunction error_func();
 
- private:
-  static LogFunction log_func_;
-  static LogFunction vlog_func_;
-  static LogFunction warning_func_;
-  static LogFunction error_func_;
+  /**
+   * Sets the most verbose level of the messages passed to the log
+   * functions and the peer log handlers, all levels by default.
+   * Messages above it are dropped before their arguments are evaluated.
+   * @param level most verbose level logged
+   */
+  static void set_log_level(LogLevel level);
+  /**
+   * Gets the most verbose level logged @see set_log_level
+   * @return most verbose level logged
+   */
+  static LogLevel log_level();
+
+  /**
+   * Keeps the messages up to the given level in an in-memory ring buffer,
+   * in addition to passing them to the log functions. The format string
+   * and the raw arguments are stored, the message is only formatted when
+   * the buffer is dumped, so verbose messages can be kept at little cost.
+   * The format strings must therefore outlive the buffer, string literals
+   * do. Every logging thread has a buffer of its own, so that threads do
+   * not contend on it.
+   * @param size buffer size in bytes per thread, 0 disables the buffer
+   * @param level most verbose level kept
+   */
+  static void set_ring_buffer(size_t size, LogLevel level = LogLevelVerbose);
+  /**
+   * Formats the messages kept in the ring buffers of all the threads,
+   * oldest first, and passes them to the given function. The buffer is left unchanged.
+   * @param func function receiving the messages
+   * @param user_data passed back to @a func
+   */
+  static void dump_ring_buffer(RingBufferDumpFunction func, void* user_data);
+
+  /**
+   * Checks whether a message of the given level is logged anywhere.
+   * Used by the logging macros, which skip the message otherwise.
+   */
+  static bool is_enabled(LogLevel level);
+  /**
+   * Checks whether a message of the given level is passed to a log
+   * function or a peer log handler.
+   */
+  static bool output_enabled(LogLevel level);
+  /**
+   * Checks whether a message of the given level is kept in the ring buffer.
+   */
+  static bool ring_buffer_enabled(LogLevel level);
+  /**
+   * Stores a message in the ring buffer @see set_ring_buffer
+   */
+  static void ring_buffer_log(LogLevel level, const char* format,
+                              const LogArg* args, int arg_count);
+
+  /**
+   * Checks whether the calling thread is currently running a peer
+   * that has its own log handler.
+   */
+  static bool has_session_handler();
+  /**
+   * Passes a message to the log handler of the peer run by the calling
+   * thread @see has_session_handler
+   */
+  static void session_log(LogLevel level, const char* format, ...);
 
  private:
   LogSystem() = delete;
 };
 
+namespace internal {
+
+template <typename... Args>
+void Log(LogLevel level, LogSystem::LogFunction (*func)(),
+         const char* format, Args... args) {
+  if (LogSystem::ring_buffer_enabled(level)) {
+    const LogArg log_args[] = {LogArg(), LogArg(args)...};
+    LogSystem::ring_buffer_log(level, format, log_args + 1, sizeof...(args));
+  }
+  if (!LogSystem::output_enabled(level))
+    return;
+  if (LogSystem::has_session_handler())
+    LogSystem::session_log(level, format, args...);
+  else
+    (*func())(format, args...);
 }
 
-#define WDS_LOG(...) (*wds::LogSystem::log_func())(__VA_ARGS__);
-#define WDS_VLOG(...) (*wds::LogSystem::vlog_func())(__VA_ARGS__);
-#define WDS_WARNING(...) (*wds::LogSystem::warning_func())(__VA_ARGS__);
-#define WDS_ERROR(...) (*wds::LogSystem::error_func())(__VA_ARGS__);
+}  // namespace internal
+
+}
+
+// Messages above this level are compiled out, e.g. build with
+// -DWDS_MAX_LOG_LEVEL=wds::LogLevelInfo to drop the verbose ones.
+#ifndef WDS_MAX_LOG_LEVEL
+#define WDS_MAX_LOG_LEVEL wds::LogLevelVerbose
+#endif
+
+#define WDS_LOG_AT(level, func, ...)                                     \
+  ((level) <= WDS_MAX_LOG_LEVEL && wds::LogSystem::is_enabled(level) ?   \
+      wds::internal::Log(level, &wds::LogSystem::func, __VA_ARGS__) :    \
+      (void)0)
+
+#define WDS_LOG(...) WDS_LOG_AT(wds::LogLevelInfo, log_func, __VA_ARGS__);
+#define WDS_VLOG(...) WDS_LOG_AT(wds::LogLevelVerbose, vlog_func, __VA_ARGS__);
+#define WDS_WARNING(...) WDS_LOG_AT(wds::LogLevelWarning, warning_func, __VA_ARGS__);
+#define WDS_ERROR(...) WDS_LOG_AT(wds::LogLevelError, error_func, __VA_ARGS__);
 
 #endif // LIBWDS_PUBLIC_LOGGING_H_
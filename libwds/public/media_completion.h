@@ -0,0 +1,112 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef LIBWDS_PUBLIC_MEDIA_COMPLETION_H_
+#define LIBWDS_PUBLIC_MEDIA_COMPLETION_H_
+
+#include <functional>
+#include <memory>
+
+namespace wds {
+
+class MediaCompletion;
+typedef std::shared_ptr<MediaCompletion> MediaCompletionPtr;
+
+/**
+ * Completion token of an asynchronous media manager operation.
+ *
+ * The token is returned by the asynchronous @c MediaManager methods, and
+ * the media manager calls Complete() once the operation has finished. The
+ * state machine does not send the corresponding RTSP reply (or move to
+ * the next state) before that.
+ *
+ * Complete() must be called from the thread driving the peer which uses
+ * the media manager, like any other call into the peer.
+ */
+class MediaCompletion {
+ public:
+  typedef std::function<void(bool result)> Callback;
+
+  /**
+   * Creates a pending token.
+   * @return new token
+   */
+  static MediaCompletionPtr Create() {
+    return MediaCompletionPtr(new MediaCompletion());
+  }
+
+  /**
+   * Creates a token for an operation which has already finished.
+   * @param result result of the operation
+   * @return new token
+   */
+  static MediaCompletionPtr Completed(bool result) {
+    MediaCompletionPtr completion = Create();
+    completion->Complete(result);
+    return completion;
+  }
+
+  /**
+   * Finishes the operation. Only the first call has any effect.
+   *
+   * @param result true if the operation succeeded; for queries
+   * (e.g. @c MediaManager::IsPausedAsync) the answer to the query
+   */
+  void Complete(bool result) {
+    if (completed_)
+      return;
+    completed_ = true;
+    result_ = result;
+    if (callback_) {
+      Callback callback;
+      callback.swap(callback_);
+      callback(result_);
+    }
+  }
+
+  /**
+   * Sets the function to be called once the operation has finished.
+   * The function is called right away if it has finished already.
+   *
+   * @param callback function receiving the result of the operation
+   */
+  void Then(Callback callback) {
+    if (completed_)
+      callback(result_);
+    else
+      callback_ = std::move(callback);
+  }
+
+  bool is_completed() const { return completed_; }
+  bool result() const { return result_; }
+
+ private:
+  MediaCompletion() : completed_(false), result_(false) {}
+
+  bool completed_;
+  bool result_;
+  Callback callback_;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_PUBLIC_MEDIA_COMPLETION_H_
@@ -25,7 +25,9 @@
 #include <string>
 #include <vector>
 #include "audio_codec.h"
+#include "capability_cache.h"
 #include "connector_type.h"
+#include "media_completion.h"
 #include "video_format.h"
 #include "wds_export.h"
 
@@ -46,6 +48,12 @@ enum SessionType {
  * MediaManager contains the common methods for both WFD sink and WFD source.
  * The client applications are not supposed to implement it directly, they should
  * rather implement either @c SinkMediaManager or @c SourceMediaManager.
+ *
+ * Operations which may take a while (e.g. pipeline state changes) also have
+ * an asynchronous variant returning a @c MediaCompletion token. The state
+ * machine only uses the asynchronous variants; their default implementations
+ * call the synchronous methods and return a completed token, so a media
+ * manager overrides them only if it does not want to block the caller.
  * @see SinkMediaManager, SourceMediaManager
  */
 class MediaManager {
@@ -73,6 +81,41 @@ class MediaManager {
    */
   virtual bool IsPaused() const = 0;
 
+  /**
+   * Asynchronous variant of Play().
+   * @return token completed once playback has started
+   */
+  virtual MediaCompletionPtr PlayAsync() {
+    Play();
+    return MediaCompletion::Completed(true);
+  }
+
+  /**
+   * Asynchronous variant of Pause().
+   * @return token completed once the media stream is paused
+   */
+  virtual MediaCompletionPtr PauseAsync() {
+    Pause();
+    return MediaCompletion::Completed(true);
+  }
+
+  /**
+   * Asynchronous variant of Teardown().
+   * @return token completed once the media stream is destroyed
+   */
+  virtual MediaCompletionPtr TeardownAsync() {
+    Teardown();
+    return MediaCompletion::Completed(true);
+  }
+
+  /**
+   * Asynchronous variant of IsPaused().
+   * @return token completed with true if media stream is paused
+   */
+  virtual MediaCompletionPtr IsPausedAsync() {
+    return MediaCompletion::Completed(IsPaused());
+  }
+
   /**
    * Returns unique WFD session id.
    *
@@ -136,12 +179,34 @@ class SinkMediaManager : public MediaManager {
    */
   virtual std::vector<H264VideoCodec> GetSupportedH264VideoCodecs() const = 0;
 
+  /**
+   * Returns list of supported H.265 video formats, advertised in
+   * 'wfd2_video_formats'. By default H.265 is not supported.
+   * @return vector of supported H.265 video formats
+   */
+  virtual std::vector<H265VideoCodec> GetSupportedH265VideoCodecs() const {
+    return std::vector<H265VideoCodec>();
+  }
+
   /**
    * Returns native video format of a device
    * @return native video format
    */
   virtual NativeVideoFormat GetNativeVideoFormat() const = 0;
 
+  /**
+   * Returns list of supported audio codecs, advertised in 'wfd-audio-codecs'.
+   * By default every LPCM, AAC and AC3 mode is declared supported.
+   * @return vector of supported audio codecs
+   */
+  virtual std::vector<AudioCodec> GetSupportedAudioCodecs() const {
+    std::vector<AudioCodec> codecs;
+    codecs.push_back(AudioCodec(LPCM, AudioModes(3), 0));
+    codecs.push_back(AudioCodec(AAC, AudioModes(15), 0));
+    codecs.push_back(AudioCodec(AC3, AudioModes(7), 0));
+    return codecs;
+  }
+
   /**
    * Sets optimal H264 format that would be used to send / receive video stream
    *
@@ -150,6 +215,34 @@ class SinkMediaManager : public MediaManager {
    */
   virtual bool SetOptimalVideoFormat(const H264VideoFormat& optimal_format) = 0;
 
+  /**
+   * Sets optimal H.265 format that would be used to receive video stream,
+   * instead of the one given to SetOptimalVideoFormat().
+   *
+   * @param optimal H.265 format
+   * @return true if format can be used by media manager, false otherwise
+   */
+  virtual bool SetOptimalH265VideoFormat(const H265VideoFormat& optimal_format) {
+    return false;
+  }
+
+  /**
+   * Sets the format of the stream from the frame of the given time
+   * stamps on, when the source changes the format during streaming.
+   * The default implementation switches right away.
+   *
+   * @param format new video format
+   * @param pts presentation time stamp of the first frame in the new format,
+   * in units of the 90 kHz MPEG-2 TS clock
+   * @param dts decoding time stamp of the same frame
+   * @return true if format can be used by media manager, false otherwise
+   */
+  virtual bool ScheduleVideoFormatChange(const H264VideoFormat& format,
+                                         unsigned long long pts,
+                                         unsigned long long dts) {
+    return SetOptimalVideoFormat(format);
+  }
+
   /**
    * Returns active connector type of a device
    * @return connector type. @see ConnectorType
@@ -189,6 +282,15 @@ class SourceMediaManager : public MediaManager {
    */
   virtual void SetSinkRtpPorts(int port1, int port2) = 0;
 
+  /**
+   * Asynchronous variant of SetSinkRtpPorts().
+   * @return token completed once the media stream can be set up
+   */
+  virtual MediaCompletionPtr SetSinkRtpPortsAsync(int port1, int port2) {
+    SetSinkRtpPorts(port1, port2);
+    return MediaCompletion::Completed(true);
+  }
+
   /**
    * Returns RTP ports that are used by WFD sink to receive media streams.
    * @see SetRtpPorts
@@ -221,6 +323,41 @@ class SourceMediaManager : public MediaManager {
    */
   virtual H264VideoFormat GetOptimalVideoFormat() const = 0;
 
+  /**
+   * Returns true if the video can be encoded in H.265, the H.265 formats
+   * of the sink are requested only then. By default H.265 is not supported.
+   */
+  virtual bool IsH265Supported() const {
+    return false;
+  }
+
+  /**
+   * Initializes optimal H.265 video format, called after
+   * InitOptimalVideoFormat() when the sink supports H.265 as well.
+   * The optimal video format will be returned by GetOptimalH265VideoFormat.
+   * When the sink rejects it, InitOptimalVideoFormat() is called again
+   * and the video is streamed in H.264.
+   *
+   * @param sink_native_format format of the sink device
+   * @param sink_supported_codecs H.265 formats that are supported by the sink device
+   * @return true if the video is streamed in H.265, false to stream it
+   * in the H.264 format chosen by InitOptimalVideoFormat()
+   */
+  virtual bool InitOptimalH265VideoFormat(
+      const NativeVideoFormat& sink_native_format,
+      const std::vector<H265VideoCodec>& sink_supported_codecs) {
+    return false;
+  }
+
+  /**
+   * Gets optimal H.265 format @see InitOptimalH265VideoFormat
+   *
+   * @return optimal H.265 format
+   */
+  virtual H265VideoFormat GetOptimalH265VideoFormat() const {
+    return H265VideoFormat();
+  }
+
   /**
    * Initializes optimal audio codec
    * The optimal audio codec will be returned by GetOptimalAudioFormat
@@ -237,11 +374,91 @@ class SourceMediaManager : public MediaManager {
    */
   virtual AudioCodec GetOptimalAudioFormat() const = 0;
 
+  /**
+   * Called when a sink the source has negotiated formats with before
+   * connects (@see Source::SetCapabilityCache), before the capability
+   * exchange. The same formats are likely to be chosen again, so the
+   * media manager can start building the media stream for them while
+   * the capabilities are being negotiated.
+   *
+   * @param formats formats negotiated with the sink the last time
+   */
+  virtual void PrepareMedia(const NegotiatedFormats& formats) {}
+
+  /**
+   * Called once the sink has accepted the formats (M4), before the session
+   * is set up (M6) and played (M7). The media manager can finish setting
+   * up the media stream for the formats and preroll it, so that starting
+   * to play it is quick.
+   *
+   * @return token completed once the media stream is ready to be played
+   */
+  virtual MediaCompletionPtr PrerollMediaAsync() {
+    return MediaCompletion::Completed(true);
+  }
+
+  /**
+   * Makes the given cached formats the optimal ones, instead of
+   * InitOptimalVideoFormat() and InitOptimalAudioFormat(). Called when a
+   * sink reports the same capabilities it had when the formats were
+   * negotiated.
+   *
+   * @param formats formats negotiated with the sink the last time
+   * @return true if the formats are used, false to negotiate them again
+   */
+  virtual bool UseNegotiatedFormats(const NegotiatedFormats& formats) {
+    return false;
+  }
+
   /**
    * Sends of H.264 instantaneous decoding refresh (IDR) picture
    * to recover the content streaming.
    */
   virtual void SendIDRPicture() = 0;
+
+  /**
+   * Asynchronous variant of SendIDRPicture(). The IDR request (M13) is
+   * answered right away, the token is only used to measure how long the
+   * picture takes to leave the encoder, @see PeerStats::idr_latency.
+   * @return token completed with true once the IDR picture has been sent,
+   * false if it could not be produced
+   */
+  virtual MediaCompletionPtr SendIDRPictureAsync() {
+    SendIDRPicture();
+    return MediaCompletion::Completed(true);
+  }
+
+  /**
+   * Picks the frame from which the stream will be encoded in the given
+   * format, @see Source::ChangeVideoFormat. The frame must be far enough
+   * ahead for the sink to acknowledge the change before it is encoded.
+   *
+   * @param format new video format
+   * @param pts presentation time stamp of the first frame in the new format,
+   * in units of the 90 kHz MPEG-2 TS clock
+   * @param dts decoding time stamp of the same frame
+   * @return true if the encoder can switch to the format, false otherwise
+   */
+  virtual bool PrepareVideoFormatChange(const H264VideoFormat& format,
+                                        unsigned long long* pts,
+                                        unsigned long long* dts) {
+    return false;
+  }
+
+  /**
+   * Called when the sink accepts the change prepared by
+   * PrepareVideoFormatChange(). The encoder must be reconfigured at the
+   * chosen frame, and the format returned by GetOptimalVideoFormat().
+   *
+   * @param format new video format
+   */
+  virtual void ApplyVideoFormatChange(const H264VideoFormat& format) {}
+
+  /**
+   * Called when the sink rejects the change prepared by
+   * PrepareVideoFormatChange(), the stream stays in the current format.
+   */
+  virtual void CancelVideoFormatChange() {}
 };
 
 inline SourceMediaManager* ToSourceMediaManager(MediaManager* mng) {
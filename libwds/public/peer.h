@@ -24,6 +24,9 @@
 
 #include <string>
 
+#include "logging.h"
+#include "peer_stats.h"
+#include "timeline.h"
 #include "wds_export.h"
 
 namespace wds {
@@ -111,6 +114,16 @@ class WDS_EXPORT Peer {
      * State machine is not reset.
      */
     virtual void SessionCompleted() {}
+    /**
+     * This method is called for every step of an RTSP message exchange
+     * and of a media manager call made by the state machine, so that the
+     * client can see where the session setup time goes.
+     *
+     * @param event the step with its timestamp
+     *
+     * @see TimelineEvent, ChromeTraceWriter
+     */
+    virtual void TimelineEventOccurred(const TimelineEvent& event) {}
 
    protected:
     virtual ~Observer() {}
@@ -168,6 +181,27 @@ class WDS_EXPORT Peer {
    * @see Delegate::CreateTimer()
    */
   virtual void OnTimerEvent(unsigned timer_id) = 0;
+
+  /**
+   * Sets a function receiving the messages logged on behalf of this peer
+   * instead of the LogSystem functions. The function is called on the
+   * thread that called into the peer.
+   * @param func log function, nullptr restores the LogSystem functions
+   * @param user_data passed back to @a func, e.g. the owning session
+   *
+   * @see LogSystem
+   */
+  virtual void SetLogHandler(SessionLogFunction func, void* user_data) = 0;
+
+  /**
+   * Returns a snapshot of the runtime counters and latency histograms
+   * of this peer. Unlike the other methods, this one can be called from
+   * any thread while the peer is in use.
+   * @return the counters and histograms collected so far
+   *
+   * @see PeerStats
+   */
+  virtual PeerStats GetStats() const = 0;
 };
 
 }
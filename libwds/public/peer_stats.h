@@ -0,0 +1,104 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef LIBWDS_PUBLIC_PEER_STATS_H_
+#define LIBWDS_PUBLIC_PEER_STATS_H_
+
+#include <cstdint>
+
+#include "wds_export.h"
+
+namespace wds {
+
+/**
+ * Latency distribution in microseconds.
+ *
+ * Like HDR histograms, the buckets grow exponentially: there are four
+ * buckets per power of two, so every value is known within 25%. Values
+ * of 2^26 us (about 67 s) and above are counted in the last bucket.
+ */
+struct WDS_EXPORT LatencyHistogram {
+  static const int kBucketCount = 100;
+
+  /**
+   * Returns the bucket counting the given value.
+   * @param value_us value in microseconds
+   * @return bucket index
+   */
+  static int BucketIndex(uint64_t value_us);
+
+  /**
+   * Returns the lowest value counted by the given bucket.
+   * @param index bucket index
+   * @return value in microseconds
+   */
+  static uint64_t BucketLowerBound(int index);
+
+  /**
+   * Returns the value which the given percentage of the samples do not
+   * exceed, e.g. Percentile(99) for the 99th percentile.
+   * @param percentile percentage, 0 to 100
+   * @return upper bound of the value in microseconds, 0 if there are no samples
+   */
+  uint64_t Percentile(double percentile) const;
+
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint64_t buckets[kBucketCount];
+};
+
+/**
+ * Snapshot of the counters of a peer, @see Peer::GetStats
+ */
+struct PeerStats {
+  /// The per-message counters are indexed by the WFD message number
+  /// (e.g. 3 for M3), index 0 counts requests that were not identified.
+  static const int kMessageTypes = 17;
+
+  uint64_t requests_received[kMessageTypes];
+  uint64_t requests_sent[kMessageTypes];
+  /// Replies counted by the request they answer.
+  uint64_t replies_received[kMessageTypes];
+  uint64_t replies_sent[kMessageTypes];
+
+  /// RTSP input that could not be parsed.
+  uint64_t parse_errors;
+  /// Requests left unanswered by the remote peer.
+  uint64_t timeouts;
+  uint64_t bytes_received;
+  uint64_t bytes_sent;
+
+  /// Time to parse an RTSP message.
+  LatencyHistogram parse_time;
+  /// Time the state machine takes to handle a parsed message.
+  LatencyHistogram handler_time;
+  /// Time from sending a request until its reply is received.
+  LatencyHistogram round_trip_time;
+  /// Time from receiving an IDR request (M13) until the IDR picture is
+  /// sent, source only.
+  LatencyHistogram idr_latency;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_PUBLIC_PEER_STATS_H_
@@ -39,9 +39,20 @@ class WDS_EXPORT Sink : public Peer {
    * Factory method that creates Sink state machine.
    * @param delegate that is used for networking
    * @param media manger that is used for media stream management
+   * @param observer
    * @return newly created Sink instance
    */
-  static Sink* Create(Peer::Delegate* delegate, SinkMediaManager* mng);
+  static Sink* Create(Peer::Delegate* delegate,
+                      SinkMediaManager* mng,
+                      Peer::Observer* observer = nullptr);
+
+  /**
+   * Asks the source for an IDR picture (M13), e.g. when packet loss has
+   * damaged the picture, instead of waiting for the next keyframe.
+   * @return true if the request is sent, false if the session is not
+   * streaming or an earlier request is still unanswered
+   */
+  virtual bool RequestIDR() = 0;
 };
 
 }
@@ -22,10 +22,14 @@
 #ifndef LIBWDS_PUBLIC_SOURCE_H_
 #define LIBWDS_PUBLIC_SOURCE_H_
 
+#include <string>
+
 #include "peer.h"
+#include "video_format.h"
 
 namespace wds {
 
+class CapabilityCache;
 class SourceMediaManager;
 
 /**
@@ -43,6 +47,28 @@ class WDS_EXPORT Source : public Peer {
   static Source* Create(Peer::Delegate* delegate,
                         SourceMediaManager* mng,
                         Peer::Observer* observer = nullptr);
+
+  /**
+   * Makes the source remember the formats negotiated with the sink in
+   * the given cache and reuse them when the same sink connects again.
+   * Must be called before Start(), which lets the media manager prepare
+   * the cached formats (@see SourceMediaManager::PrepareMedia).
+   * @param cache cache shared with other sources, nullptr disables it
+   * @param peer_id key identifying the sink, e.g. its P2P device address
+   */
+  virtual void SetCapabilityCache(CapabilityCache* cache,
+                                  const std::string& peer_id) = 0;
+
+  /**
+   * Switches the stream to another video format while streaming, e.g. to
+   * a lower resolution when the link is congested. Sends M4 with the
+   * format and the time stamps of the frame from which it is used,
+   * @see SourceMediaManager::PrepareVideoFormatChange.
+   * @param format new video format, one that the sink supports
+   * @return true if M4 is sent, false if the session is not streaming,
+   * another change is pending or the media manager cannot switch
+   */
+  virtual bool ChangeVideoFormat(const H264VideoFormat& format) = 0;
 };
 
 }
@@ -0,0 +1,107 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef LIBWDS_PUBLIC_TIMELINE_H_
+#define LIBWDS_PUBLIC_TIMELINE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "wds_export.h"
+
+namespace wds {
+
+/**
+ * A step of the RTSP message exchange or of a media manager call made by
+ * the state machine, reported through @c Peer::Observer::TimelineEventOccurred.
+ */
+struct TimelineEvent {
+  enum Type {
+    RequestSent,
+    RequestReceived,
+    ReplySent,
+    ReplyReceived,
+    MediaCallEntered,
+    MediaCallReturned,
+    /// Peer::Start() was called, i.e. the RTSP connection is established.
+    SessionStarted,
+    /// The first media packet was sent. Not reported by the state machine:
+    /// the client adds it from its media pipeline, see TimelineTimestamp().
+    FirstMediaPacket
+  };
+
+  Type type;
+  /// WFD message the step belongs to, e.g. 7 for M7, 0 if not identified.
+  int message;
+  /// CSeq of the RTSP message, 0 for media manager calls.
+  int cseq;
+  /// Name of the media manager call, nullptr for RTSP messages.
+  const char* media_call;
+  /// Monotonic time in microseconds, see TimelineTimestamp().
+  uint64_t timestamp_us;
+};
+
+/**
+ * Returns the current time in the clock of TimelineEvent::timestamp_us,
+ * CLOCK_MONOTONIC in microseconds (as g_get_monotonic_time()).
+ * @return monotonic time in microseconds
+ */
+WDS_EXPORT uint64_t TimelineTimestamp();
+
+/**
+ * Builds a Chrome trace event JSON document (as loaded by chrome://tracing
+ * and the Perfetto UI) from the timeline events of one or more sessions.
+ *
+ * Every session is shown as a process with one track for the RTSP message
+ * exchanges and one for the media manager calls. When both the session
+ * start and the first media packet were recorded, the time between them
+ * is shown as a "Setup" span on a track of its own.
+ */
+class WDS_EXPORT ChromeTraceWriter {
+ public:
+  ChromeTraceWriter();
+
+  /**
+   * Adds the events recorded for a session.
+   * @param session_name name to show for the session
+   * @param events timeline events in the order they were reported
+   */
+  void AddSession(const std::string& session_name,
+                  const std::vector<TimelineEvent>& events);
+
+  /**
+   * Returns the JSON document.
+   * @return trace in Chrome trace event format
+   */
+  std::string ToString() const;
+
+ private:
+  void AddEvent(const std::string& event);
+
+  std::string trace_events_;
+  int session_count_;
+};
+
+}  // namespace wds
+
+#endif  // LIBWDS_PUBLIC_TIMELINE_H_
@@ -23,6 +23,9 @@
 #define LIBWDS_PUBLIC_VIDEO_FORMAT_H_
 
 #include <bitset>
+#include <cstddef>
+#include <functional>
+#include <iterator>
 #include <vector>
 
 #include "wds_export.h"
@@ -120,6 +123,24 @@ enum H264Level {
   k4_2
 };
 
+enum H265Profile {
+  H265Main,
+  H265Main10
+};
+
+enum H265Level {
+  kH265_3_1,
+  kH265_4,
+  kH265_4_1,
+  kH265_5,
+  kH265_5_1
+};
+
+enum VideoCodecType {
+  H264,
+  H265
+};
+
 
 struct NativeVideoFormat {
   NativeVideoFormat()
@@ -135,6 +156,60 @@ struct NativeVideoFormat {
   RateAndResolution rate_resolution;
 };
 
+/**
+ * Frame size and rate of a CEA, VESA or HH rate and resolution.
+ */
+struct VideoModeInfo {
+  VideoModeInfo() : width(0), height(0), frame_rate(0), interlaced(false) {}
+  constexpr VideoModeInfo(unsigned width, unsigned height,
+                          unsigned frame_rate, bool interlaced)
+  : width(width), height(height), frame_rate(frame_rate),
+    interlaced(interlaced) {}
+
+  unsigned width;
+  unsigned height;
+  /// Frames per second, or fields per second for interlaced modes.
+  unsigned frame_rate;
+  bool interlaced;
+};
+
+/**
+ * Gets the frame size and rate of the given rate and resolution.
+ *
+ * @param type resolution type
+ * @param rate_resolution CEA, VESA or HH rate and resolution,
+ * depending on @a type
+ * @return the mode info, all zeros for an unknown mode
+ */
+WDS_EXPORT VideoModeInfo GetVideoModeInfo(ResolutionType type,
+                                          RateAndResolution rate_resolution);
+
+/**
+ * The misc-params, max-hres and max-vres of a 'wfd-video-formats' codec.
+ *
+ * Sinks advertise the latency and slicing they decode best with, sources
+ * echo the values they encode with in the selected format. All zeros
+ * leave them unspecified.
+ */
+struct H264CodecParameters {
+  H264CodecParameters()
+  : latency(0), min_slice_size(0), slice_enc_params(0),
+    frame_rate_control_support(0), max_hres(0), max_vres(0) {}
+
+  /// Decoder latency in units of 5 ms.
+  unsigned char latency;
+  /// Smallest slice that can be decoded in macroblocks, 0 if slices are
+  /// not supported.
+  unsigned short min_slice_size;
+  /// Maximum number of slices and slice size ratio bits.
+  unsigned short slice_enc_params;
+  /// Frame skipping and dynamic frame rate change support bits.
+  unsigned char frame_rate_control_support;
+  /// Largest frame size for the preferred display mode, 0 for none.
+  unsigned short max_hres;
+  unsigned short max_vres;
+};
+
 /**
  * A single video format that the source selects for streaming.
  *
@@ -160,8 +235,41 @@ struct H264VideoFormat {
   H264Level level;
   ResolutionType type;
   RateAndResolution rate_resolution;
+  H264CodecParameters params;
 };
 
+inline VideoModeInfo GetVideoModeInfo(const H264VideoFormat& format) {
+  return GetVideoModeInfo(format.type, format.rate_resolution);
+}
+
+/**
+ * A single H.265 video format, @see H264VideoFormat.
+ */
+struct H265VideoFormat {
+  H265VideoFormat()
+  : profile(H265Main), level(kH265_3_1), type(CEA),
+    rate_resolution(CEA640x480p60) {}
+
+  H265VideoFormat(H265Profile profile, H265Level level, CEARatesAndResolutions rr)
+  : profile(profile), level(level), type(CEA), rate_resolution(rr) {}
+
+  H265VideoFormat(H265Profile profile, H265Level level, VESARatesAndResolutions rr)
+  : profile(profile), level(level), type(VESA), rate_resolution(rr) {}
+
+  H265VideoFormat(H265Profile profile, H265Level level, HHRatesAndResolutions rr)
+  : profile(profile), level(level), type(HH), rate_resolution(rr) {}
+
+  H265Profile profile;
+  H265Level level;
+  ResolutionType type;
+  RateAndResolution rate_resolution;
+  H264CodecParameters params;
+};
+
+inline VideoModeInfo GetVideoModeInfo(const H265VideoFormat& format) {
+  return GetVideoModeInfo(format.type, format.rate_resolution);
+}
+
 /**
  * Represents <profile, level, misc-params, max-hres, max-vres> tuple used in 'wfd-video-formats'.
  *
@@ -185,11 +293,137 @@ struct H264VideoCodec {
   RateAndResolutionsBitmap cea_rr;
   RateAndResolutionsBitmap vesa_rr;
   RateAndResolutionsBitmap hh_rr;
+  H264CodecParameters params;
+};
+
+/**
+ * The H.265 profile, level and resolutions of a codec in 'wfd2_video_formats',
+ * which has the tuples of 'wfd-video-formats' @see H264VideoCodec.
+ */
+struct H265VideoCodec {
+  H265VideoCodec()
+  : profile(H265Main), level(kH265_3_1),
+    cea_rr(RateAndResolutionsBitmap().set(CEA640x480p60)) {}
+
+  H265VideoCodec(H265Profile profile, H265Level level,
+                 const RateAndResolutionsBitmap& cea,
+                 const RateAndResolutionsBitmap& vesa,
+                 const RateAndResolutionsBitmap& hh)
+  : profile(profile), level(level), cea_rr(cea), vesa_rr(vesa), hh_rr(hh) {}
+
+  H265Profile profile;
+  H265Level level;
+  RateAndResolutionsBitmap cea_rr;
+  RateAndResolutionsBitmap vesa_rr;
+  RateAndResolutionsBitmap hh_rr;
+  H264CodecParameters params;
+};
+
+/**
+ * A view of the @c H264VideoFormat items of a @c H264VideoCodec (or the
+ * @c H265VideoFormat items of a @c H265VideoCodec), to enumerate them
+ * without allocating a list: CEA, VESA and then HH formats, each in
+ * the rate and resolution order.
+ *
+ * The iterators refer to the range, which keeps a copy of the codec.
+ */
+template <typename Codec, typename Format>
+class VideoFormatRange {
+ public:
+  class Iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Format value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Format* pointer;
+    typedef const Format& reference;
+
+    reference operator*() const { return format_; }
+    pointer operator->() const { return &format_; }
+    Iterator& operator++() {
+      range_->Seek(format_.type, format_.rate_resolution + 1, &format_);
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator it = *this;
+      ++*this;
+      return it;
+    }
+    bool operator==(const Iterator& other) const {
+      return format_.type == other.format_.type &&
+             format_.rate_resolution == other.format_.rate_resolution;
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class VideoFormatRange;
+    Iterator(const VideoFormatRange* range, ResolutionType type,
+             RateAndResolution rate_resolution)
+    : range_(range),
+      format_(range->codec_.profile, range->codec_.level, CEA640x480p60) {
+      format_.params = range->codec_.params;
+      range->Seek(type, rate_resolution, &format_);
+    }
+
+    const VideoFormatRange* range_;
+    Format format_;
+  };
+
+  VideoFormatRange() { codec_.cea_rr.reset(); }
+  explicit VideoFormatRange(const Codec& codec) : codec_(codec) {}
+
+  Iterator begin() const { return Iterator(this, CEA, 0); }
+  Iterator end() const { return Iterator(this, HH, Count(HH)); }
+  size_t size() const {
+    return (codec_.cea_rr & Mask(CEA)).count() +
+           (codec_.vesa_rr & Mask(VESA)).count() +
+           (codec_.hh_rr & Mask(HH)).count();
+  }
+  bool empty() const { return size() == 0; }
+
+ private:
+  static RateAndResolution Count(ResolutionType type) {
+    return type == CEA ? CEA1920x1080p24 + 1 :
+           type == VESA ? VESA1920x1200p30 + 1 : HH848x480p60 + 1;
+  }
+  static RateAndResolutionsBitmap Mask(ResolutionType type) {
+    return RateAndResolutionsBitmap((1ul << Count(type)) - 1);
+  }
+  const RateAndResolutionsBitmap& Bitmap(ResolutionType type) const {
+    return type == CEA ? codec_.cea_rr :
+           type == VESA ? codec_.vesa_rr : codec_.hh_rr;
+  }
+  // Moves |format| to the first format at or after |rate_resolution|
+  // of |type|, or to the end.
+  void Seek(ResolutionType type, RateAndResolution rate_resolution,
+            Format* format) const {
+    for (;;) {
+      for (; rate_resolution < Count(type); ++rate_resolution) {
+        if (Bitmap(type).test(rate_resolution)) {
+          format->type = type;
+          format->rate_resolution = rate_resolution;
+          return;
+        }
+      }
+      if (type == HH)
+        break;
+      type = static_cast<ResolutionType>(type + 1);
+      rate_resolution = 0;
+    }
+    format->type = HH;
+    format->rate_resolution = Count(HH);
+  }
+
+  Codec codec_;
 };
 
+using H264VideoFormatRange = VideoFormatRange<H264VideoCodec, H264VideoFormat>;
+using H265VideoFormatRange = VideoFormatRange<H265VideoCodec, H265VideoFormat>;
+
 /**
  * An auxiliary function which populates list of @c H264VideoFormat
  * items from the given @c H264VideoCodec instance.
+ * @see H264VideoFormatRange to enumerate them without the list
  *
  * @param codec the given @c H264VideoCodec instance.
  * @param formats resulting list of @c H264VideoFormat items
@@ -213,6 +447,116 @@ WDS_EXPORT H264VideoFormat FindOptimalVideoFormat(
     const std::vector<H264VideoCodec>& remote_codecs,
     bool* success = nullptr);
 
+/**
+ * @see FindOptimalVideoFormat for H.265 codecs.
+ */
+WDS_EXPORT H265VideoFormat FindOptimalVideoFormat(
+    const NativeVideoFormat& remote_native_format,
+    const std::vector<H265VideoCodec>& local_codecs,
+    const std::vector<H265VideoCodec>& remote_codecs,
+    bool* success = nullptr);
+
+/**
+ * What it takes to stream a video format in real time, @see SelectVideoFormat
+ */
+struct VideoFormatCostModel {
+  VideoFormatCostModel()
+  : link_mbps(0), bits_per_pixel(0.1), h265_bitrate_ratio(0.6),
+    prefer_native(true) {}
+
+  /// Throughput of the link to the remote device in Mbps, e.g. the maximum
+  /// throughput from its WFD device information subelement. 0 if unknown.
+  unsigned link_mbps;
+  /// Average encoded size of a pixel: the bitrate of a format is estimated
+  /// as width * height * frames per second * bits_per_pixel.
+  double bits_per_pixel;
+  /// Bitrate of H.265 relative to H.264 at the same quality.
+  double h265_bitrate_ratio;
+  /// Frames per second the local encoder sustains at the given frame size.
+  /// Unset if it keeps up with every format.
+  std::function<unsigned(unsigned width, unsigned height)> encoder_fps;
+  /// Whether the native format of the remote device is picked over
+  /// the formats of higher quality when it can be sustained.
+  bool prefer_native;
+};
+
+/**
+ * Checks whether the given format can be streamed in real time with the
+ * given cost model, e.g. before reusing a format negotiated earlier.
+ *
+ * @param format H.264 video format
+ * @param cost_model link and encoder limits
+ * @return false if the link or the encoder cannot keep up with the format
+ */
+WDS_EXPORT bool IsVideoFormatSustainable(
+    const H264VideoFormat& format,
+    const VideoFormatCostModel& cost_model);
+
+/**
+ * @see IsVideoFormatSustainable for H.265 formats, the bitrate is
+ * estimated with @c VideoFormatCostModel::h265_bitrate_ratio.
+ */
+WDS_EXPORT bool IsVideoFormatSustainable(
+    const H265VideoFormat& format,
+    const VideoFormatCostModel& cost_model);
+
+/**
+ * Finds the best video format that both devices support and that can be
+ * streamed in real time with the given cost model: the native format of
+ * the remote device if preferred, otherwise the one of highest quality
+ * weight. If no format can be sustained, the one @c FindOptimalVideoFormat
+ * picks is returned.
+ *
+ * @param native format of a remote device
+ * @param local_codecs list of H264 codecs that are supported by local device
+ * @param remote_codecs list of H264 codecs that are supported by remote device
+ * @param cost_model link and encoder limits
+ * @return best sustainable H264 video format
+ */
+WDS_EXPORT H264VideoFormat SelectVideoFormat(
+    const NativeVideoFormat& remote_native_format,
+    const std::vector<H264VideoCodec>& local_codecs,
+    const std::vector<H264VideoCodec>& remote_codecs,
+    const VideoFormatCostModel& cost_model,
+    bool* success = nullptr);
+
+/**
+ * @see SelectVideoFormat for H.265 codecs, the bitrate is estimated with
+ * @c VideoFormatCostModel::h265_bitrate_ratio.
+ */
+WDS_EXPORT H265VideoFormat SelectVideoFormat(
+    const NativeVideoFormat& remote_native_format,
+    const std::vector<H265VideoCodec>& local_codecs,
+    const std::vector<H265VideoCodec>& remote_codecs,
+    const VideoFormatCostModel& cost_model,
+    bool* success = nullptr);
+
+/**
+ * Selects the codec and the video format to stream with. H.265 is
+ * preferred when both devices support it and it reaches at least the
+ * quality weight H.264 does: its lower bitrate lets it sustain better
+ * formats on a slow link.
+ *
+ * @param native format of a remote device
+ * @param local_h264_codecs H.264 codecs supported by local device
+ * @param remote_h264_codecs H.264 codecs supported by remote device
+ * @param local_h265_codecs H.265 codecs supported by local device
+ * @param remote_h265_codecs H.265 codecs supported by remote device
+ * @param cost_model link and encoder limits
+ * @param h264_format set to the H.264 format if H.264 is selected
+ * @param h265_format set to the H.265 format if H.265 is selected
+ * @return the selected codec
+ */
+WDS_EXPORT VideoCodecType SelectVideoCodec(
+    const NativeVideoFormat& remote_native_format,
+    const std::vector<H264VideoCodec>& local_h264_codecs,
+    const std::vector<H264VideoCodec>& remote_h264_codecs,
+    const std::vector<H265VideoCodec>& local_h265_codecs,
+    const std::vector<H265VideoCodec>& remote_h265_codecs,
+    const VideoFormatCostModel& cost_model,
+    H264VideoFormat* h264_format,
+    H265VideoFormat* h265_format);
+
 }  // namespace wds
 
 #endif  // LIBWDS_PUBLIC_VIDEO_FORMAT_H_
@@ -41,6 +41,7 @@ enum PropertyType {
   CoupledSinkPropertyType,
   DisplayEdidPropertyType,
   GenericPropertyType,
+  H265VideoFormatsPropertyType,
   I2CPropertyType,
   IDRRequestPropertyType,
   PreferredDisplayModePropertyType,
@@ -59,6 +60,7 @@ namespace PropertyName {
   const char wfd_audio_codecs[] = "wfd_audio_codecs";
   const char wfd_video_formats[] = "wfd_video_formats";
   const char wfd_3d_video_formats[] = "wfd_3d_video_formats";
+  const char wfd2_video_formats[] = "wfd2_video_formats";
   const char wfd_content_protection[] = "wfd_content_protection";
   const char wfd_display_edid[] = "wfd_display_edid";
   const char wfd_coupled_sink[] = "wfd_coupled_sink";
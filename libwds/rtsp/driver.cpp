@@ -61,7 +61,10 @@ void Driver::Parse(const std::string& input, std::unique_ptr<Message>& message)
   void* scanner = nullptr;
 #if YYDEBUG
   bool enable_debug = true;
-  wds_debug = 1;
+  // wds_debug is a process global of the generated parser, set it once
+  // rather than on every call so that peers can parse concurrently.
+  static const bool parser_debug_enabled = (wds_debug = 1);
+  (void) parser_debug_enabled;
 #else
   bool enable_debug = false;
 #endif
@@ -68,6 +68,8 @@ std::string GetPropertyName(PropertyType type) {
     case GenericPropertyType:
       WDS_ERROR("Generic property does not have a defined name");
       return std::string();
+    case H265VideoFormatsPropertyType:
+      return PropertyName::wfd2_video_formats;
     case I2CPropertyType:
       return PropertyName::wfd_I2C;
     case IDRRequestPropertyType:
@@ -0,0 +1,340 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef LIBWDS_RTSP_TESTS_SESSION_FIXTURE_H_
+#define LIBWDS_RTSP_TESTS_SESSION_FIXTURE_H_
+
+// A source and a sink talking over an in-memory transport, with media
+// managers recording what the state machines asked them to do. Shared by
+// the session tests and the multi-threaded stress test.
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libwds/public/capability_cache.h"
+#include "libwds/public/logging.h"
+#include "libwds/public/media_manager.h"
+#include "libwds/public/sink.h"
+#include "libwds/public/source.h"
+#include "libwds/public/timeline.h"
+
+inline wds::H264VideoCodec TestCodec() {
+  wds::RateAndResolutionsBitmap cea_rr;
+  cea_rr.set(wds::CEA640x480p60);
+  cea_rr.set(wds::CEA1280x720p30);
+  return wds::H264VideoCodec(wds::CBP, wds::k3_1, cea_rr,
+                             wds::RateAndResolutionsBitmap(),
+                             wds::RateAndResolutionsBitmap());
+}
+
+inline wds::H265VideoCodec TestH265Codec() {
+  wds::H264VideoCodec codec = TestCodec();
+  return wds::H265VideoCodec(wds::H265Main, wds::kH265_3_1, codec.cea_rr,
+                             codec.vesa_rr, codec.hh_rr);
+}
+
+class TestSourceMediaManager : public wds::SourceMediaManager {
+ public:
+  TestSourceMediaManager()
+    : play_count(0), teardown_count(0), format_selections(0),
+      prepare_count(0), preroll_count(0), cancelled_format_changes(0),
+      async_play(false),
+      h265(false), paused_(true) {}
+
+  void Play() override { paused_ = false; ++play_count; }
+  void Pause() override { paused_ = true; }
+  void Teardown() override { paused_ = true; ++teardown_count; }
+  bool IsPaused() const override { return paused_; }
+  std::string GetSessionId() const override { return "stress"; }
+  wds::SessionType GetSessionType() const override { return wds::VideoSession; }
+  void SetSinkRtpPorts(int port1, int port2) override { ports_ = {port1, port2}; }
+  std::pair<int,int> GetSinkRtpPorts() const override { return ports_; }
+  int GetLocalRtpPort() const override { return 16384; }
+  bool InitOptimalVideoFormat(
+      const wds::NativeVideoFormat& sink_native_format,
+      const std::vector<wds::H264VideoCodec>& sink_supported_codecs) override {
+    ++format_selections;
+    format_ = wds::FindOptimalVideoFormat(sink_native_format, {TestCodec()},
+                                          sink_supported_codecs);
+    return true;
+  }
+  wds::H264VideoFormat GetOptimalVideoFormat() const override { return format_; }
+  bool IsH265Supported() const override { return h265; }
+  bool InitOptimalH265VideoFormat(
+      const wds::NativeVideoFormat& sink_native_format,
+      const std::vector<wds::H265VideoCodec>& sink_supported_codecs) override {
+    h265_format_ = wds::FindOptimalVideoFormat(
+        sink_native_format, {TestH265Codec()}, sink_supported_codecs);
+    return true;
+  }
+  wds::H265VideoFormat GetOptimalH265VideoFormat() const override {
+    return h265_format_;
+  }
+  bool InitOptimalAudioFormat(const std::vector<wds::AudioCodec>&) override { return false; }
+  wds::AudioCodec GetOptimalAudioFormat() const override { return wds::AudioCodec(); }
+  void SendIDRPicture() override {}
+  wds::MediaCompletionPtr SendIDRPictureAsync() override {
+    pending_idr = wds::MediaCompletion::Create();
+    return pending_idr;
+  }
+  void PrepareMedia(const wds::NegotiatedFormats&) override { ++prepare_count; }
+  wds::MediaCompletionPtr PrerollMediaAsync() override {
+    ++preroll_count;
+    return wds::SourceMediaManager::PrerollMediaAsync();
+  }
+  bool UseNegotiatedFormats(const wds::NegotiatedFormats& formats) override {
+    format_ = formats.video_format;
+    return true;
+  }
+  bool PrepareVideoFormatChange(const wds::H264VideoFormat&,
+                                unsigned long long* pts,
+                                unsigned long long* dts) override {
+    // A second ahead of the stream.
+    *pts = 90000;
+    *dts = 87000;
+    return true;
+  }
+  void ApplyVideoFormatChange(const wds::H264VideoFormat& format) override {
+    format_ = format;
+  }
+  void CancelVideoFormatChange() override { ++cancelled_format_changes; }
+
+  wds::MediaCompletionPtr PlayAsync() override {
+    if (!async_play)
+      return wds::SourceMediaManager::PlayAsync();
+    pending_play = wds::MediaCompletion::Create();
+    return pending_play;
+  }
+
+  void CompletePlay() {
+    Play();
+    pending_play->Complete(true);
+  }
+
+  int play_count;
+  int teardown_count;
+  int format_selections;
+  int prepare_count;
+  int preroll_count;
+  int cancelled_format_changes;
+  bool async_play;
+  bool h265;
+  wds::MediaCompletionPtr pending_play;
+  wds::MediaCompletionPtr pending_idr;
+
+ private:
+  bool paused_;
+  std::pair<int,int> ports_;
+  wds::H264VideoFormat format_;
+  wds::H265VideoFormat h265_format_;
+};
+
+class TestSinkMediaManager : public wds::SinkMediaManager {
+ public:
+  TestSinkMediaManager()
+    : reject_vga(false), h265(false), reject_h265(false),
+      format_change_pts(0), h265_formats_set(0), paused_(true) {}
+
+  void Play() override { paused_ = false; }
+  void Pause() override { paused_ = true; }
+  void Teardown() override { paused_ = true; }
+  bool IsPaused() const override { return paused_; }
+  std::string GetSessionId() const override { return session_; }
+  std::pair<int,int> GetLocalRtpPorts() const override { return {1028, 0}; }
+  void SetPresentationUrl(const std::string& url) override { url_ = url; }
+  std::string GetPresentationUrl() const override { return url_; }
+  void SetSessionId(const std::string& session) override { session_ = session; }
+  std::vector<wds::H264VideoCodec> GetSupportedH264VideoCodecs() const override {
+    return {TestCodec()};
+  }
+  std::vector<wds::H265VideoCodec> GetSupportedH265VideoCodecs() const override {
+    if (!h265)
+      return {};
+    return {TestH265Codec()};
+  }
+  wds::NativeVideoFormat GetNativeVideoFormat() const override {
+    return wds::NativeVideoFormat(wds::CEA1280x720p30);
+  }
+  bool SetOptimalVideoFormat(const wds::H264VideoFormat& format) override {
+    format_ = format;
+    return !reject_vga || format.rate_resolution != wds::CEA640x480p60;
+  }
+  bool ScheduleVideoFormatChange(const wds::H264VideoFormat& format,
+                                 unsigned long long pts,
+                                 unsigned long long) override {
+    format_change_pts = pts;
+    return SetOptimalVideoFormat(format);
+  }
+  bool SetOptimalH265VideoFormat(const wds::H265VideoFormat&) override {
+    ++h265_formats_set;
+    return !reject_h265;
+  }
+  const wds::H264VideoFormat& format() const { return format_; }
+  wds::ConnectorType GetConnectorType() const override { return wds::ConnectorTypeNone; }
+
+  // Fails to set up the 640x480 format the source selects first.
+  bool reject_vga;
+  bool h265;
+  // Fails to set up the H.265 format, as if it could not be decoded.
+  bool reject_h265;
+  unsigned long long format_change_pts;
+  int h265_formats_set;
+
+ private:
+  bool paused_;
+  std::string url_;
+  std::string session_;
+  wds::H264VideoFormat format_;
+};
+
+// In-memory transport: data sent by one peer is queued for the other one
+// and delivered by Pump(), so the state machines are never reentered.
+class Endpoint : public wds::Peer::Delegate {
+ public:
+  Endpoint()
+    : coalesced_sends(0),
+      peer_(nullptr), remote_(nullptr), cseq_(0), timer_id_(0) {}
+
+  void Connect(wds::Peer* peer, Endpoint* remote) {
+    peer_ = peer;
+    remote_ = remote;
+  }
+
+  bool Deliver() {
+    if (inbox_.empty())
+      return false;
+    std::string data = inbox_.front();
+    inbox_.pop_front();
+    peer_->RTSPDataReceived(data);
+    return true;
+  }
+
+  void SendRTSPData(const std::string& data) override {
+    if (data.find("CSeq: ") != data.rfind("CSeq: "))
+      ++coalesced_sends;
+    remote_->inbox_.push_back(data);
+  }
+  std::string GetLocalIPAddress() const override { return "127.0.0.1"; }
+  unsigned CreateTimer(int) override { return ++timer_id_; }
+  void ReleaseTimer(unsigned) override {}
+  int GetNextCSeq(int* initial_peer_cseq = nullptr) const override {
+    ++cseq_;
+    if (initial_peer_cseq && cseq_ == *initial_peer_cseq)
+      cseq_ *= 2;
+    return cseq_;
+  }
+
+  // The timer created last, e.g. the reply timeout of the last request.
+  unsigned last_timer() const { return timer_id_; }
+
+  // Sends carrying more than one message.
+  int coalesced_sends;
+
+ private:
+  wds::Peer* peer_;
+  Endpoint* remote_;
+  std::deque<std::string> inbox_;
+  mutable int cseq_;
+  unsigned timer_id_;
+};
+
+class TimelineObserver : public wds::Peer::Observer {
+ public:
+  TimelineObserver() : errors(0) {}
+
+  void ErrorOccurred(wds::ErrorType) override { ++errors; }
+  void TimelineEventOccurred(const wds::TimelineEvent& event) override {
+    events.push_back(event);
+  }
+
+  // Whether the source replied to M7 only after the Play() call returned.
+  bool PlayedBeforeM7Reply() const {
+    bool played = false;
+    for (const wds::TimelineEvent& event : events) {
+      if (event.type == wds::TimelineEvent::MediaCallReturned &&
+          std::string(event.media_call) == "Play")
+        played = true;
+      if (event.type == wds::TimelineEvent::ReplySent && event.message == 7)
+        return played;
+    }
+    return false;
+  }
+
+  // Whether the media stream was prerolled before M7 was received.
+  bool PrerolledBeforeM7() const {
+    bool prerolled = false;
+    for (const wds::TimelineEvent& event : events) {
+      if (event.type == wds::TimelineEvent::MediaCallReturned &&
+          std::string(event.media_call) == "PrerollMedia")
+        prerolled = true;
+      if (event.type == wds::TimelineEvent::RequestReceived &&
+          event.message == 7)
+        return prerolled;
+    }
+    return false;
+  }
+
+  std::vector<wds::TimelineEvent> events;
+  int errors;
+};
+
+struct Session {
+  Session()
+    : source(wds::Source::Create(&source_endpoint, &source_manager,
+                                 &source_observer)),
+      sink(wds::Sink::Create(&sink_endpoint, &sink_manager)),
+      thread(std::this_thread::get_id()),
+      log_messages(0),
+      misrouted_log_messages(0) {
+    source_endpoint.Connect(source.get(), &sink_endpoint);
+    sink_endpoint.Connect(sink.get(), &source_endpoint);
+    source->SetLogHandler(&Session::Log, this);
+    sink->SetLogHandler(&Session::Log, this);
+  }
+
+  void Pump() {
+    while (source_endpoint.Deliver() || sink_endpoint.Deliver())
+      ;
+  }
+
+  static void Log(void* user_data, wds::LogLevel, const char*, va_list) {
+    Session* session = static_cast<Session*>(user_data);
+    session->log_messages++;
+    if (session->thread != std::this_thread::get_id())
+      session->misrouted_log_messages++;
+  }
+
+  Endpoint source_endpoint;
+  Endpoint sink_endpoint;
+  TimelineObserver source_observer;
+  TestSourceMediaManager source_manager;
+  TestSinkMediaManager sink_manager;
+  std::unique_ptr<wds::Source> source;
+  std::unique_ptr<wds::Sink> sink;
+  std::thread::id thread;
+  int log_messages;
+  int misrouted_log_messages;
+};
+
+#endif  // LIBWDS_RTSP_TESTS_SESSION_FIXTURE_H_
@@ -0,0 +1,122 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+// Runs complete source/sink sessions on several threads at once, each
+// peer logging through its own handler. Build with -DWDS_TSAN=ON to have
+// ThreadSanitizer check that peers share no unsynchronized state, and that
+// the log ring buffer keeps the messages of all the threads. The behaviour
+// of the sessions is checked by session-tests.cpp.
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "session-fixture.h"
+
+namespace {
+
+const int kThreads = 8;
+const int kSessionsPerThread = 50;
+
+std::atomic<int> global_log_messages(0);
+
+void GlobalLog(const char*, ...) {
+  ++global_log_messages;
+}
+
+int ring_buffer_messages = 0;
+
+void CountRingBufferMessage(void*, wds::LogLevel, const char* message) {
+  if (std::string(message).find("NOT RTSP") != std::string::npos)
+    ++ring_buffer_messages;
+}
+
+bool RunSession() {
+  Session session;
+  session.source->Start();
+  session.sink->Start();
+  session.Pump();
+  if (session.source_manager.play_count != 1)
+    return false;
+
+  if (!session.sink->Pause())
+    return false;
+  session.Pump();
+  if (!session.sink->Play())
+    return false;
+  session.Pump();
+  if (!session.sink->Teardown())
+    return false;
+  session.Pump();
+  if (session.source_manager.teardown_count != 1)
+    return false;
+
+  // A parse error is logged through the session handler.
+  session.source->RTSPDataReceived("NOT RTSP\r\n\r\n");
+  return session.log_messages > 0 && session.misrouted_log_messages == 0;
+}
+
+void RunSessions(std::atomic<int>* failures) {
+  for (int i = 0; i < kSessionsPerThread; ++i) {
+    if (!RunSession())
+      ++*failures;
+  }
+}
+
+}  // namespace
+
+int main(const int argc, const char **argv)
+{
+  wds::LogSystem::set_log_func(&GlobalLog);
+  wds::LogSystem::set_vlog_func(&GlobalLog);
+  wds::LogSystem::set_warning_func(&GlobalLog);
+  wds::LogSystem::set_error_func(&GlobalLog);
+  wds::LogSystem::set_ring_buffer(64 * 1024);
+
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i)
+    threads.emplace_back(RunSessions, &failures);
+  for (auto& thread : threads)
+    thread.join();
+
+  if (failures > 0) {
+    std::cout << "Failed " << failures << " out of "
+              << kThreads * kSessionsPerThread << " sessions" << std::endl;
+    return 1;
+  }
+  if (global_log_messages > 0) {
+    std::cout << global_log_messages
+              << " messages bypassed the session log handlers" << std::endl;
+    return 1;
+  }
+  wds::LogSystem::dump_ring_buffer(&CountRingBufferMessage, nullptr);
+  if (ring_buffer_messages == 0) {
+    std::cout << "The parse errors are missing from the log ring buffer"
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,307 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+// Runs source/sink sessions over an in-memory transport and checks how
+// the state machines drive the media managers.
+
+#include <iostream>
+#include <list>
+#include <string>
+
+#include "session-fixture.h"
+
+typedef bool (*TestFunc)(void);
+
+#define ASSERT_EQUAL(value, expected) \
+  if ((value) != (expected)) { \
+    std::cout << __func__ << " (" << __FILE__ << ":" << __LINE__ << "): " \
+              << #value << ": " \
+              << "expected '" << (expected) \
+              << "', got '" << (value) << "'" \
+              << std::endl; \
+    return 0; \
+  }
+
+#define ASSERT(assertion) \
+  if (!(assertion)) { \
+    std::cout << __func__ << " (" << __FILE__ << ":" << __LINE__ << "): " \
+              << "assertion failed: " << #assertion \
+              << std::endl; \
+    return 0; \
+  }
+
+static bool test_session ()
+{
+  Session session;
+  session.source->Start();
+  session.sink->Start();
+  session.Pump();
+  ASSERT_EQUAL(session.source_manager.play_count, 1);
+  ASSERT(!session.source_observer.events.empty());
+  ASSERT_EQUAL(session.source_observer.events.front().type,
+               wds::TimelineEvent::SessionStarted);
+  // The sink answers M1 and sends M2 in one go.
+  ASSERT(session.sink_endpoint.coalesced_sends > 0);
+  ASSERT(session.source_observer.PlayedBeforeM7Reply());
+  ASSERT(session.source_observer.PrerolledBeforeM7());
+
+  ASSERT(session.sink->Pause());
+  session.Pump();
+  ASSERT(session.source_manager.IsPaused());
+
+  ASSERT(session.sink->Play());
+  session.Pump();
+  ASSERT_EQUAL(session.source_manager.play_count, 2);
+
+  ASSERT(session.sink->Teardown());
+  session.Pump();
+  ASSERT_EQUAL(session.source_manager.teardown_count, 1);
+
+  // Both PLAY requests (M7) are counted.
+  wds::PeerStats stats = session.source->GetStats();
+  ASSERT_EQUAL(stats.requests_received[7], 2u);
+  ASSERT_EQUAL(stats.replies_sent[7], 2u);
+  ASSERT(stats.round_trip_time.count > 0);
+  ASSERT(stats.bytes_received > 0);
+  ASSERT(stats.bytes_sent > 0);
+  ASSERT_EQUAL(stats.parse_errors, 0u);
+
+  session.source->RTSPDataReceived("NOT RTSP\r\n\r\n");
+  ASSERT_EQUAL(session.source->GetStats().parse_errors, 1u);
+  return true;
+}
+
+static bool test_async_play_session ()
+{
+  Session session;
+  session.source_manager.async_play = true;
+  session.source->Start();
+  session.sink->Start();
+  session.Pump();
+  // M7 is not answered while the media manager is busy with it.
+  ASSERT(session.source_manager.pending_play);
+  ASSERT(!session.sink->Pause());
+
+  session.source_manager.CompletePlay();
+  session.Pump();
+  ASSERT(session.sink->Pause());
+  session.Pump();
+
+  // A completion arriving after the source has been reset is dropped.
+  ASSERT(session.sink->Play());
+  session.Pump();
+  session.source->Reset();
+  session.source_manager.CompletePlay();
+  ASSERT(!session.sink_endpoint.Deliver());
+  return true;
+}
+
+// A sink reconnecting with the same capabilities reuses the cached formats.
+static bool test_cached_session ()
+{
+  wds::CapabilityCache cache;
+  for (int i = 0; i < 2; ++i) {
+    Session session;
+    session.source->SetCapabilityCache(&cache, "sink");
+    session.source->Start();
+    session.sink->Start();
+    session.Pump();
+    ASSERT_EQUAL(session.source_manager.play_count, 1);
+    ASSERT_EQUAL(session.source_manager.prepare_count, i);
+    ASSERT_EQUAL(session.source_manager.format_selections, 1 - i);
+  }
+  return true;
+}
+
+// The source falls back to the next best format rejected by the sink in M4.
+static bool test_video_format_fallback_session ()
+{
+  wds::CapabilityCache cache;
+  Session session;
+  session.source->SetCapabilityCache(&cache, "sink");
+  session.sink_manager.reject_vga = true;
+  session.source->Start();
+  session.sink->Start();
+  session.Pump();
+  ASSERT_EQUAL(session.source_manager.play_count, 1);
+  ASSERT_EQUAL(session.source_manager.format_selections, 2);
+  // Prerolled once, for the format the sink accepted.
+  ASSERT_EQUAL(session.source_manager.preroll_count, 1);
+  ASSERT_EQUAL(session.sink_manager.format().rate_resolution,
+               wds::CEA1280x720p30);
+
+  // The accepted format is cached instead of the rejected one.
+  wds::NegotiatedFormats formats;
+  ASSERT(cache.Lookup("sink", &formats));
+  ASSERT_EQUAL(formats.video_format.rate_resolution, wds::CEA1280x720p30);
+
+  Session reconnected;
+  reconnected.source->SetCapabilityCache(&cache, "sink");
+  reconnected.sink_manager.reject_vga = true;
+  reconnected.source->Start();
+  reconnected.sink->Start();
+  reconnected.Pump();
+  ASSERT_EQUAL(reconnected.source_manager.play_count, 1);
+  ASSERT_EQUAL(reconnected.source_manager.format_selections, 0);
+  ASSERT_EQUAL(reconnected.sink_manager.format().rate_resolution,
+               wds::CEA1280x720p30);
+  return true;
+}
+
+// The source switches the video format while streaming.
+static bool test_video_format_change_session ()
+{
+  Session session;
+  wds::H264VideoFormat hd(wds::CBP, wds::k3_1, wds::CEA1280x720p30);
+  ASSERT(!session.source->ChangeVideoFormat(hd));
+  session.source->Start();
+  session.sink->Start();
+  session.Pump();
+
+  // One change at a time.
+  ASSERT(session.source->ChangeVideoFormat(hd));
+  ASSERT(!session.source->ChangeVideoFormat(hd));
+  session.Pump();
+  ASSERT_EQUAL(session.sink_manager.format().rate_resolution,
+               wds::CEA1280x720p30);
+  ASSERT_EQUAL(session.sink_manager.format_change_pts, 90000u);
+  ASSERT_EQUAL(session.source_manager.GetOptimalVideoFormat().rate_resolution,
+               wds::CEA1280x720p30);
+
+  // A rejected change keeps the session streaming in the current format.
+  session.sink_manager.reject_vga = true;
+  wds::H264VideoFormat vga(wds::CBP, wds::k3_1, wds::CEA640x480p60);
+  ASSERT(session.source->ChangeVideoFormat(vga));
+  session.Pump();
+  ASSERT_EQUAL(session.source_manager.cancelled_format_changes, 1);
+  ASSERT_EQUAL(session.source_manager.GetOptimalVideoFormat().rate_resolution,
+               wds::CEA1280x720p30);
+
+  // So does a change the sink does not reply to, without failing the
+  // session, and its late reply is dropped.
+  ASSERT(session.source->ChangeVideoFormat(vga));
+  session.source->OnTimerEvent(session.source_endpoint.last_timer());
+  ASSERT_EQUAL(session.source_manager.cancelled_format_changes, 2);
+  ASSERT_EQUAL(session.source->GetStats().timeouts, 1u);
+  session.Pump();
+  ASSERT_EQUAL(session.source_observer.errors, 0);
+  ASSERT_EQUAL(session.source_manager.GetOptimalVideoFormat().rate_resolution,
+               wds::CEA1280x720p30);
+  ASSERT(session.source->ChangeVideoFormat(hd));
+  session.Pump();
+  ASSERT_EQUAL(session.source_observer.errors, 0);
+  ASSERT_EQUAL(session.source_manager.GetOptimalVideoFormat().rate_resolution,
+               wds::CEA1280x720p30);
+  return true;
+}
+
+// H.265 is streamed when both peers support it, the source falls back
+// to H.264 when the sink rejects it in M4.
+static bool test_h265_session ()
+{
+  for (bool reject : {false, true}) {
+    Session session;
+    session.source_manager.h265 = true;
+    session.sink_manager.h265 = true;
+    session.sink_manager.reject_h265 = reject;
+    session.source->Start();
+    session.sink->Start();
+    session.Pump();
+    ASSERT_EQUAL(session.source_manager.play_count, 1);
+    ASSERT_EQUAL(session.sink_manager.h265_formats_set, 1);
+    ASSERT_EQUAL(session.source_manager.format_selections, reject ? 2 : 1);
+    // The stream cannot switch from H.265 to an H.264 format.
+    wds::H264VideoFormat hd(wds::CBP, wds::k3_1, wds::CEA1280x720p30);
+    ASSERT_EQUAL(session.source->ChangeVideoFormat(hd), reject);
+  }
+
+  // A sink without H.265 answers 'none'.
+  Session session;
+  session.source_manager.h265 = true;
+  session.source->Start();
+  session.sink->Start();
+  session.Pump();
+  ASSERT_EQUAL(session.source_manager.play_count, 1);
+  ASSERT_EQUAL(session.sink_manager.h265_formats_set, 0);
+  return true;
+}
+
+// The sink gets the reply to its IDR request (M13) right away, the time
+// until the picture is sent is measured.
+static bool test_idr_session ()
+{
+  Session session;
+  ASSERT(!session.sink->RequestIDR());
+  session.source->Start();
+  session.sink->Start();
+  session.Pump();
+  for (bool sent : {true, false}) {
+    // One request at a time.
+    ASSERT(session.sink->RequestIDR());
+    ASSERT(!session.sink->RequestIDR());
+    session.Pump();
+    ASSERT(session.source_manager.pending_idr);
+    wds::PeerStats stats = session.source->GetStats();
+    ASSERT_EQUAL(stats.replies_sent[13], sent ? 1u : 2u);
+    ASSERT_EQUAL(stats.idr_latency.count, sent ? 0u : 1u);
+    session.source_manager.pending_idr->Complete(sent);
+    session.source_manager.pending_idr.reset();
+    // A picture that could not be produced is not measured.
+    ASSERT_EQUAL(session.source->GetStats().idr_latency.count, 1u);
+  }
+
+  // The source may be gone by the time the picture is sent.
+  ASSERT(session.sink->RequestIDR());
+  session.Pump();
+  session.source.reset();
+  session.source_manager.pending_idr->Complete(true);
+  return true;
+}
+
+int main(const int argc, const char **argv)
+{
+  std::list<TestFunc> tests;
+  int failures = 0;
+
+  tests.push_back(test_session);
+  tests.push_back(test_async_play_session);
+  tests.push_back(test_cached_session);
+  tests.push_back(test_video_format_fallback_session);
+  tests.push_back(test_video_format_change_session);
+  tests.push_back(test_h265_session);
+  tests.push_back(test_idr_session);
+
+  // Run tests
+  for (std::list<TestFunc>::iterator it=tests.begin(); it!=tests.end(); ++it) {
+    TestFunc test = *it;
+    if (!test())
+      failures++;
+  }
+
+  if (failures > 0) {
+    std::cout << std::endl << "Failed " << failures
+              << " out of " << tests.size() << " tests" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Passed all " << tests.size() << " tests" << std::endl;
+  return 0;
+}
@@ -41,6 +41,10 @@
 #include "libwds/rtsp/triggermethod.h"
 #include "libwds/rtsp/uibcsetting.h"
 #include "libwds/rtsp/videoformats.h"
+#include "libwds/public/audio_codec.h"
+#include "libwds/public/logging.h"
+#include "libwds/public/timeline.h"
+#include "libwds/public/video_format.h"
 
 using wds::rtsp::Driver;
 
@@ -503,6 +507,12 @@ static bool test_valid_get_parameter_reply ()
   ASSERT_EQUAL(video_formats->GetNativeFormat().rate_resolution, 8);
   ASSERT_EQUAL(video_formats->GetNativeFormat().type, 0);
   ASSERT_EQUAL(video_formats->GetH264Formats().size(), 96);
+  const wds::H264CodecParameters& params =
+      video_formats->GetH264VideoCodecs()[1].params;
+  ASSERT_EQUAL(params.frame_rate_control_support, 0x11);
+  ASSERT_EQUAL(params.max_hres, 0x400);
+  ASSERT_EQUAL(params.max_vres, 0x300);
+  ASSERT_EQUAL(video_formats->GetH264Formats()[0].params.max_hres, 0x400);
 
   ASSERT_NO_EXCEPTION (prop =
       payload->GetProperty(wds::rtsp::Video3DFormatsPropertyType));
@@ -951,6 +961,551 @@ static bool test_number_conversion_in_errors ()
   return true;
 }
 
+struct VideoMode {
+  wds::ResolutionType type;
+  wds::RateAndResolution rate_resolution;
+};
+
+static std::vector<VideoMode> all_video_modes ()
+{
+  std::vector<VideoMode> modes;
+  for (unsigned rr = wds::CEA640x480p60; rr <= wds::CEA1920x1080p24; ++rr)
+    modes.push_back({wds::CEA, rr});
+  for (unsigned rr = wds::VESA800x600p30; rr <= wds::VESA1920x1200p30; ++rr)
+    modes.push_back({wds::VESA, rr});
+  for (unsigned rr = wds::HH800x480p30; rr <= wds::HH848x480p60; ++rr)
+    modes.push_back({wds::HH, rr});
+  return modes;
+}
+
+static wds::H264VideoCodec video_codec (wds::H264Profile profile,
+                                        wds::H264Level level)
+{
+  return wds::H264VideoCodec(profile, level, wds::RateAndResolutionsBitmap(),
+                             wds::RateAndResolutionsBitmap(),
+                             wds::RateAndResolutionsBitmap());
+}
+
+static void add_video_mode (wds::H264VideoCodec& codec, const VideoMode& mode)
+{
+  if (mode.type == wds::CEA)
+    codec.cea_rr.set(mode.rate_resolution);
+  else if (mode.type == wds::VESA)
+    codec.vesa_rr.set(mode.rate_resolution);
+  else
+    codec.hh_rr.set(mode.rate_resolution);
+}
+
+static unsigned legacy_weight (const wds::H264VideoFormat& format)
+{
+  wds::VideoModeInfo info = wds::GetVideoModeInfo(format);
+  return info.width * info.height * info.frame_rate * (info.interlaced ? 1 : 2);
+}
+
+static bool legacy_format_less (const wds::H264VideoFormat& a,
+                                const wds::H264VideoFormat& b)
+{
+  if (legacy_weight(a) != legacy_weight(b))
+    return legacy_weight(a) < legacy_weight(b);
+  if (a.profile != b.profile)
+    return a.profile < b.profile;
+  if (a.level != b.level)
+    return a.level < b.level;
+  // The order of the formats of the same weight, profile and level
+  // used to be left to std::sort.
+  if (a.type != b.type)
+    return a.type < b.type;
+  return a.rate_resolution < b.rate_resolution;
+}
+
+// FindOptimalVideoFormat() as it was before the mode tables: the sorted
+// lists of all the local and remote formats are matched by resolution.
+static wds::H264VideoFormat legacy_find_optimal_video_format (
+    const std::vector<wds::H264VideoCodec>& local_codecs,
+    const std::vector<wds::H264VideoCodec>& remote_codecs,
+    bool* success)
+{
+  std::vector<wds::H264VideoFormat> local_formats, remote_formats;
+  for (const auto& codec : local_codecs)
+    wds::PopulateVideoFormatList(codec, local_formats);
+  for (const auto& codec : remote_codecs)
+    wds::PopulateVideoFormatList(codec, remote_formats);
+  std::sort(local_formats.begin(), local_formats.end(), legacy_format_less);
+  std::sort(remote_formats.begin(), remote_formats.end(), legacy_format_less);
+
+  for (const auto& local : local_formats) {
+    auto match = std::find_if(remote_formats.begin(), remote_formats.end(),
+        [&local] (const wds::H264VideoFormat& format) {
+          wds::VideoModeInfo a = wds::GetVideoModeInfo(local);
+          wds::VideoModeInfo b = wds::GetVideoModeInfo(format);
+          return local.type == format.type &&
+                 a.width == b.width && a.height == b.height;
+        });
+    if (match == remote_formats.end())
+      continue;
+
+    wds::H264VideoFormat format = *match;
+    if (format.profile > local.profile)
+      format.profile = local.profile;
+    if (format.level > local.level)
+      format.level = local.level;
+    *success = true;
+    return format;
+  }
+  *success = false;
+  return wds::H264VideoFormat();
+}
+
+static bool check_optimal_video_format (
+    const std::vector<wds::H264VideoCodec>& local_codecs,
+    const std::vector<wds::H264VideoCodec>& remote_codecs)
+{
+  bool expected_success = false;
+  wds::H264VideoFormat expected = legacy_find_optimal_video_format(
+      local_codecs, remote_codecs, &expected_success);
+  bool success = false;
+  wds::H264VideoFormat format = wds::FindOptimalVideoFormat(
+      wds::NativeVideoFormat(), local_codecs, remote_codecs, &success);
+
+  ASSERT_EQUAL(success, expected_success);
+  ASSERT_EQUAL(format.profile, expected.profile);
+  ASSERT_EQUAL(format.level, expected.level);
+  ASSERT_EQUAL(format.type, expected.type);
+  ASSERT_EQUAL(format.rate_resolution, expected.rate_resolution);
+
+  return true;
+}
+
+static void ignore_log (const char*, ...)
+{
+}
+
+static bool test_video_mode_info ()
+{
+  wds::VideoModeInfo info = wds::GetVideoModeInfo(wds::CEA, wds::CEA1920x1080i60);
+  ASSERT_EQUAL(info.width, 1920);
+  ASSERT_EQUAL(info.height, 1080);
+  ASSERT_EQUAL(info.frame_rate, 60);
+  ASSERT(info.interlaced);
+
+  info = wds::GetVideoModeInfo(
+      wds::H264VideoFormat(wds::CBP, wds::k3_1, wds::HH848x480p30));
+  ASSERT_EQUAL(info.width, 848);
+  ASSERT_EQUAL(info.height, 480);
+  ASSERT_EQUAL(info.frame_rate, 30);
+  ASSERT(!info.interlaced);
+
+  info = wds::GetVideoModeInfo(wds::VESA, wds::VESA1920x1200p30 + 1);
+  ASSERT_EQUAL(info.width, 0);
+  ASSERT_EQUAL(info.frame_rate, 0);
+
+  return true;
+}
+
+// Every pair of single local and remote modes, and every pair of modes on
+// one side against every single mode on the other.
+static bool test_optimal_video_format_matches_legacy ()
+{
+  const std::vector<VideoMode> modes = all_video_modes();
+  const std::pair<wds::H264Profile, wds::H264Level> profiles[] = {
+    {wds::CBP, wds::k3_1}, {wds::CHP, wds::k3_2}, {wds::CBP, wds::k4_2}
+  };
+  wds::LogSystem::LogFunction error_func = wds::LogSystem::error_func();
+  wds::LogSystem::set_error_func(&ignore_log);
+
+  bool result = true;
+  for (const VideoMode& a : modes) {
+    for (const VideoMode& b : modes) {
+      for (const auto& local_profile : profiles) {
+        for (const auto& remote_profile : profiles) {
+          wds::H264VideoCodec local =
+              video_codec(local_profile.first, local_profile.second);
+          wds::H264VideoCodec remote =
+              video_codec(remote_profile.first, remote_profile.second);
+          add_video_mode(local, a);
+          add_video_mode(remote, b);
+          result = result && check_optimal_video_format({local}, {remote});
+        }
+      }
+
+      wds::H264VideoCodec first = video_codec(wds::CHP, wds::k3_1);
+      wds::H264VideoCodec second = video_codec(wds::CBP, wds::k4);
+      add_video_mode(first, a);
+      add_video_mode(second, b);
+      for (const VideoMode& c : modes) {
+        wds::H264VideoCodec single = video_codec(wds::CHP, wds::k4_2);
+        add_video_mode(single, c);
+        result = result &&
+                 check_optimal_video_format({first, second}, {single}) &&
+                 check_optimal_video_format({single}, {first, second});
+      }
+    }
+  }
+
+  wds::LogSystem::set_error_func(error_func);
+  return result;
+}
+
+// Random sets of codecs with several modes each.
+static bool test_optimal_video_format_matches_legacy_random ()
+{
+  const std::vector<VideoMode> modes = all_video_modes();
+  unsigned seed = 1;
+  auto random = [&seed] (unsigned range) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % range;
+  };
+  auto random_codecs = [&] () {
+    std::vector<wds::H264VideoCodec> codecs;
+    for (unsigned i = random(3); i < 3; ++i) {
+      wds::H264VideoCodec codec = video_codec(
+          static_cast<wds::H264Profile>(random(wds::CHP + 1)),
+          static_cast<wds::H264Level>(random(wds::k4_2 + 1)));
+      for (const VideoMode& mode : modes)
+        if (random(8) == 0)
+          add_video_mode(codec, mode);
+      codecs.push_back(codec);
+    }
+    return codecs;
+  };
+  wds::LogSystem::LogFunction error_func = wds::LogSystem::error_func();
+  wds::LogSystem::set_error_func(&ignore_log);
+
+  bool result = true;
+  for (int i = 0; i < 20000 && result; ++i)
+    result = check_optimal_video_format(random_codecs(), random_codecs());
+
+  wds::LogSystem::set_error_func(error_func);
+  return result;
+}
+
+static bool test_video_format_range ()
+{
+  const std::vector<VideoMode> modes = all_video_modes();
+  wds::H264VideoCodec codec = video_codec(wds::CHP, wds::k4);
+  for (const VideoMode& mode : modes)
+    add_video_mode(codec, mode);
+  // Bits past the last mode of a type are not formats.
+  codec.cea_rr.set(31);
+  codec.hh_rr.set(20);
+
+  wds::H264VideoFormatRange range(codec);
+  ASSERT_EQUAL(range.size(), modes.size());
+  size_t i = 0;
+  for (const wds::H264VideoFormat& format : range) {
+    ASSERT(i < modes.size());
+    ASSERT_EQUAL(format.profile, wds::CHP);
+    ASSERT_EQUAL(format.level, wds::k4);
+    ASSERT_EQUAL(format.type, modes[i].type);
+    ASSERT_EQUAL(format.rate_resolution, modes[i].rate_resolution);
+    ++i;
+  }
+  ASSERT_EQUAL(i, modes.size());
+
+  wds::H264VideoFormatRange empty(video_codec(wds::CBP, wds::k3_1));
+  ASSERT(empty.empty());
+  ASSERT(empty.begin() == empty.end());
+
+  wds::rtsp::H264Codec rtsp_codec(
+      wds::H264VideoFormat(wds::CBP, wds::k3_2, wds::VESA1280x800p60));
+  wds::H264VideoFormatRange formats = rtsp_codec.formats();
+  ASSERT_EQUAL(formats.size(), 1);
+  ASSERT_EQUAL(formats.begin()->type, wds::VESA);
+  ASSERT_EQUAL(formats.begin()->rate_resolution, wds::VESA1280x800p60);
+  ASSERT_EQUAL(formats.begin()->level, wds::k3_2);
+
+  return true;
+}
+
+static bool test_h264_codec_parameters ()
+{
+  wds::H264VideoCodec remote = video_codec(wds::CHP, wds::k4_1);
+  add_video_mode(remote, {wds::CEA, wds::CEA1280x720p60});
+  remote.params.latency = 2;
+  remote.params.min_slice_size = 0x10;
+  remote.params.slice_enc_params = 0xc01;
+  remote.params.frame_rate_control_support = 0x11;
+  remote.params.max_hres = 0x500;
+  remote.params.max_vres = 0x2d0;
+
+  wds::rtsp::H264Codec rtsp_codec(remote);
+  ASSERT_EQUAL(rtsp_codec.ToString(),
+      "02 08 00000040 00000000 00000000 02 0010 0C01 11 0500 02D0");
+  wds::H264VideoCodec codec = rtsp_codec.ToH264VideoCodec();
+  ASSERT_EQUAL(codec.params.latency, 2);
+  ASSERT_EQUAL(codec.params.min_slice_size, 0x10);
+  ASSERT_EQUAL(codec.params.slice_enc_params, 0xc01);
+  ASSERT_EQUAL(codec.params.frame_rate_control_support, 0x11);
+  ASSERT_EQUAL(codec.params.max_hres, 0x500);
+  ASSERT_EQUAL(codec.params.max_vres, 0x2d0);
+  ASSERT_EQUAL(rtsp_codec.formats().begin()->params.min_slice_size, 0x10);
+
+  // The selected format carries the parameters of the remote codec.
+  wds::H264VideoCodec local = video_codec(wds::CHP, wds::k4_2);
+  add_video_mode(local, {wds::CEA, wds::CEA640x480p60});
+  add_video_mode(local, {wds::CEA, wds::CEA1280x720p60});
+  add_video_mode(remote, {wds::CEA, wds::CEA640x480p60});
+  wds::NativeVideoFormat native(wds::CEA1280x720p60);
+  wds::H264VideoFormat format = wds::SelectVideoFormat(
+      native, {local}, {remote}, wds::VideoFormatCostModel());
+  ASSERT_EQUAL(format.params.slice_enc_params, 0xc01);
+  format = wds::FindOptimalVideoFormat(native, {local}, {remote});
+  ASSERT_EQUAL(format.params.latency, 2);
+  ASSERT_EQUAL(wds::rtsp::H264Codec(format).ToString(),
+      "02 08 00000001 00000000 00000000 02 0010 0C01 11 0500 02D0");
+
+  return true;
+}
+
+static bool test_find_optimal_audio_format ()
+{
+  std::vector<wds::AudioCodec> local;
+  local.push_back(wds::AudioCodec(wds::LPCM, wds::AudioModes(3), 0));
+  local.push_back(wds::AudioCodec(wds::AAC,
+      wds::AudioModes().set(wds::AAC_48K_16B_2CH), 0));
+  std::vector<wds::AudioCodec> remote;
+  remote.push_back(wds::AudioCodec(wds::LPCM,
+      wds::AudioModes().set(wds::LPCM_48K_16B_2CH), 0));
+  remote.push_back(wds::AudioCodec(wds::AAC, wds::AudioModes(15), 2));
+
+  // LPCM is passed through when the link can carry it.
+  wds::AudioCostModel cost_model;
+  bool success = false;
+  wds::AudioCodec codec = wds::FindOptimalAudioFormat(
+      local, remote, cost_model, &success);
+  ASSERT(success);
+  ASSERT_EQUAL(codec.format, wds::LPCM);
+  ASSERT_EQUAL(codec.modes, wds::AudioModes().set(wds::LPCM_48K_16B_2CH));
+
+  // 1536 kbps of LPCM do not fit, AAC is encoded instead.
+  cost_model.link_kbps = 1000;
+  codec = wds::FindOptimalAudioFormat(local, remote, cost_model);
+  ASSERT_EQUAL(codec.format, wds::AAC);
+  ASSERT_EQUAL(codec.modes, wds::AudioModes().set(wds::AAC_48K_16B_2CH));
+  ASSERT_EQUAL(codec.latency, 2u);
+
+  // When nothing fits the lowest bitrate is used.
+  cost_model.link_kbps = 100;
+  codec = wds::FindOptimalAudioFormat(local, remote, cost_model, &success);
+  ASSERT(success);
+  ASSERT_EQUAL(codec.format, wds::AAC);
+
+  // More channels are preferred up to the limit, then the cheapest codec.
+  local.push_back(wds::AudioCodec(wds::AC3, wds::AudioModes(7), 0));
+  remote.push_back(wds::AudioCodec(wds::AC3, wds::AudioModes(7), 0));
+  local[1].modes = wds::AudioModes(15);
+  cost_model.link_kbps = 0;
+  cost_model.max_channels = 0;
+  codec = wds::FindOptimalAudioFormat(local, remote, cost_model);
+  ASSERT_EQUAL(codec.format, wds::AAC);
+  ASSERT_EQUAL(codec.modes, wds::AudioModes().set(wds::AAC_48K_16B_8CH));
+  cost_model.max_channels = 6;
+  codec = wds::FindOptimalAudioFormat(local, remote, cost_model);
+  ASSERT_EQUAL(codec.format, wds::AC3);
+  ASSERT_EQUAL(codec.modes, wds::AudioModes().set(wds::AC3_48K_16B_6CH));
+
+  std::vector<wds::AudioCodec> lpcm_only(1, local[0]);
+  std::vector<wds::AudioCodec> ac3_only(1, local[2]);
+  wds::FindOptimalAudioFormat(lpcm_only, ac3_only, cost_model, &success);
+  ASSERT(!success);
+
+  return true;
+}
+
+static bool test_select_video_format ()
+{
+  wds::H264VideoCodec local = video_codec(wds::CHP, wds::k4_2);
+  for (const VideoMode& mode : all_video_modes())
+    add_video_mode(local, mode);
+  wds::H264VideoCodec remote = video_codec(wds::CHP, wds::k4_1);
+  add_video_mode(remote, {wds::CEA, wds::CEA640x480p60});
+  add_video_mode(remote, {wds::CEA, wds::CEA1280x720p60});
+  add_video_mode(remote, {wds::CEA, wds::CEA1920x1080p60});
+  wds::NativeVideoFormat native(wds::CEA1280x720p60);
+
+  // Without limits the best format both sides support is picked.
+  wds::VideoFormatCostModel cost_model;
+  cost_model.prefer_native = false;
+  bool success = false;
+  wds::H264VideoFormat format = wds::SelectVideoFormat(
+      native, {local}, {remote}, cost_model, &success);
+  ASSERT(success);
+  ASSERT_EQUAL(format.rate_resolution, wds::CEA1920x1080p60);
+  ASSERT_EQUAL(format.profile, wds::CHP);
+  ASSERT_EQUAL(format.level, wds::k4_1);
+
+  cost_model.prefer_native = true;
+  format = wds::SelectVideoFormat(native, {local}, {remote}, cost_model);
+  ASSERT_EQUAL(format.rate_resolution, wds::CEA1280x720p60);
+  cost_model.prefer_native = false;
+
+  // 1080p60 needs about 12 Mbps.
+  cost_model.link_mbps = 10;
+  format = wds::SelectVideoFormat(native, {local}, {remote}, cost_model);
+  ASSERT_EQUAL(format.rate_resolution, wds::CEA1280x720p60);
+
+  cost_model.link_mbps = 0;
+  cost_model.encoder_fps = [] (unsigned width, unsigned height) {
+    return width * height > 1280 * 720 ? 30u : 60u;
+  };
+  format = wds::SelectVideoFormat(native, {local}, {remote}, cost_model);
+  ASSERT_EQUAL(format.rate_resolution, wds::CEA1280x720p60);
+
+  // When nothing can be sustained the lowest format is used.
+  cost_model.link_mbps = 1;
+  format = wds::SelectVideoFormat(
+      native, {local}, {remote}, cost_model, &success);
+  ASSERT(success);
+  ASSERT_EQUAL(format.rate_resolution, wds::CEA640x480p60);
+
+  return true;
+}
+
+static bool test_h265_video_formats ()
+{
+  std::string header("RTSP/1.0 200 OK\r\n"
+                     "CSeq: 2\r\n"
+                     "Content-Type: text/parameters\r\n"
+                     "Content-Length: 86\r\n\r\n");
+  std::unique_ptr<wds::rtsp::Message> message;
+  Driver::Parse(header, message);
+  ASSERT(message != NULL);
+  ASSERT(message->is_reply());
+
+  std::string payload_buffer("wfd2_video_formats: 30 00 01 10 00000040 00000000 00000000 00 0000 0000 00 none none\r\n");
+  Driver::Parse(payload_buffer, message);
+
+  auto payload = ToPropertyMapPayload(message->payload());
+  ASSERT(payload);
+  std::shared_ptr<wds::rtsp::Property> prop;
+  ASSERT_NO_EXCEPTION (prop =
+      payload->GetProperty(wds::rtsp::H265VideoFormatsPropertyType));
+  ASSERT(!prop->is_none());
+  auto h265_formats = std::static_pointer_cast<wds::rtsp::H265VideoFormats>(prop);
+  ASSERT_EQUAL(h265_formats->GetNativeFormat().rate_resolution,
+               wds::CEA1280x720p60);
+  std::vector<wds::H265VideoCodec> codecs = h265_formats->GetH265VideoCodecs();
+  ASSERT_EQUAL(codecs.size(), 1);
+  ASSERT_EQUAL(codecs[0].profile, wds::H265Main);
+  ASSERT_EQUAL(codecs[0].level, wds::kH265_5_1);
+  ASSERT_EQUAL(codecs[0].cea_rr.to_ulong(), 1 << wds::CEA1280x720p60);
+  auto format = h265_formats->codecs()[0].h265_formats().begin();
+  ASSERT_EQUAL(format->rate_resolution, wds::CEA1280x720p60);
+
+  ASSERT_EQUAL(message->ToString(), header + payload_buffer);
+
+  // The source offers the selected format the same way.
+  wds::rtsp::H265VideoFormats selected(wds::NativeVideoFormat(), false,
+                                       std::vector<wds::H265VideoFormat>{*format});
+  ASSERT_EQUAL(selected.ToString(),
+      "wfd2_video_formats: 00 00 01 10 00000040 00000000 00000000 00 0000 0000 00 none none");
+  ASSERT_EQUAL(wds::rtsp::H265VideoFormats().ToString(), "wfd2_video_formats: none");
+
+  return true;
+}
+
+static bool test_select_video_codec ()
+{
+  wds::H264VideoCodec h264 = video_codec(wds::CHP, wds::k4_2);
+  add_video_mode(h264, {wds::CEA, wds::CEA640x480p60});
+  add_video_mode(h264, {wds::CEA, wds::CEA1280x720p60});
+  add_video_mode(h264, {wds::CEA, wds::CEA1920x1080p60});
+  wds::H265VideoCodec h265(wds::H265Main, wds::kH265_5_1,
+                           h264.cea_rr, h264.vesa_rr, h264.hh_rr);
+  wds::NativeVideoFormat native(wds::CEA1920x1080p60);
+  wds::VideoFormatCostModel cost_model;
+  wds::H264VideoFormat h264_format;
+  wds::H265VideoFormat h265_format;
+
+  // H.265 is preferred when it reaches the same format.
+  ASSERT_EQUAL(wds::SelectVideoCodec(native, {h264}, {h264}, {h265}, {h265},
+                                     cost_model, &h264_format, &h265_format),
+               wds::H265);
+  ASSERT_EQUAL(h265_format.rate_resolution, wds::CEA1920x1080p60);
+  ASSERT_EQUAL(h265_format.profile, wds::H265Main);
+
+  // 1080p60 needs about 12 Mbps in H.264, about 60% of it in H.265.
+  cost_model.link_mbps = 10;
+  cost_model.prefer_native = false;
+  ASSERT_EQUAL(wds::SelectVideoCodec(native, {h264}, {h264}, {h265}, {h265},
+                                     cost_model, &h264_format, &h265_format),
+               wds::H265);
+  ASSERT_EQUAL(h265_format.rate_resolution, wds::CEA1920x1080p60);
+  ASSERT_EQUAL(wds::SelectVideoFormat(native, {h264}, {h264}, cost_model)
+                   .rate_resolution,
+               wds::CEA1280x720p60);
+
+  // A remote device without H.265 gets H.264.
+  ASSERT_EQUAL(wds::SelectVideoCodec(native, {h264}, {h264}, {h265}, {},
+                                     cost_model, &h264_format, &h265_format),
+               wds::H264);
+  ASSERT_EQUAL(h264_format.rate_resolution, wds::CEA1280x720p60);
+
+  // A format selected earlier is checked against the current limits.
+  ASSERT(wds::IsVideoFormatSustainable(h264_format, cost_model));
+  ASSERT(wds::IsVideoFormatSustainable(h265_format, cost_model));
+  h264_format.rate_resolution = wds::CEA1920x1080p60;
+  ASSERT(!wds::IsVideoFormatSustainable(h264_format, cost_model));
+  cost_model.link_mbps = 5;
+  ASSERT(!wds::IsVideoFormatSustainable(h265_format, cost_model));
+
+  return true;
+}
+
+static void collect_ring_buffer_message (void* user_data, wds::LogLevel,
+                                         const char* message)
+{
+  static_cast<std::vector<std::string>*>(user_data)->push_back(message);
+}
+
+static bool test_ring_buffer ()
+{
+  wds::LogSystem::set_ring_buffer(1024);
+  for (int i = 0; i < 100; ++i) {
+    wds::LogArg args[] = {wds::LogArg(i), wds::LogArg("message")};
+    wds::LogSystem::ring_buffer_log(wds::LogLevelInfo, "%d %s", args, 2);
+  }
+
+  std::vector<std::string> messages;
+  wds::LogSystem::dump_ring_buffer(&collect_ring_buffer_message, &messages);
+  wds::LogSystem::set_ring_buffer(0);
+
+  // The oldest messages were dropped, the rest are dumped in order.
+  ASSERT(!messages.empty());
+  ASSERT(messages.size() < 100);
+  ASSERT_EQUAL(messages.back(), "99 message");
+  ASSERT_EQUAL(messages.front(),
+               std::to_string(100 - messages.size()) + " message");
+
+  return true;
+}
+
+static bool test_chrome_trace_setup ()
+{
+  std::vector<wds::TimelineEvent> events;
+  events.push_back({wds::TimelineEvent::SessionStarted, 0, 0, nullptr, 1000});
+  events.push_back({wds::TimelineEvent::RequestSent, 1, 1, nullptr, 2000});
+  events.push_back({wds::TimelineEvent::ReplyReceived, 1, 1, nullptr, 3000});
+  events.push_back(
+      {wds::TimelineEvent::FirstMediaPacket, 0, 0, nullptr, 250000});
+
+  wds::ChromeTraceWriter writer;
+  writer.AddSession("source", events);
+  std::string trace = writer.ToString();
+
+  // The setup span runs from the session start to the first media packet.
+  ASSERT(trace.find("\"name\":\"Setup\"") != std::string::npos);
+  ASSERT(trace.find("\"dur\":249000") != std::string::npos);
+
+  // Without a first media packet there is no setup span.
+  events.pop_back();
+  wds::ChromeTraceWriter incomplete;
+  incomplete.AddSession("source", events);
+  ASSERT(incomplete.ToString().find("\"dur\":249000") == std::string::npos);
+
+  return true;
+}
+
 int main(const int argc, const char **argv)
 {
   std::list<TestFunc> tests;
@@ -979,6 +1534,17 @@ int main(const int argc, const char **argv)
   tests.push_back(test_hex_number_conversion_body);
   tests.push_back(test_hex_number_conversion_body_2);
   tests.push_back(test_number_conversion_in_errors);
+  tests.push_back(test_video_mode_info);
+  tests.push_back(test_optimal_video_format_matches_legacy);
+  tests.push_back(test_optimal_video_format_matches_legacy_random);
+  tests.push_back(test_video_format_range);
+  tests.push_back(test_h264_codec_parameters);
+  tests.push_back(test_select_video_format);
+  tests.push_back(test_find_optimal_audio_format);
+  tests.push_back(test_h265_video_formats);
+  tests.push_back(test_select_video_codec);
+  tests.push_back(test_chrome_trace_setup);
+  tests.push_back(test_ring_buffer);
 
   // Run tests
   for (std::list<TestFunc>::iterator it=tests.begin(); it!=tests.end(); ++it) {
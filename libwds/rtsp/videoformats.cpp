@@ -43,6 +43,8 @@ unsigned int EnumListToMask(const std::vector<EnumType>& from) {
 
 using wds::H264VideoFormat;
 using wds::H264VideoCodec;
+using wds::H265VideoFormat;
+using wds::H265VideoCodec;
 
 H264Codec::H264Codec(unsigned char profile, unsigned char level,
     unsigned int cea_support, unsigned int vesa_support,
@@ -62,36 +64,47 @@ H264Codec::H264Codec(unsigned char profile, unsigned char level,
     max_hres(max_hres),
     max_vres(max_vres) {}
 
-H264Codec::H264Codec(const H264VideoFormat& format)
-  : profile(1 << format.profile),
-    level(1 << format.level),
-    cea_support((format.type == CEA) ? 1 << format.rate_resolution : 0),
-    vesa_support((format.type == VESA) ? 1 << format.rate_resolution : 0),
-    hh_support((format.type == HH) ? 1 << format.rate_resolution : 0),
-    latency(0),
-    min_slice_size(0),
-    slice_enc_params(0),
-    frame_rate_control_support(0),
-    max_hres(0),
-    max_vres(0) {
+namespace {
 
+template <typename Format>
+H264Codec CodecFromFormat(const Format& format) {
+  return H264Codec(1 << format.profile, 1 << format.level,
+                   (format.type == CEA) ? 1 << format.rate_resolution : 0,
+                   (format.type == VESA) ? 1 << format.rate_resolution : 0,
+                   (format.type == HH) ? 1 << format.rate_resolution : 0,
+                   format.params.latency, format.params.min_slice_size,
+                   format.params.slice_enc_params,
+                   format.params.frame_rate_control_support,
+                   format.params.max_hres, format.params.max_vres);
+}
+
+template <typename Codec>
+H264Codec CodecFromVideoCodec(const Codec& codec) {
+  return H264Codec(1 << codec.profile, 1 << codec.level,
+                   codec.cea_rr.to_ulong(), codec.vesa_rr.to_ulong(),
+                   codec.hh_rr.to_ulong(), codec.params.latency,
+                   codec.params.min_slice_size, codec.params.slice_enc_params,
+                   codec.params.frame_rate_control_support,
+                   codec.params.max_hres, codec.params.max_vres);
+}
+
+}  // namespace
+
+H264Codec::H264Codec(const H264VideoFormat& format)
+  : H264Codec(CodecFromFormat(format)) {
 }
 
 H264Codec::H264Codec(const H264VideoCodec& format)
-  : profile(1 << format.profile),
-    level(1 << format.level),
-    cea_support(format.cea_rr.to_ulong()),
-    vesa_support(format.vesa_rr.to_ulong()),
-    hh_support(format.hh_rr.to_ulong()),
-    latency(0),
-    min_slice_size(0),
-    slice_enc_params(0),
-    frame_rate_control_support(0),
-    max_hres(0),
-    max_vres(0) {
+  : H264Codec(CodecFromVideoCodec(format)) {
+}
 
+H264Codec::H264Codec(const H265VideoFormat& format)
+  : H264Codec(CodecFromFormat(format)) {
 }
 
+H264Codec::H264Codec(const H265VideoCodec& format)
+  : H264Codec(CodecFromVideoCodec(format)) {
+}
 
 std::string H264Codec::ToString() const {
   std::string ret;
@@ -186,12 +199,31 @@ H264VideoCodec H264Codec::ToH264VideoCodec() const {
   H264VideoCodec result;
   result.profile = ToH264Profile(profile);
   result.level = ToH264Level(level);
-  result.cea_rr = RateAndResolutionsBitmap(cea_support);
-  result.vesa_rr = RateAndResolutionsBitmap(vesa_support);
-  result.hh_rr = RateAndResolutionsBitmap(hh_support);
+  CopyFormats(&result);
+  return result;
+}
+
+H265VideoCodec H264Codec::ToH265VideoCodec() const {
+  H265VideoCodec result;
+  result.profile = MaskToEnum<H265Profile>(profile, H265Main10);
+  result.level = MaskToEnum<H265Level>(level, kH265_5_1);
+  CopyFormats(&result);
   return result;
 }
 
+template <typename Codec>
+void H264Codec::CopyFormats(Codec* codec) const {
+  codec->cea_rr = RateAndResolutionsBitmap(cea_support);
+  codec->vesa_rr = RateAndResolutionsBitmap(vesa_support);
+  codec->hh_rr = RateAndResolutionsBitmap(hh_support);
+  codec->params.latency = latency;
+  codec->params.min_slice_size = min_slice_size;
+  codec->params.slice_enc_params = slice_enc_params;
+  codec->params.frame_rate_control_support = frame_rate_control_support;
+  codec->params.max_hres = max_hres;
+  codec->params.max_vres = max_vres;
+}
+
 VideoFormats::VideoFormats() : Property(VideoFormatsPropertyType, true) {
 }
 
@@ -237,11 +269,41 @@ NativeVideoFormat GetFormatFromIndex(unsigned index, EnumType biggest_value) {
   return NativeVideoFormat(biggest_value);
 }
 
+// 'wfd_video_formats' and 'wfd2_video_formats' have the same layout.
+std::string FormatsToString(const char* name, bool is_none,
+                            unsigned char native,
+                            unsigned char preferred_display_mode,
+                            const H264Codecs& codecs) {
+  std::string ret;
+
+  ret = name + std::string(SEMICOLON)+ std::string(SPACE);
+
+  if (is_none)
+    return ret + NONE;
+
+  MAKE_HEX_STRING_2(native_str, native);
+  MAKE_HEX_STRING_2(preferred_display_mode_str, preferred_display_mode);
+
+  ret += native_str + std::string(SPACE)
+      + preferred_display_mode_str + std::string(SPACE);
+
+  auto it = codecs.begin();
+  auto end = codecs.end();
+  while(it != end) {
+    ret += (*it).ToString();
+    ++it;
+    if (it != end)
+      ret += ", ";
+  }
+
+  return ret;
 }
 
-NativeVideoFormat VideoFormats::GetNativeFormat() const {
-  unsigned index  = native_ >> 3;
-  unsigned selection_bits = native_ & 7;
+}
+
+NativeVideoFormat ToNativeVideoFormat(unsigned char native) {
+  unsigned index  = native >> 3;
+  unsigned selection_bits = native & 7;
   switch (selection_bits) {
   case 0: // 0b000 CEA
     return GetFormatFromIndex<CEARatesAndResolutions>(index, CEA1920x1080p24);
@@ -256,45 +318,85 @@ NativeVideoFormat VideoFormats::GetNativeFormat() const {
   return NativeVideoFormat(CEA640x480p60);
 }
 
+NativeVideoFormat VideoFormats::GetNativeFormat() const {
+  return ToNativeVideoFormat(native_);
+}
+
 std::vector<H264VideoFormat> VideoFormats::GetH264Formats() const {
   std::vector<H264VideoFormat> result;
-  for (const auto& codec : h264_codecs_)
-    PopulateVideoFormatList(codec.ToH264VideoCodec(), result);
+  for (const auto& codec : h264_codecs_) {
+    H264VideoFormatRange formats = codec.formats();
+    result.insert(result.end(), formats.begin(), formats.end());
+  }
   return result;
 }
 
 std::vector<H264VideoCodec> VideoFormats::GetH264VideoCodecs() const {
   std::vector<H264VideoCodec> result;
+  result.reserve(h264_codecs_.size());
   for (const auto& codec : h264_codecs_)
     result.push_back(codec.ToH264VideoCodec());
   return result;
 }
 
 std::string VideoFormats::ToString() const {
-  std::string ret;
+  return FormatsToString(PropertyName::wfd_video_formats, is_none(),
+                         native_, preferred_display_mode_, h264_codecs_);
+}
 
-  ret = PropertyName::wfd_video_formats
-      + std::string(SEMICOLON)+ std::string(SPACE);
+H265VideoFormats::H265VideoFormats()
+  : Property(H265VideoFormatsPropertyType, true),
+    native_(0),
+    preferred_display_mode_(0) {
+}
 
-  if (is_none())
-    return ret + NONE;
+H265VideoFormats::H265VideoFormats(NativeVideoFormat format,
+    bool preferred_display_mode,
+    const std::vector<H265VideoFormat>& h265_formats)
+  : Property(H265VideoFormatsPropertyType),
+    native_((format.rate_resolution << 3) | format.type),
+    preferred_display_mode_(preferred_display_mode ? 1 : 0) {
+  for (const auto& h265_format : h265_formats)
+    codecs_.push_back(H264Codec(h265_format));
+}
 
-  MAKE_HEX_STRING_2(native, native_);
-  MAKE_HEX_STRING_2(preferred_display_mode, preferred_display_mode_);
+H265VideoFormats::H265VideoFormats(NativeVideoFormat format,
+    bool preferred_display_mode,
+    const std::vector<H265VideoCodec>& h265_codecs)
+  : Property(H265VideoFormatsPropertyType),
+    native_((format.rate_resolution << 3) | format.type),
+    preferred_display_mode_(preferred_display_mode ? 1 : 0) {
+  for (const auto& h265_codec : h265_codecs)
+    codecs_.push_back(H264Codec(h265_codec));
+}
 
-  ret += native + std::string(SPACE)
-      + preferred_display_mode + std::string(SPACE);
+H265VideoFormats::H265VideoFormats(unsigned char native,
+    unsigned char preferred_display_mode,
+    const H264Codecs& codecs)
+  : Property(H265VideoFormatsPropertyType),
+    native_(native),
+    preferred_display_mode_(preferred_display_mode),
+    codecs_(codecs) {
+}
 
-  auto it = h264_codecs_.begin();
-  auto end = h264_codecs_.end();
-  while(it != end) {
-    ret += (*it).ToString();
-    ++it;
-    if (it != end)
-      ret += ", ";
-  }
+H265VideoFormats::~H265VideoFormats() {
+}
 
-  return ret;
+NativeVideoFormat H265VideoFormats::GetNativeFormat() const {
+  return ToNativeVideoFormat(native_);
+}
+
+std::vector<H265VideoCodec> H265VideoFormats::GetH265VideoCodecs() const {
+  std::vector<H265VideoCodec> result;
+  result.reserve(codecs_.size());
+  for (const auto& codec : codecs_)
+    result.push_back(codec.ToH265VideoCodec());
+  return result;
+}
+
+std::string H265VideoFormats::ToString() const {
+  return FormatsToString(PropertyName::wfd2_video_formats, is_none(),
+                         native_, preferred_display_mode_, codecs_);
 }
 
 }  // namespace rtsp
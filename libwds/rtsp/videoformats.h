@@ -42,8 +42,19 @@ struct H264Codec {
 
   H264Codec(const H264VideoFormat& format);
   H264Codec(const H264VideoCodec& format);
+  // The codecs of 'wfd2_video_formats' have the same fields,
+  // with H.265 profile and level bits.
+  H264Codec(const H265VideoFormat& format);
+  H264Codec(const H265VideoCodec& format);
 
   H264VideoCodec ToH264VideoCodec() const;
+  H264VideoFormatRange formats() const {
+    return H264VideoFormatRange(ToH264VideoCodec());
+  }
+  H265VideoCodec ToH265VideoCodec() const;
+  H265VideoFormatRange h265_formats() const {
+    return H265VideoFormatRange(ToH265VideoCodec());
+  }
 
   std::string ToString() const;
 
@@ -58,6 +69,10 @@ struct H264Codec {
   unsigned char frame_rate_control_support;
   unsigned short max_hres;
   unsigned short max_vres;
+
+ private:
+  template <typename Codec>
+  void CopyFormats(Codec* codec) const;
 };
 
 using H264Codecs = std::vector<H264Codec>;
@@ -78,8 +93,11 @@ class VideoFormats: public Property {
 
   NativeVideoFormat GetNativeFormat() const;
 
+  // Copies of the formats, h264_codecs() and H264Codec::formats()
+  // enumerate them without allocation.
   std::vector<H264VideoFormat> GetH264Formats() const;
   std::vector<H264VideoCodec> GetH264VideoCodecs() const;
+  const H264Codecs& h264_codecs() const { return h264_codecs_; }
 
   std::string ToString() const override;
 
@@ -89,6 +107,33 @@ class VideoFormats: public Property {
   H264Codecs h264_codecs_;
 };
 
+// The H.265 counterpart of 'wfd_video_formats'.
+class H265VideoFormats: public Property {
+ public:
+  H265VideoFormats();
+  H265VideoFormats(NativeVideoFormat format,
+                   bool preferred_display_mode,
+                   const std::vector<H265VideoFormat>& h265_formats);
+  H265VideoFormats(NativeVideoFormat format,
+                   bool preferred_display_mode,
+                   const std::vector<H265VideoCodec>& h265_codecs);
+  H265VideoFormats(unsigned char native,
+                   unsigned char preferred_display_mode,
+                   const H264Codecs& codecs);
+  ~H265VideoFormats() override;
+
+  NativeVideoFormat GetNativeFormat() const;
+  std::vector<H265VideoCodec> GetH265VideoCodecs() const;
+  const H264Codecs& codecs() const { return codecs_; }
+
+  std::string ToString() const override;
+
+ private:
+  unsigned char native_;
+  unsigned char preferred_display_mode_;
+  H264Codecs codecs_;
+};
+
 }  // namespace rtsp
 }  // namespace wds
 
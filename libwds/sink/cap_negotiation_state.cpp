@@ -25,6 +25,7 @@
 
 #include "libwds/public/media_manager.h"
 #include "libwds/rtsp/audiocodecs.h"
+#include "libwds/rtsp/avformatchangetiming.h"
 #include "libwds/rtsp/clientrtpports.h"
 #include "libwds/rtsp/connectortype.h"
 #include "libwds/rtsp/contentprotection.h"
@@ -67,22 +68,22 @@ std::unique_ptr<Reply> M3Handler::HandleMessage(Message* message) {
   for (const std::string& property : received_payload->properties()) {
       std::shared_ptr<rtsp::Property> new_prop;
       if (property == GetPropertyName(rtsp::AudioCodecsPropertyType)){
-          // FIXME: declare that we support absolutely every audio codec/format,
-          // but there should be a MediaManager API for it
-          auto codec_lpcm = AudioCodec(LPCM, AudioModes(3), 0);
-          auto codec_aac = AudioCodec(AAC, AudioModes(15), 0);
-          auto codec_ac3 = AudioCodec(AC3, AudioModes(7), 0);
-          std::vector<AudioCodec> codec_list;
-          codec_list.push_back(codec_lpcm);
-          codec_list.push_back(codec_aac);
-          codec_list.push_back(codec_ac3);
-          new_prop.reset(new rtsp::AudioCodecs(codec_list));
+          new_prop.reset(new rtsp::AudioCodecs(
+              ToSinkMediaManager(manager_)->GetSupportedAudioCodecs()));
           reply_payload->AddProperty(new_prop);
       } else if (property == GetPropertyName(rtsp::VideoFormatsPropertyType)){
           new_prop.reset(new rtsp::VideoFormats(ToSinkMediaManager(manager_)->GetNativeVideoFormat(),
               false,
               ToSinkMediaManager(manager_)->GetSupportedH264VideoCodecs()));
           reply_payload->AddProperty(new_prop);
+      } else if (property == GetPropertyName(rtsp::H265VideoFormatsPropertyType)){
+          auto h265_codecs = ToSinkMediaManager(manager_)->GetSupportedH265VideoCodecs();
+          if (h265_codecs.empty())
+            new_prop.reset(new rtsp::H265VideoFormats());
+          else
+            new_prop.reset(new rtsp::H265VideoFormats(ToSinkMediaManager(manager_)->GetNativeVideoFormat(),
+                false, h265_codecs));
+          reply_payload->AddProperty(new_prop);
       } else if (property == GetPropertyName(rtsp::Video3DFormatsPropertyType)){
           new_prop.reset(new rtsp::Formats3d());
           reply_payload->AddProperty(new_prop);
@@ -140,6 +141,11 @@ std::unique_ptr<Reply> M4Handler::HandleMessage(Message* message) {
     sink_media_manager->SetPresentationUrl(presentation_url->presentation_url_1());
   }
 
+  auto h265_formats = static_cast<rtsp::H265VideoFormats*>(
+      payload->GetProperty(rtsp::H265VideoFormatsPropertyType).get());
+  if (h265_formats)
+    return HandleH265VideoFormats(h265_formats);
+
   auto video_formats =
       static_cast<rtsp::VideoFormats*>(payload->GetProperty(rtsp::VideoFormatsPropertyType).get());
 
@@ -148,26 +154,75 @@ std::unique_ptr<Reply> M4Handler::HandleMessage(Message* message) {
     return nullptr;
   }
 
-  const auto& selected_formats = video_formats->GetH264Formats();
-  if (selected_formats.size() != 1) {
+  H264VideoFormat selected_format;
+  size_t format_count = 0;
+  for (const auto& codec : video_formats->h264_codecs()) {
+    for (const H264VideoFormat& format : codec.formats()) {
+      selected_format = format;
+      ++format_count;
+    }
+  }
+  if (format_count != 1) {
     WDS_ERROR("Failed to obtain optimal video format from 'wfd-video-formats' in M4 handler.");
     return nullptr;
   }
 
-  if (!sink_media_manager->SetOptimalVideoFormat(selected_formats[0])) {
-    auto reply = std::unique_ptr<Reply>(new Reply(rtsp::STATUS_SeeOther));
-    auto payload = new rtsp::PropertyErrorPayload();
-    std::vector<unsigned short> error_codes = {rtsp::STATUS_UnsupportedMediaType};
-    auto property_errors =
-        std::make_shared<rtsp::PropertyErrors>(rtsp::VideoFormatsPropertyType, error_codes);
-    payload->AddPropertyError(property_errors);
-    reply->set_payload(std::unique_ptr<rtsp::Payload>(payload));
-    return reply;
+  // During streaming the source tells from which frame the format is used.
+  auto timing = static_cast<rtsp::AVFormatChangeTiming*>(
+      payload->GetProperty(rtsp::AVFormatChangeTimingPropertyType).get());
+  bool accepted = timing
+      ? TraceMediaCall(Request::M4, "ScheduleVideoFormatChange",
+            [sink_media_manager, &selected_format, timing] {
+              return sink_media_manager->ScheduleVideoFormatChange(
+                  selected_format, timing->pts(), timing->dts());
+            })
+      : TraceMediaCall(Request::M4, "SetOptimalVideoFormat",
+            [sink_media_manager, &selected_format] {
+              return sink_media_manager->SetOptimalVideoFormat(selected_format);
+            });
+  if (!accepted)
+    return CreateUnsupportedFormatReply(rtsp::VideoFormatsPropertyType);
+
+  return std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK));
+}
+
+std::unique_ptr<Reply> M4Handler::HandleH265VideoFormats(
+    rtsp::H265VideoFormats* h265_formats) {
+  SinkMediaManager* sink_media_manager = ToSinkMediaManager(manager_);
+  H265VideoFormat selected_format;
+  size_t format_count = 0;
+  for (const auto& codec : h265_formats->codecs()) {
+    for (const H265VideoFormat& format : codec.h265_formats()) {
+      selected_format = format;
+      ++format_count;
+    }
+  }
+  if (format_count != 1) {
+    WDS_ERROR("Failed to obtain optimal video format from 'wfd2-video-formats' in M4 handler.");
+    return nullptr;
   }
 
+  if (!TraceMediaCall(Request::M4, "SetOptimalH265VideoFormat",
+      [sink_media_manager, &selected_format] {
+        return sink_media_manager->SetOptimalH265VideoFormat(selected_format);
+      }))
+    return CreateUnsupportedFormatReply(rtsp::H265VideoFormatsPropertyType);
+
   return std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK));
 }
 
+std::unique_ptr<Reply> M4Handler::CreateUnsupportedFormatReply(
+    rtsp::PropertyType type) {
+  auto reply = std::unique_ptr<Reply>(new Reply(rtsp::STATUS_SeeOther));
+  auto payload = new rtsp::PropertyErrorPayload();
+  std::vector<unsigned short> error_codes = {rtsp::STATUS_UnsupportedMediaType};
+  auto property_errors =
+      std::make_shared<rtsp::PropertyErrors>(type, error_codes);
+  payload->AddPropertyError(property_errors);
+  reply->set_payload(std::unique_ptr<rtsp::Payload>(payload));
+  return reply;
+}
+
 class M5Handler final : public MessageReceiver<Request::M5> {
  public:
   M5Handler(const InitParams& init_params)
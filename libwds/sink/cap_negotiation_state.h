@@ -23,8 +23,14 @@
 #define LIBWDS_SINK_CAP_NEGOTIATION_STATE_H_
 
 #include "libwds/common/message_handler.h"
+#include "libwds/rtsp/constants.h"
 
 namespace wds {
+
+namespace rtsp {
+class H265VideoFormats;
+}
+
 namespace sink {
 
 // Capability negotiation state for RTSP sink.
@@ -38,6 +44,12 @@ class M4Handler final : public MessageReceiver<rtsp::Request::M4> {
  public:
   M4Handler(const InitParams& init_params);
   std::unique_ptr<rtsp::Reply> HandleMessage(rtsp::Message* message) override;
+
+ private:
+  std::unique_ptr<rtsp::Reply> HandleH265VideoFormats(
+      rtsp::H265VideoFormats* h265_formats);
+  std::unique_ptr<rtsp::Reply> CreateUnsupportedFormatReply(
+      rtsp::PropertyType type);
 };
 
 class M3Handler final : public MessageReceiver<rtsp::Request::M3> {
@@ -61,6 +61,7 @@ class M2Handler final : public SequencedMessageSender {
   virtual std::unique_ptr<Message> CreateMessage() override {
     auto options = new rtsp::Options("*");
     options->header().set_cseq(sender_->GetNextCSeq(&source_init_cseq_));
+    options->set_id(Request::M2);
     options->header().set_require_wfd_support(true);
     return std::unique_ptr<Message>(options);
   }
@@ -41,7 +41,7 @@ M16Handler::M16Handler(const InitParams& init_params, unsigned& keep_alive_timer
   : MessageReceiver<Request::M16>(init_params),
     keep_alive_timer_(keep_alive_timer) { }
 
-bool M16Handler::HandleTimeoutEvent(unsigned timer_id) const {
+bool M16Handler::HandleTimeoutEvent(unsigned timer_id) {
   return timer_id == keep_alive_timer_;
 }
 
@@ -64,6 +64,7 @@ std::unique_ptr<Message> M6Handler::CreateMessage() {
   transport->set_client_port(ToSinkMediaManager(manager_)->GetLocalRtpPorts().first);
   setup->header().set_transport(transport);
   setup->header().set_cseq(sender_->GetNextCSeq());
+  setup->set_id(Request::M6);
   setup->header().set_require_wfd_support(true);
 
   return std::unique_ptr<Message>(setup);
@@ -89,6 +90,7 @@ class M7Handler final : public SequencedMessageSender {
     rtsp::Play* play = new rtsp::Play(ToSinkMediaManager(manager_)->GetPresentationUrl());
     play->header().set_session(manager_->GetSessionId());
     play->header().set_cseq(sender_->GetNextCSeq());
+    play->set_id(Request::M7);
     play->header().set_require_wfd_support(true);
 
     return std::unique_ptr<Message>(play);
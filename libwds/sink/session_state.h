@@ -43,7 +43,7 @@ class M16Handler final : public MessageReceiver<rtsp::Request::M16> {
   M16Handler(const InitParams& init_params, unsigned& keep_alive_timer);
 
  private:
-  bool HandleTimeoutEvent(unsigned timer_id) const override;
+  bool HandleTimeoutEvent(unsigned timer_id) override;
   std::unique_ptr<rtsp::Reply> HandleMessage(rtsp::Message* message) override;
 
   unsigned& keep_alive_timer_;
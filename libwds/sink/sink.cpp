@@ -21,11 +21,18 @@
 
 #include "libwds/public/sink.h"
 
+#include "libwds/common/log_scope.h"
 #include "libwds/common/message_handler.h"
+#include "libwds/common/output_batch.h"
+#include "libwds/common/stats_recorder.h"
+#include "libwds/common/timeline.h"
+#include "libwds/common/tracepoints.h"
 #include "libwds/common/rtsp_input_handler.h"
 #include "libwds/public/wds_export.h"
+#include "libwds/rtsp/idrrequest.h"
 #include "libwds/rtsp/pause.h"
 #include "libwds/rtsp/play.h"
+#include "libwds/rtsp/setparameter.h"
 #include "libwds/rtsp/teardown.h"
 #include "libwds/rtsp/triggermethod.h"
 #include "libwds/public/media_manager.h"
@@ -75,6 +82,20 @@ bool InitializeRequestId(Request* request) {
   return true;
 }
 
+std::unique_ptr<Message> CreateM13(const std::string& session,
+                                   int send_cseq) {
+  auto set_param = std::unique_ptr<Request>(
+      new rtsp::SetParameter("rtsp://localhost/wfd1.0"));
+  set_param->header().set_session(session);
+  set_param->header().set_cseq(send_cseq);
+  auto payload = new rtsp::PropertyMapPayload();
+  payload->AddProperty(
+      std::shared_ptr<rtsp::Property>(new rtsp::IDRRequest()));
+  set_param->set_payload(std::unique_ptr<rtsp::Payload>(payload));
+  set_param->set_id(Request::M13);
+  return std::move(set_param);
+}
+
 }
 
 class SinkStateMachine : public MessageSequenceHandler {
@@ -99,7 +120,7 @@ class SinkStateMachine : public MessageSequenceHandler {
 
 class SinkImpl final : public Sink, public RTSPInputHandler, public MessageHandler::Observer {
  public:
-  SinkImpl(Delegate* delegate, SinkMediaManager* mng);
+  SinkImpl(Delegate* delegate, SinkMediaManager* mng, Peer::Observer* observer);
 
  private:
   // Sink implementation.
@@ -109,6 +130,9 @@ class SinkImpl final : public Sink, public RTSPInputHandler, public MessageHandl
   bool Teardown() override;
   bool Play() override;
   bool Pause() override;
+  bool RequestIDR() override;
+  void SetLogHandler(SessionLogFunction func, void* user_data) override;
+  PeerStats GetStats() const override;
 
   // RTSPInputHandler
   void MessageParsed(std::unique_ptr<Message> message) override;
@@ -125,26 +149,46 @@ class SinkImpl final : public Sink, public RTSPInputHandler, public MessageHandl
 
   void ResetAndTeardownMedia();
 
+  StatsRecorder stats_;
+  BufferedDelegate output_;
+  TimelineRecorder timeline_;
   std::shared_ptr<SinkStateMachine> state_machine_;
   Delegate* delegate_;
   SinkMediaManager* manager_;
+  SessionLogFunction log_func_;
+  void* log_user_data_;
 };
 
-SinkImpl::SinkImpl(Delegate* delegate, SinkMediaManager* mng)
-  : state_machine_(new SinkStateMachine({delegate, mng, this})),
+SinkImpl::SinkImpl(Delegate* delegate, SinkMediaManager* mng,
+                   Peer::Observer* observer)
+  : RTSPInputHandler(this, &stats_),
+    output_(delegate, &stats_, this),
+    timeline_(observer),
+    state_machine_(new SinkStateMachine(
+        {&output_, mng, this, &timeline_, &stats_, this})),
     delegate_(delegate),
-    manager_(mng) {
+    manager_(mng),
+    log_func_(nullptr),
+    log_user_data_(nullptr) {
 }
 
 void SinkImpl::Start() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  timeline_.Record(TimelineEvent::SessionStarted, Request::UNKNOWN, 0);
   state_machine_->Start();
 }
 
 void SinkImpl::Reset() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   state_machine_->Reset();
 }
 
 void SinkImpl::RTSPDataReceived(const std::string& message) {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  stats_.CountBytesReceived(message.size());
   AddInput(message);
 }
 
@@ -169,17 +213,39 @@ bool SinkImpl::HandleCommand(std::unique_ptr<Message> command) {
 }
 
 bool SinkImpl::Teardown() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   return HandleCommand(CreateCommand<rtsp::Teardown, Request::M8>());
 }
 
 bool SinkImpl::Play() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   return HandleCommand(CreateCommand<rtsp::Play, Request::M7>());
 }
 
 bool SinkImpl::Pause() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   return HandleCommand(CreateCommand<rtsp::Pause, Request::M9>());
 }
 
+bool SinkImpl::RequestIDR() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  return HandleCommand(
+      CreateM13(manager_->GetSessionId(), delegate_->GetNextCSeq()));
+}
+
+void SinkImpl::SetLogHandler(SessionLogFunction func, void* user_data) {
+  log_func_ = func;
+  log_user_data_ = user_data;
+}
+
+PeerStats SinkImpl::GetStats() const {
+  return stats_.Snapshot();
+}
+
 void SinkImpl::MessageParsed(std::unique_ptr<Message> message) {
   if (message->is_request() && !InitializeRequestId(ToRequest(message.get()))) {
     WDS_ERROR("Cannot identify the received message");
@@ -189,31 +255,43 @@ void SinkImpl::MessageParsed(std::unique_ptr<Message> message) {
     WDS_ERROR("Cannot handle the received message with Id: %d", ToRequest(message.get())->id());
     return;
   }
+  WDS_TRACE3(message__parsed, static_cast<Peer*>(this), message->cseq(),
+             message->is_request() ? ToRequest(message.get())->id()
+                                   : Request::UNKNOWN);
   state_machine_->Handle(std::move(message));
 }
 
 void SinkImpl::ResetAndTeardownMedia() {
-  manager_->Teardown();
+  // Nothing waits for the media stream to be gone.
+  manager_->TeardownAsync();
   state_machine_->Reset();
 }
 
 void SinkImpl::OnCompleted(MessageHandlerPtr handler) {
   assert(handler == state_machine_);
+  WDS_TRACE2(handler__completed, static_cast<Peer*>(this), handler.get());
   ResetAndTeardownMedia();
 }
 
 void SinkImpl::OnError(MessageHandlerPtr handler) {
    assert(handler == state_machine_);
+   WDS_TRACE2(handler__error, static_cast<Peer*>(this), handler.get());
    ResetAndTeardownMedia();
 }
 
 void SinkImpl::OnTimerEvent(unsigned timer_id) {
-  if (state_machine_->HandleTimeoutEvent(timer_id))
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  WDS_TRACE2(timer__fire, static_cast<Peer*>(this), timer_id);
+  if (state_machine_->HandleTimeoutEvent(timer_id)) {
+    stats_.CountTimeout();
     state_machine_->Reset();
+  }
 }
 
-Sink* Sink::Create(Delegate* delegate, SinkMediaManager* mng) {
-  return new SinkImpl(delegate, mng);
+Sink* Sink::Create(Delegate* delegate, SinkMediaManager* mng,
+                   Peer::Observer* observer) {
+  return new SinkImpl(delegate, mng, observer);
 }
 
 }  // namespace wds
@@ -73,15 +73,21 @@ class M7Sender final : public SequencedMessageSender {
     rtsp::Play* play = new rtsp::Play(ToSinkMediaManager(manager_)->GetPresentationUrl());
     play->header().set_session(manager_->GetSessionId());
     play->header().set_cseq (sender_->GetNextCSeq());
+    play->set_id(Request::M7);
     return std::unique_ptr<Message>(play);
   }
 
   bool HandleReply(Reply* reply) override {
-    if (reply->response_code() == rtsp::STATUS_OK) {
-      manager_->Play();
-      return true;
+    return (reply->response_code() == rtsp::STATUS_OK);
+  }
+
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override {
+    if (!HandleReply(reply)) {
+      done(false);
+      return;
     }
-    return false;
+    AwaitMediaCall(Request::M7, "Play",
+                   [this] { return manager_->PlayAsync(); }, done);
   }
 };
 
@@ -102,16 +108,22 @@ class M8Sender final : public SequencedMessageSender {
     rtsp::Teardown* teardown = new rtsp::Teardown(ToSinkMediaManager(manager_)->GetPresentationUrl());
     teardown->header().set_session(manager_->GetSessionId());
     teardown->header().set_cseq(sender_->GetNextCSeq());
+    teardown->set_id(Request::M8);
     return std::unique_ptr<Message>(teardown);
   }
 
   bool HandleReply(Reply* reply) override {
-    if (!manager_->GetSessionId().empty() &&
-        (reply->response_code() == rtsp::STATUS_OK)) {
-      manager_->Teardown();
-      return true;
+    return !manager_->GetSessionId().empty() &&
+           (reply->response_code() == rtsp::STATUS_OK);
+  }
+
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override {
+    if (!HandleReply(reply)) {
+      done(false);
+      return;
     }
-    return false;
+    AwaitMediaCall(Request::M8, "Teardown",
+                   [this] { return manager_->TeardownAsync(); }, done);
   }
 };
 
@@ -129,15 +141,21 @@ class M9Sender final : public SequencedMessageSender {
     rtsp::Pause* pause = new rtsp::Pause(ToSinkMediaManager(manager_)->GetPresentationUrl());
     pause->header().set_session(manager_->GetSessionId());
     pause->header().set_cseq(sender_->GetNextCSeq());
+    pause->set_id(Request::M9);
     return std::unique_ptr<Message>(pause);
   }
 
   bool HandleReply(Reply* reply) override {
-    if (reply->response_code() == rtsp::STATUS_OK) {
-      manager_->Pause();
-      return true;
+    return (reply->response_code() == rtsp::STATUS_OK);
+  }
+
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override {
+    if (!HandleReply(reply)) {
+      done(false);
+      return;
     }
-    return false;
+    AwaitMediaCall(Request::M9, "Pause",
+                   [this] { return manager_->PauseAsync(); }, done);
   }
 };
 
@@ -157,11 +175,16 @@ class M7SenderOptional final : public OptionalMessageSender<Request::M7> {
   }
  private:
   bool HandleReply(Reply* reply) override {
-    if (reply->response_code() == rtsp::STATUS_OK) {
-      manager_->Play();
-      return true;
+    return (reply->response_code() == rtsp::STATUS_OK);
+  }
+
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override {
+    if (!HandleReply(reply)) {
+      done(false);
+      return;
     }
-    return false;
+    AwaitMediaCall(Request::M7, "Play",
+                   [this] { return manager_->PlayAsync(); }, done);
   }
 
   bool CanSend(Message* message) const override {
@@ -180,12 +203,16 @@ class M8SenderOptional final : public OptionalMessageSender<Request::M8> {
  private:
   bool HandleReply(Reply* reply) override {
     // todo: if successfull, switch to init state
-    if (reply->response_code() == rtsp::STATUS_OK) {
-      manager_->Teardown();
-      return true;
-    }
+    return (reply->response_code() == rtsp::STATUS_OK);
+  }
 
-    return false;
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override {
+    if (!HandleReply(reply)) {
+      done(false);
+      return;
+    }
+    AwaitMediaCall(Request::M8, "Teardown",
+                   [this] { return manager_->TeardownAsync(); }, done);
   }
 };
 
@@ -196,11 +223,16 @@ class M9SenderOptional final : public OptionalMessageSender<Request::M9> {
   }
  private:
   bool HandleReply(Reply* reply) override {
-    if (reply->response_code() == rtsp::STATUS_OK) {
-      manager_->Pause();
-      return true;
+    return (reply->response_code() == rtsp::STATUS_OK);
+  }
+
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override {
+    if (!HandleReply(reply)) {
+      done(false);
+      return;
     }
-    return false;
+    AwaitMediaCall(Request::M9, "Pause",
+                   [this] { return manager_->PauseAsync(); }, done);
   }
 
   bool CanSend(Message* message) const override {
@@ -211,6 +243,41 @@ class M9SenderOptional final : public OptionalMessageSender<Request::M9> {
   }
 };
 
+// Sends M13 to ask for an IDR picture, @see Sink::RequestIDR.
+class M13Sender final : public OptionalMessageSender<Request::M13> {
+ public:
+  M13Sender(const InitParams& init_params)
+    : OptionalMessageSender<Request::M13>(init_params),
+      pending_(false) {
+  }
+
+ private:
+  bool CanSend(Message* message) const override {
+    // Requests made before the answer are served by the same picture.
+    return OptionalMessageSender<Request::M13>::CanSend(message) && !pending_;
+  }
+
+  void Send(std::unique_ptr<Message> message) override {
+    pending_ = true;
+    OptionalMessageSender<Request::M13>::Send(std::move(message));
+  }
+
+  void Reset() override {
+    pending_ = false;
+    OptionalMessageSender<Request::M13>::Reset();
+  }
+
+  bool HandleReply(Reply* reply) override {
+    pending_ = false;
+    // The next regular keyframe repairs the picture as well.
+    if (reply->response_code() != rtsp::STATUS_OK)
+      WDS_WARNING("Source rejected the IDR request.");
+    return true;
+  }
+
+  bool pending_;
+};
+
 StreamingState::StreamingState(const InitParams& init_params, MessageHandlerPtr m16_handler)
   : MessageSequenceWithOptionalSetHandler(init_params) {
   AddSequencedHandler(make_ptr(new TeardownHandler(init_params)));
@@ -223,6 +290,7 @@ StreamingState::StreamingState(const InitParams& init_params, MessageHandlerPtr
   AddOptionalHandler(make_ptr(new M7SenderOptional(init_params)));
   AddOptionalHandler(make_ptr(new M8SenderOptional(init_params)));
   AddOptionalHandler(make_ptr(new M9SenderOptional(init_params)));
+  AddOptionalHandler(make_ptr(new M13Sender(init_params)));
   AddOptionalHandler(m16_handler);
 }
 
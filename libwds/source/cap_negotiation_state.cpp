@@ -21,6 +21,8 @@
 
 #include "libwds/source/cap_negotiation_state.h"
 
+#include <functional>
+
 #include "libwds/rtsp/audiocodecs.h"
 #include "libwds/rtsp/clientrtpports.h"
 #include "libwds/rtsp/getparameter.h"
@@ -29,6 +31,7 @@
 #include "libwds/rtsp/reply.h"
 #include "libwds/rtsp/setparameter.h"
 #include "libwds/rtsp/videoformats.h"
+#include "libwds/public/capability_cache.h"
 #include "libwds/public/media_manager.h"
 
 namespace wds {
@@ -36,6 +39,7 @@ namespace wds {
 using rtsp::AudioCodecs;
 using rtsp::ClientRtpPorts;
 using rtsp::GetParameter;
+using rtsp::H265VideoFormats;
 using rtsp::Message;
 using rtsp::Payload;
 using rtsp::Property;
@@ -46,32 +50,113 @@ using rtsp::VideoFormats;
 
 namespace source {
 
+namespace {
+
+// Number of times the source selects another video format when
+// the sink rejects the selected one in M4.
+const int kMaxVideoFormatRetries = 3;
+
+// Removes |format| from the rates and resolutions of |codecs|,
+// returns false if there are none left.
+bool RemoveVideoFormat(const H264VideoFormat& format,
+                       std::vector<H264VideoCodec>* codecs) {
+  bool has_formats = false;
+  for (H264VideoCodec& codec : *codecs) {
+    RateAndResolutionsBitmap* bitmap = &codec.cea_rr;
+    if (format.type == VESA)
+      bitmap = &codec.vesa_rr;
+    else if (format.type == HH)
+      bitmap = &codec.hh_rr;
+    bitmap->reset(format.rate_resolution);
+    has_formats |= codec.cea_rr.any() || codec.vesa_rr.any() ||
+                   codec.hh_rr.any();
+  }
+  return has_formats;
+}
+
+// Caches the formats the media manager is set up with.
+void StoreFormats(const CapabilityCacheKey& cache_key,
+                  SourceMediaManager* source_manager,
+                  const VideoFormatCandidates& video_candidates,
+                  bool has_video, bool has_audio) {
+  if (!cache_key.cache)
+    return;
+
+  NegotiatedFormats formats;
+  formats.has_video = has_video;
+  if (has_video)
+    formats.video_format = source_manager->GetOptimalVideoFormat();
+  formats.has_h265 = video_candidates.use_h265;
+  if (formats.has_h265)
+    formats.h265_format = source_manager->GetOptimalH265VideoFormat();
+  formats.has_audio = has_audio;
+  if (has_audio)
+    formats.audio_codec = source_manager->GetOptimalAudioFormat();
+  formats.capabilities_digest = video_candidates.capabilities_digest;
+  cache_key.cache->Store(cache_key.peer_id, formats);
+}
+
+}  // namespace
+
 class M3Handler final : public SequencedMessageSender {
  public:
-  using SequencedMessageSender::SequencedMessageSender;
+  M3Handler(const InitParams& init_params,
+            const CapabilityCacheKey& cache_key,
+            VideoFormatCandidates& video_candidates)
+    : SequencedMessageSender(init_params),
+      cache_key_(cache_key),
+      video_candidates_(video_candidates) {
+  }
 
  private:
+  bool UseCachedFormats(uint64_t capabilities_digest);
+  bool InitH265VideoFormat(H265VideoFormats* h265_formats);
+
   std::unique_ptr<Message> CreateMessage() override;
   bool HandleReply(Reply* reply) override;
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override;
+
+  const CapabilityCacheKey& cache_key_;
+  VideoFormatCandidates& video_candidates_;
 };
 
 class M4Handler final : public SequencedMessageSender {
  public:
-  using SequencedMessageSender::SequencedMessageSender;
+  M4Handler(const InitParams& init_params,
+            const CapabilityCacheKey& cache_key,
+            VideoFormatCandidates& video_candidates)
+    : SequencedMessageSender(init_params),
+      cache_key_(cache_key),
+      video_candidates_(video_candidates),
+      fell_back_(false) {
+  }
 
  private:
+  bool RetryWithH264(Reply* reply);
+  bool RetryWithNextVideoFormat(Reply* reply);
+
   std::unique_ptr<Message> CreateMessage() override;
   bool HandleReply(Reply* reply) override;
+  void HandleReplyAsync(Reply* reply, const CompletionCallback& done) override;
+
+  const CapabilityCacheKey& cache_key_;
+  VideoFormatCandidates& video_candidates_;
+  // Set once the sink rejected the formats of M3.
+  bool fell_back_;
 };
 
 std::unique_ptr<Message> M3Handler::CreateMessage() {
   GetParameter* get_param = new GetParameter("rtsp://localhost/wfd1.0");
   get_param->header().set_cseq(sender_->GetNextCSeq());
+  get_param->set_id(Request::M3);
   std::vector<std::string> props;
 
   SessionType media_type = ToSourceMediaManager(manager_)->GetSessionType();
-  if (media_type & VideoSession)
+  if (media_type & VideoSession) {
     props.push_back("wfd_video_formats");
+    if (ToSourceMediaManager(manager_)->IsH265Supported())
+      props.push_back("wfd2_video_formats");
+  }
   if (media_type & AudioSession)
     props.push_back("wfd_audio_codecs");
 
@@ -97,11 +182,13 @@ bool M3Handler::HandleReply(Reply* reply) {
     WDS_ERROR("Failed to obtain RTP ports from source.");
     return false;
   }
-  source_manager->SetSinkRtpPorts(ports->rtp_port_0(), ports->rtp_port_1());
 
   auto video_formats = static_cast<VideoFormats*>(
       payload->GetProperty(rtsp::VideoFormatsPropertyType).get());
 
+  auto h265_formats = static_cast<H265VideoFormats*>(
+      payload->GetProperty(rtsp::H265VideoFormatsPropertyType).get());
+
   auto audio_codecs = static_cast<AudioCodecs*>(
       payload->GetProperty(rtsp::AudioCodecsPropertyType).get());
 
@@ -115,25 +202,100 @@ bool M3Handler::HandleReply(Reply* reply) {
     return false;
   }
 
-  if (video_formats && !source_manager->InitOptimalVideoFormat(
-      video_formats->GetNativeFormat(),
-      video_formats->GetH264VideoCodecs())) {
+  if (video_formats) {
+    video_candidates_.native_format = video_formats->GetNativeFormat();
+    video_candidates_.codecs = video_formats->GetH264VideoCodecs();
+    video_candidates_.rejected = 0;
+  }
+  video_candidates_.use_h265 = false;
+
+  // A sink reporting the same capabilities gets the same formats.
+  uint64_t digest = std::hash<std::string>()(
+      (video_formats ? video_formats->ToString() : "") + "\n" +
+      (h265_formats ? h265_formats->ToString() : "") + "\n" +
+      (audio_codecs ? audio_codecs->ToString() : ""));
+  video_candidates_.capabilities_digest = digest;
+  if (UseCachedFormats(digest))
+    return true;
+
+  if (video_formats && !TraceMediaCall(Request::M3, "InitOptimalVideoFormat",
+      [source_manager, video_formats] {
+        return source_manager->InitOptimalVideoFormat(
+            video_formats->GetNativeFormat(),
+            video_formats->GetH264VideoCodecs());
+      })) {
     WDS_ERROR("Cannot initalize optimal video format from the supported by sink.");
     return false;
   }
 
-  if (audio_codecs && !source_manager->InitOptimalAudioFormat(
-      audio_codecs->audio_codecs())) {
+  if (video_formats && h265_formats)
+    video_candidates_.use_h265 = InitH265VideoFormat(h265_formats);
+
+  if (audio_codecs && !TraceMediaCall(Request::M3, "InitOptimalAudioFormat",
+      [source_manager, audio_codecs] {
+        return source_manager->InitOptimalAudioFormat(
+            audio_codecs->audio_codecs());
+      })) {
     WDS_ERROR("Cannot initalize optimal audio format from the supported by sink.");
     return false;
   }
 
+  StoreFormats(cache_key_, source_manager, video_candidates_,
+               video_formats != nullptr, audio_codecs != nullptr);
+  return true;
+}
+
+bool M3Handler::UseCachedFormats(uint64_t capabilities_digest) {
+  NegotiatedFormats formats;
+  if (!cache_key_.cache ||
+      !cache_key_.cache->Lookup(cache_key_.peer_id, &formats) ||
+      formats.capabilities_digest != capabilities_digest)
+    return false;
+
+  if (!TraceMediaCall(Request::M3, "UseNegotiatedFormats",
+      [this, &formats] {
+        return ToSourceMediaManager(manager_)->UseNegotiatedFormats(formats);
+      }))
+    return false;
+
+  video_candidates_.use_h265 = formats.has_h265;
   return true;
 }
 
+bool M3Handler::InitH265VideoFormat(H265VideoFormats* h265_formats) {
+  SourceMediaManager* source_manager = ToSourceMediaManager(manager_);
+  if (h265_formats->is_none() || !source_manager->IsH265Supported())
+    return false;
+
+  return TraceMediaCall(Request::M3, "InitOptimalH265VideoFormat",
+      [source_manager, h265_formats] {
+        return source_manager->InitOptimalH265VideoFormat(
+            h265_formats->GetNativeFormat(),
+            h265_formats->GetH265VideoCodecs());
+      });
+}
+
+void M3Handler::HandleReplyAsync(Reply* reply, const CompletionCallback& done) {
+  if (!HandleReply(reply)) {
+    done(false);
+    return;
+  }
+  // Set up the media stream once the formats are known, the reply
+  // is complete when the media manager is ready with it.
+  auto payload = ToPropertyMapPayload(reply->payload());
+  auto ports = static_cast<ClientRtpPorts*>(
+      payload->GetProperty(rtsp::ClientRTPPortsPropertyType).get());
+  int port0 = ports->rtp_port_0();
+  int port1 = ports->rtp_port_1();
+  AwaitMediaCall(Request::M3, "SetSinkRtpPorts", [this, port0, port1] {
+    return ToSourceMediaManager(manager_)->SetSinkRtpPortsAsync(port0, port1);
+  }, done);
+}
+
 std::unique_ptr<Message> M4Handler::CreateMessage() {
   SetParameter* set_param = new SetParameter("rtsp://localhost/wfd1.0");
   set_param->header().set_cseq(sender_->GetNextCSeq());
+  set_param->set_id(Request::M4);
   SourceMediaManager* source_manager = ToSourceMediaManager(manager_);
   const auto& ports = source_manager->GetSinkRtpPorts();
   auto payload = new rtsp::PropertyMapPayload();
@@ -144,7 +306,14 @@ std::unique_ptr<Message> M4Handler::CreateMessage() {
   payload->AddProperty(
       std::shared_ptr<Property>(new rtsp::PresentationUrl(presentation_Url_1, "")));
 
-  if (source_manager->GetSessionType() & VideoSession) {
+  if ((source_manager->GetSessionType() & VideoSession) &&
+      video_candidates_.use_h265) {
+    payload->AddProperty(
+        std::shared_ptr<H265VideoFormats>(new H265VideoFormats(
+            NativeVideoFormat(),  // Should be all zeros.
+            false,
+            {source_manager->GetOptimalH265VideoFormat()})));
+  } else if (source_manager->GetSessionType() & VideoSession) {
     payload->AddProperty(
         std::shared_ptr<VideoFormats>(new VideoFormats(
             NativeVideoFormat(),  // Should be all zeros.
@@ -163,13 +332,109 @@ std::unique_ptr<Message> M4Handler::CreateMessage() {
 }
 
 bool M4Handler::HandleReply(Reply* reply) {
-  return (reply->response_code() == rtsp::STATUS_OK);
+  if (reply->response_code() == rtsp::STATUS_SeeOther &&
+      (RetryWithH264(reply) || RetryWithNextVideoFormat(reply)))
+    return true;
+  if (reply->response_code() != rtsp::STATUS_OK)
+    return false;
+
+  // Remember the formats the sink accepted instead of the rejected ones.
+  if (fell_back_) {
+    SourceMediaManager* source_manager = ToSourceMediaManager(manager_);
+    SessionType session_type = source_manager->GetSessionType();
+    StoreFormats(cache_key_, source_manager, video_candidates_,
+                 (session_type & VideoSession) != 0,
+                 (session_type & AudioSession) != 0);
+  }
+  return true;
+}
+
+void M4Handler::HandleReplyAsync(Reply* reply, const CompletionCallback& done) {
+  if (!HandleReply(reply)) {
+    done(false);
+    return;
+  }
+  // M4 is resent with other formats.
+  if (reply->response_code() != rtsp::STATUS_OK) {
+    done(true);
+    return;
+  }
+  // Take setting up the media stream off the critical path of M7.
+  AwaitMediaCall(Request::M4, "PrerollMedia", [this] {
+    return ToSourceMediaManager(manager_)->PrerollMediaAsync();
+  }, done);
+}
+
+bool M4Handler::RetryWithH264(Reply* reply) {
+  Payload* payload = reply->payload();
+  if (!video_candidates_.use_h265 ||
+      !payload || payload->type() != Payload::Errors ||
+      !ToPropertyErrorPayload(payload)->GetPropertyError(
+          rtsp::H265VideoFormatsPropertyType))
+    return false;
+
+  WDS_WARNING("Sink rejected the H.265 video format, falling back to H.264.");
+  video_candidates_.use_h265 = false;
+  SourceMediaManager* source_manager = ToSourceMediaManager(manager_);
+  if (!TraceMediaCall(Request::M4, "InitOptimalVideoFormat",
+      [this, source_manager] {
+        return source_manager->InitOptimalVideoFormat(
+            video_candidates_.native_format, video_candidates_.codecs);
+      })) {
+    WDS_ERROR("Cannot initalize optimal video format from the supported by sink.");
+    return false;
+  }
+
+  // Not cached again unless the sink accepts the H.264 format.
+  if (cache_key_.cache)
+    cache_key_.cache->Remove(cache_key_.peer_id);
+  fell_back_ = true;
+  Resend();
+  return true;
+}
+
+bool M4Handler::RetryWithNextVideoFormat(Reply* reply) {
+  Payload* payload = reply->payload();
+  if (!payload || payload->type() != Payload::Errors ||
+      !ToPropertyErrorPayload(payload)->GetPropertyError(
+          rtsp::VideoFormatsPropertyType))
+    return false;
+
+  SourceMediaManager* source_manager = ToSourceMediaManager(manager_);
+  if (video_candidates_.rejected >= kMaxVideoFormatRetries ||
+      !RemoveVideoFormat(source_manager->GetOptimalVideoFormat(),
+                         &video_candidates_.codecs))
+    return false;
+  ++video_candidates_.rejected;
+
+  WDS_WARNING("Sink rejected the video format, selecting another one.");
+  if (!TraceMediaCall(Request::M4, "InitOptimalVideoFormat",
+      [this, source_manager] {
+        return source_manager->InitOptimalVideoFormat(
+            video_candidates_.native_format, video_candidates_.codecs);
+      })) {
+    WDS_ERROR("Cannot initalize optimal video format from the supported by sink.");
+    return false;
+  }
+
+  // The cached formats are not usable with the sink either, the next
+  // ones are cached once the sink accepts them.
+  if (cache_key_.cache)
+    cache_key_.cache->Remove(cache_key_.peer_id);
+  fell_back_ = true;
+  Resend();
+  return true;
 }
 
-CapNegotiationState::CapNegotiationState(const InitParams &init_params)
+CapNegotiationState::CapNegotiationState(
+    const InitParams &init_params,
+    const CapabilityCacheKey& cache_key,
+    VideoFormatCandidates& video_candidates)
   : MessageSequenceHandler(init_params) {
-  AddSequencedHandler(make_ptr(new M3Handler(init_params)));
-  AddSequencedHandler(make_ptr(new M4Handler(init_params)));
+  AddSequencedHandler(make_ptr(
+      new M3Handler(init_params, cache_key, video_candidates)));
+  AddSequencedHandler(make_ptr(
+      new M4Handler(init_params, cache_key, video_candidates)));
 }
 
 CapNegotiationState::~CapNegotiationState() {
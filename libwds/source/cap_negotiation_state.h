@@ -22,16 +22,45 @@
 #ifndef LIBWDS_SOURCE_CAP_NEGOTIATION_STATE_H_
 #define LIBWDS_SOURCE_CAP_NEGOTIATION_STATE_H_
 
+#include <string>
+#include <vector>
+
 #include "libwds/common/message_handler.h"
+#include "libwds/public/video_format.h"
 
 namespace wds {
+
+class CapabilityCache;
+
 namespace source {
 
+// The cache keeping the formats negotiated with the sink,
+// see Source::SetCapabilityCache.
+struct CapabilityCacheKey {
+  CapabilityCache* cache;
+  std::string peer_id;
+};
+
+// The video formats supported by the sink (from the M3 reply), the
+// rejected ones are removed when the sink replies to M4 with an error.
+// |use_h265| is set while the H.265 format is offered instead.
+// |capabilities_digest| identifies the sink capabilities in the cache.
+// Owned by the state machine, the streaming state checks the codec.
+struct VideoFormatCandidates {
+  NativeVideoFormat native_format;
+  std::vector<H264VideoCodec> codecs;
+  int rejected;
+  bool use_h265;
+  uint64_t capabilities_digest;
+};
+
 // Capability negotiation state for RTSP source.
 // Includes M3 and M4 messages handling
 class CapNegotiationState : public MessageSequenceHandler {
  public:
-  CapNegotiationState(const InitParams& init_params);
+  CapNegotiationState(const InitParams& init_params,
+                      const CapabilityCacheKey& cache_key,
+                      VideoFormatCandidates& video_candidates);
   ~CapNegotiationState() override;
 };
 
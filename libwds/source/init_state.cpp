@@ -39,6 +39,7 @@ class M1Handler final : public SequencedMessageSender {
   std::unique_ptr<Message> CreateMessage() override {
     rtsp::Options* options = new rtsp::Options("*");
     options->header().set_cseq(sender_->GetNextCSeq());
+    options->set_id(Request::M1);
     options->header().set_require_wfd_support(true);
     return std::unique_ptr<Message>(options);
   }
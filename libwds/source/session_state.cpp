@@ -44,6 +44,7 @@ class M5Handler final : public SequencedMessageSender {
   std::unique_ptr<Message> CreateMessage() override {
     rtsp::SetParameter* set_param = new rtsp::SetParameter("rtsp://localhost/wfd1.0");
     set_param->header().set_cseq(sender_->GetNextCSeq());
+    set_param->set_id(Request::M5);
     auto payload = new rtsp::PropertyMapPayload();
     payload->AddProperty(
         std::shared_ptr<rtsp::Property>(new rtsp::TriggerMethod(rtsp::TriggerMethod::SETUP)));
@@ -92,12 +93,22 @@ M7Handler::M7Handler(const InitParams& init_params)
   : MessageReceiver<Request::M7>(init_params) {
 }
 
-std::unique_ptr<Reply> M7Handler::HandleMessage(
-    Message* message) {
-  if (!manager_->IsPaused())
-    return std::unique_ptr<Reply>(new Reply(rtsp::STATUS_NotAcceptable));
-  manager_->Play();
-  return std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK));
+void M7Handler::HandleMessageAsync(Message* message,
+                                   const ReplyCallback& reply_callback) {
+  AwaitMediaCall(Request::M7, "IsPaused",
+      [this] { return manager_->IsPausedAsync(); },
+      [this, reply_callback](bool paused) {
+    if (!paused) {
+      reply_callback(std::unique_ptr<Reply>(new Reply(rtsp::STATUS_NotAcceptable)));
+      return;
+    }
+    AwaitMediaCall(Request::M7, "Play",
+        [this] { return manager_->PlayAsync(); },
+        [reply_callback](bool success) {
+      reply_callback(success ? std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK))
+                             : nullptr);
+    });
+  });
 }
 
 M16Sender::M16Sender(const InitParams& init_params)
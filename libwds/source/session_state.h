@@ -41,8 +41,8 @@ class M7Handler final : public MessageReceiver<rtsp::Request::M7> {
   M7Handler(const InitParams& init_params);
 
  private:
-  std::unique_ptr<rtsp::Reply> HandleMessage(
-      rtsp::Message* message) override;
+  void HandleMessageAsync(rtsp::Message* message,
+                          const ReplyCallback& reply_callback) override;
 };
 
 class M16Sender final : public OptionalMessageSender<rtsp::Request::M16> {
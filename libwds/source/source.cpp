@@ -25,12 +25,20 @@
 #include "libwds/source/init_state.h"
 #include "libwds/source/streaming_state.h"
 #include "libwds/source/session_state.h"
+#include "libwds/common/log_scope.h"
 #include "libwds/common/message_handler.h"
+#include "libwds/common/output_batch.h"
+#include "libwds/common/stats_recorder.h"
+#include "libwds/common/timeline.h"
+#include "libwds/common/tracepoints.h"
 #include "libwds/common/rtsp_input_handler.h"
 #include "libwds/public/wds_export.h"
+#include "libwds/rtsp/avformatchangetiming.h"
 #include "libwds/rtsp/getparameter.h"
 #include "libwds/rtsp/setparameter.h"
 #include "libwds/rtsp/triggermethod.h"
+#include "libwds/rtsp/videoformats.h"
+#include "libwds/public/capability_cache.h"
 #include "libwds/public/media_manager.h"
 
 namespace wds {
@@ -88,14 +96,19 @@ bool InitializeRequestId(Request* request) {
 
 class SourceStateMachine : public MessageSequenceHandler {
  public:
-   SourceStateMachine(const InitParams& init_params, unsigned& timer_id)
-     : MessageSequenceHandler(init_params) {
+   SourceStateMachine(const InitParams& init_params, unsigned& timer_id,
+                      const source::CapabilityCacheKey& cache_key)
+     : MessageSequenceHandler(init_params),
+       video_candidates_() {
      MessageHandlerPtr m16_sender = make_ptr(new source::M16Sender(init_params));
      AddSequencedHandler(make_ptr(new source::InitState(init_params)));
-     AddSequencedHandler(make_ptr(new source::CapNegotiationState(init_params)));
+     AddSequencedHandler(make_ptr(new source::CapNegotiationState(init_params, cache_key, video_candidates_)));
      AddSequencedHandler(make_ptr(new source::SessionState(init_params, timer_id, m16_sender)));
-     AddSequencedHandler(make_ptr(new source::StreamingState(init_params, m16_sender)));
+     AddSequencedHandler(make_ptr(new source::StreamingState(init_params, m16_sender, video_candidates_)));
    }
+
+ private:
+  source::VideoFormatCandidates video_candidates_;
 };
 
 class SourceImpl final : public Source, public RTSPInputHandler, public MessageHandler::Observer {
@@ -110,6 +123,11 @@ class SourceImpl final : public Source, public RTSPInputHandler, public MessageH
   bool Teardown() override;
   bool Play() override;
   bool Pause() override;
+  void SetLogHandler(SessionLogFunction func, void* user_data) override;
+  PeerStats GetStats() const override;
+  void SetCapabilityCache(CapabilityCache* cache,
+                          const std::string& peer_id) override;
+  bool ChangeVideoFormat(const H264VideoFormat& format) override;
 
   // public MessageHandler::Observer
   void OnCompleted(MessageHandlerPtr handler) override;
@@ -126,38 +144,77 @@ class SourceImpl final : public Source, public RTSPInputHandler, public MessageH
   void ResetAndTeardownMedia();
 
   unsigned keep_alive_timer_;
+  StatsRecorder stats_;
+  BufferedDelegate output_;
+  TimelineRecorder timeline_;
+  source::CapabilityCacheKey capability_cache_key_;
   std::shared_ptr<SourceStateMachine> state_machine_;
   Delegate* delegate_;
   SourceMediaManager* media_manager_;
   Peer::Observer* observer_;
+  SessionLogFunction log_func_;
+  void* log_user_data_;
 };
 
 SourceImpl::SourceImpl(Delegate* delegate, SourceMediaManager* mng, Peer::Observer* observer)
-  : keep_alive_timer_(0),
-    state_machine_(new SourceStateMachine({delegate, mng, this}, keep_alive_timer_)),
+  : RTSPInputHandler(this, &stats_),
+    keep_alive_timer_(0),
+    output_(delegate, &stats_, this),
+    timeline_(observer),
+    capability_cache_key_{nullptr, std::string()},
+    state_machine_(new SourceStateMachine(
+        {&output_, mng, this, &timeline_, &stats_, this}, keep_alive_timer_,
+        capability_cache_key_)),
     delegate_(delegate),
     media_manager_(mng),
-    observer_(observer) {
+    observer_(observer),
+    log_func_(nullptr),
+    log_user_data_(nullptr) {
 }
 
 void SourceImpl::Start() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  timeline_.Record(TimelineEvent::SessionStarted, Request::UNKNOWN, 0);
+  // Overlap building the media stream with the capability exchange.
+  NegotiatedFormats formats;
+  if (capability_cache_key_.cache &&
+      capability_cache_key_.cache->Lookup(capability_cache_key_.peer_id,
+                                          &formats)) {
+    WDS_TRACE3(media__call__entry, static_cast<Peer*>(this), Request::UNKNOWN,
+               "PrepareMedia");
+    media_manager_->PrepareMedia(formats);
+    WDS_TRACE3(media__call__return, static_cast<Peer*>(this),
+               Request::UNKNOWN, "PrepareMedia");
+  }
   state_machine_->Start();
 }
 
 void SourceImpl::Reset() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   state_machine_->Reset();
   delegate_->ReleaseTimer(keep_alive_timer_);
 }
 
 void SourceImpl::RTSPDataReceived(const std::string& message) {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  stats_.CountBytesReceived(message.size());
   AddInput(message);
 }
 
 void SourceImpl::OnTimerEvent(unsigned timer_id) {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  WDS_TRACE2(timer__fire, static_cast<Peer*>(this), timer_id);
   if (keep_alive_timer_ == timer_id)
     SendKeepAlive();
-  else if (state_machine_->HandleTimeoutEvent(timer_id) && observer_)
-    observer_->ErrorOccurred(TimeoutError);
+  else if (state_machine_->HandleTimeoutEvent(timer_id)) {
+    stats_.CountTimeout();
+    if (observer_)
+      observer_->ErrorOccurred(TimeoutError);
+  }
 }
 
 void SourceImpl::SendKeepAlive() {
@@ -172,6 +229,8 @@ void SourceImpl::SendKeepAlive() {
   keep_alive_timer_ =
       delegate_->CreateTimer(kDefaultKeepAliveTimeout - kDefaultTimeoutValue);
   assert(keep_alive_timer_);
+  WDS_TRACE3(timer__create, static_cast<Peer*>(this), keep_alive_timer_,
+             kDefaultKeepAliveTimeout - kDefaultTimeoutValue);
 }
 
 namespace  {
@@ -188,9 +247,24 @@ std::unique_ptr<Message> CreateM5(int send_cseq, rtsp::TriggerMethod::Method met
   return std::move(set_param);
 }
 
+std::unique_ptr<Message> CreateM4(int send_cseq,
+                                  const H264VideoFormat& format) {
+  auto set_param = std::unique_ptr<Request>(
+      new rtsp::SetParameter("rtsp://localhost/wfd1.0"));
+  set_param->header().set_cseq(send_cseq);
+  auto payload = new rtsp::PropertyMapPayload();
+  payload->AddProperty(std::shared_ptr<rtsp::Property>(
+      new rtsp::VideoFormats(NativeVideoFormat(), false, {format})));
+  set_param->set_payload(std::unique_ptr<rtsp::Payload>(payload));
+  set_param->set_id(Request::M4);
+  return std::move(set_param);
+}
+
 }
 
 bool SourceImpl::Teardown() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   auto m5 = CreateM5(delegate_->GetNextCSeq(),
                      rtsp::TriggerMethod::TEARDOWN);
 
@@ -201,6 +275,8 @@ bool SourceImpl::Teardown() {
 }
 
 bool SourceImpl::Play() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   auto m5 = CreateM5(delegate_->GetNextCSeq(),
                      rtsp::TriggerMethod::PLAY);
 
@@ -211,6 +287,8 @@ bool SourceImpl::Play() {
 }
 
 bool SourceImpl::Pause() {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
   auto m5 = CreateM5(delegate_->GetNextCSeq(),
                      rtsp::TriggerMethod::PAUSE);
 
@@ -220,14 +298,54 @@ bool SourceImpl::Pause() {
   return true;
 }
 
+void SourceImpl::SetLogHandler(SessionLogFunction func, void* user_data) {
+  log_func_ = func;
+  log_user_data_ = user_data;
+}
+
+PeerStats SourceImpl::GetStats() const {
+  return stats_.Snapshot();
+}
+
+void SourceImpl::SetCapabilityCache(CapabilityCache* cache,
+                                    const std::string& peer_id) {
+  capability_cache_key_.cache = cache;
+  capability_cache_key_.peer_id = peer_id;
+}
+
+bool SourceImpl::ChangeVideoFormat(const H264VideoFormat& format) {
+  ScopedLogHandler log_scope(log_func_, log_user_data_);
+  ScopedOutputBatch output_batch(&output_);
+  auto m4 = CreateM4(delegate_->GetNextCSeq(), format);
+  if (!state_machine_->CanSend(m4.get()))
+    return false;
+
+  unsigned long long pts = 0;
+  unsigned long long dts = 0;
+  WDS_TRACE3(media__call__entry, static_cast<Peer*>(this), Request::M4,
+             "PrepareVideoFormatChange");
+  bool prepared = media_manager_->PrepareVideoFormatChange(format, &pts, &dts);
+  WDS_TRACE3(media__call__return, static_cast<Peer*>(this), Request::M4,
+             "PrepareVideoFormatChange");
+  if (!prepared)
+    return false;
+
+  rtsp::ToPropertyMapPayload(m4->payload())->AddProperty(
+      std::shared_ptr<rtsp::Property>(new rtsp::AVFormatChangeTiming(pts, dts)));
+  state_machine_->Send(std::move(m4));
+  return true;
+}
+
 void SourceImpl::OnCompleted(MessageHandlerPtr handler) {
   assert(handler == state_machine_);
+  WDS_TRACE2(handler__completed, static_cast<Peer*>(this), handler.get());
   if (observer_)
     observer_->SessionCompleted();
 }
 
 void SourceImpl::OnError(MessageHandlerPtr handler) {
   assert(handler == state_machine_);
+  WDS_TRACE2(handler__error, static_cast<Peer*>(this), handler.get());
   if (observer_)
     observer_->ErrorOccurred(UnexpectedMessageError);
 }
@@ -245,6 +363,9 @@ void SourceImpl::MessageParsed(std::unique_ptr<Message> message) {
       observer_->ErrorOccurred(UnexpectedMessageError);
     return;
   }
+  WDS_TRACE3(message__parsed, static_cast<Peer*>(this), message->cseq(),
+             message->is_request() ? ToRequest(message.get())->id()
+                                   : Request::UNKNOWN);
   state_machine_->Handle(std::move(message));
 }
 
@@ -21,10 +21,12 @@
 
 #include "libwds/source/streaming_state.h"
 
+#include "libwds/common/timeline.h"
 #include "libwds/public/media_manager.h"
 #include "libwds/source/cap_negotiation_state.h"
 #include "libwds/source/session_state.h"
 #include "libwds/rtsp/reply.h"
+#include "libwds/rtsp/videoformats.h"
 
 namespace wds {
 
@@ -41,10 +43,14 @@ class M8Handler final : public MessageReceiver<rtsp::Request::M8> {
   }
 
  private:
-  std::unique_ptr<rtsp::Reply> HandleMessage(
-      rtsp::Message* message) override {
-    manager_->Teardown();
-    return std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK));
+  void HandleMessageAsync(rtsp::Message* message,
+                          const ReplyCallback& reply_callback) override {
+    AwaitMediaCall(Request::M8, "Teardown",
+        [this] { return manager_->TeardownAsync(); },
+        [reply_callback](bool success) {
+      reply_callback(success ? std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK))
+                             : nullptr);
+    });
   }
 };
 
@@ -54,14 +60,22 @@ class M9Handler final : public MessageReceiver<Request::M9> {
     : MessageReceiver<Request::M9>(init_params) {
   }
 
-  std::unique_ptr<Reply> HandleMessage(
-      Message* message) override {
-    int response_code = rtsp::STATUS_NotAcceptable;
-    if (!manager_->IsPaused()) {
-      manager_->Pause();
-      response_code = rtsp::STATUS_OK;
-    }
-    return std::unique_ptr<Reply>(new Reply(response_code));
+  void HandleMessageAsync(Message* message,
+                          const ReplyCallback& reply_callback) override {
+    AwaitMediaCall(Request::M9, "IsPaused",
+        [this] { return manager_->IsPausedAsync(); },
+        [this, reply_callback](bool paused) {
+      if (paused) {
+        reply_callback(std::unique_ptr<Reply>(new Reply(rtsp::STATUS_NotAcceptable)));
+        return;
+      }
+      AwaitMediaCall(Request::M9, "Pause",
+          [this] { return manager_->PauseAsync(); },
+          [reply_callback](bool success) {
+        reply_callback(success ? std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK))
+                               : nullptr);
+      });
+    });
   }
 };
 
@@ -75,6 +89,107 @@ class M5Sender final : public OptionalMessageSender<Request::M5> {
   }
 };
 
+// Sends M4 with 'wfd-av-format-change-timing' to change the video format
+// while streaming, @see Source::ChangeVideoFormat.
+class VideoFormatChangeSender final : public OptionalMessageSender<Request::M4> {
+ public:
+  VideoFormatChangeSender(const InitParams& init_params,
+                          const VideoFormatCandidates& video_candidates)
+    : OptionalMessageSender<Request::M4>(init_params),
+      video_candidates_(video_candidates),
+      pending_(false),
+      cseq_(0),
+      timed_out_cseq_(0) {
+  }
+
+ private:
+  bool CanSend(Message* message) const override {
+    // The encoder is reconfigured for one change at a time.
+    if (!OptionalMessageSender<Request::M4>::CanSend(message) || pending_)
+      return false;
+    // A stream negotiated in H.265 cannot switch to an H.264 format.
+    auto payload = rtsp::ToPropertyMapPayload(message->payload());
+    return payload && !(video_candidates_.use_h265 &&
+        payload->GetProperty(rtsp::VideoFormatsPropertyType));
+  }
+
+  void Send(std::unique_ptr<Message> message) override {
+    auto payload = rtsp::ToPropertyMapPayload(message->payload());
+    auto video_formats = static_cast<rtsp::VideoFormats*>(
+        payload->GetProperty(rtsp::VideoFormatsPropertyType).get());
+    format_ = *video_formats->h264_codecs()[0].formats().begin();
+    pending_ = true;
+    cseq_ = message->cseq();
+    OptionalMessageSender<Request::M4>::Send(std::move(message));
+  }
+
+  void Reset() override {
+    pending_ = false;
+    OptionalMessageSender<Request::M4>::Reset();
+  }
+
+  // Not fatal: the stream goes on in the current format.
+  bool HandleTimeoutEvent(unsigned timer_id) override {
+    if (!OptionalMessageSender<Request::M4>::HandleTimeoutEvent(timer_id))
+      return false;
+    // Without a reply the sink is not known to expect the new format,
+    // a late reply is dropped.
+    WDS_WARNING("Sink did not reply to the video format change.");
+    if (stats_)
+      stats_->CountTimeout();
+    Reset();
+    timed_out_cseq_ = cseq_;
+    SourceMediaManager* source_manager = ToSourceMediaManager(manager_);
+    TraceMediaCall(Request::M4, "CancelVideoFormatChange", [source_manager] {
+      source_manager->CancelVideoFormatChange();
+    });
+    return false;
+  }
+
+  bool CanHandle(Message* message) const override {
+    return IsLateReply(message) ||
+           OptionalMessageSender<Request::M4>::CanHandle(message);
+  }
+
+  void Handle(std::unique_ptr<Message> message) override {
+    if (!IsLateReply(message.get())) {
+      OptionalMessageSender<Request::M4>::Handle(std::move(message));
+      return;
+    }
+    WDS_WARNING("Dropping the late reply to the video format change.");
+    timed_out_cseq_ = 0;
+  }
+
+  bool IsLateReply(Message* message) const {
+    return timed_out_cseq_ && message->is_reply() &&
+           message->cseq() == timed_out_cseq_;
+  }
+
+  bool HandleReply(Reply* reply) override {
+    pending_ = false;
+    SourceMediaManager* source_manager = ToSourceMediaManager(manager_);
+    if (reply->response_code() != rtsp::STATUS_OK) {
+      // The stream goes on in the current format.
+      WDS_WARNING("Sink rejected the video format change.");
+      TraceMediaCall(Request::M4, "CancelVideoFormatChange", [source_manager] {
+        source_manager->CancelVideoFormatChange();
+      });
+      return true;
+    }
+    TraceMediaCall(Request::M4, "ApplyVideoFormatChange", [this, source_manager] {
+      source_manager->ApplyVideoFormatChange(format_);
+    });
+    return true;
+  }
+
+  const VideoFormatCandidates& video_candidates_;
+  H264VideoFormat format_;
+  bool pending_;
+  int cseq_;
+  // CSeq of the request that timed out, 0 if none.
+  int timed_out_cseq_;
+};
+
 class M13Handler final : public MessageReceiver<Request::M13> {
  public:
   M13Handler(const InitParams& init_params)
@@ -83,13 +198,28 @@ class M13Handler final : public MessageReceiver<Request::M13> {
 
   std::unique_ptr<Reply> HandleMessage(
       Message* message) override {
-    ToSourceMediaManager(manager_)->SendIDRPicture();
+    uint64_t received_us = stats_ ? MonotonicMicroseconds() : 0;
+    MediaCompletionPtr completion =
+        TraceMediaCall(Request::M13, "SendIDRPictureAsync", [this] {
+          return ToSourceMediaManager(manager_)->SendIDRPictureAsync();
+        });
+    // The sink is not kept waiting for the picture. Unlike Await(), the
+    // measurement survives the Reset() following the reply.
+    if (stats_) {
+      std::weak_ptr<MessageHandler> weak_this = shared_from_this();
+      StatsRecorder* stats = stats_;
+      completion->Then([weak_this, stats, received_us](bool sent) {
+        if (sent && weak_this.lock())
+          stats->idr_latency().Record(MonotonicMicroseconds() - received_us);
+      });
+    }
     return std::unique_ptr<Reply>(new Reply(rtsp::STATUS_OK));
   }
 };
 
 StreamingState::StreamingState(const InitParams& init_params,
-    MessageHandlerPtr m16_sender)
+    MessageHandlerPtr m16_sender,
+    const VideoFormatCandidates& video_candidates)
   : MessageSequenceWithOptionalSetHandler(init_params) {
   AddSequencedHandler(make_ptr(new M8Handler(init_params)));
 
@@ -97,6 +227,8 @@ StreamingState::StreamingState(const InitParams& init_params,
   AddOptionalHandler(make_ptr(new M7Handler(init_params)));
   AddOptionalHandler(make_ptr(new M9Handler(init_params)));
   AddOptionalHandler(make_ptr(new M13Handler(init_params)));
+  AddOptionalHandler(make_ptr(
+      new VideoFormatChangeSender(init_params, video_candidates)));
   AddOptionalHandler(m16_sender);
 }
 
@@ -27,11 +27,14 @@
 namespace wds {
 namespace source {
 
+struct VideoFormatCandidates;
+
 // Streaming state for RTSP source.
 // Includes M8 message handling and optionally can handle M3, M4, M7, M9-M15
 class StreamingState : public MessageSequenceWithOptionalSetHandler {
  public:
-  StreamingState(const InitParams& init_params, MessageHandlerPtr m16_sender);
+  StreamingState(const InitParams& init_params, MessageHandlerPtr m16_sender,
+                 const VideoFormatCandidates& video_candidates);
   ~StreamingState() override;
 };
 
@@ -27,6 +27,7 @@
 #include <memory>
 
 #include <glib-unix.h>
+#include <sys/resource.h>
 
 #include "mirac-gst-test-source.hpp"
 #include "mirac-gst-sink.hpp"
@@ -42,6 +43,29 @@ static gboolean _sig_handler (gpointer data_ptr)
 }
 
 
+static double cpu_seconds ()
+{
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void print_encoder_stats (const MiracEncoderStats& stats, double cpu, int seconds)
+{
+    if (stats.frames == 0) {
+        std::cout << "No frames encoded" << std::endl;
+        return;
+    }
+    std::cout << "Encoded " << stats.frames << " frames in " << seconds << " s, "
+              << stats.bytes * 8 / 1000 / seconds << " kbit/s" << std::endl
+              << "Frame size: " << stats.bytes / stats.frames << " bytes average, "
+              << stats.max_frame_bytes << " bytes max" << std::endl
+              << "Encoder latency: " << stats.total_latency / stats.frames / GST_MSECOND << " ms average, "
+              << stats.max_latency / GST_MSECOND << " ms max" << std::endl
+              << "CPU: " << cpu / seconds * 100 << " %" << std::endl;
+}
+
 int main (int argc, char *argv[])
 {
     InitGlibLogging();
@@ -54,6 +78,8 @@ int main (int argc, char *argv[])
     gchar* wfd_stream_option = NULL;
     gchar* hostname_option = NULL;
     gint port = 0;
+    gchar* encoder_profile_option = NULL;
+    gint bench_seconds = 0;
     
     GOptionEntry main_entries[] =
     {
@@ -61,10 +87,12 @@ int main (int argc, char *argv[])
         { "stream", 0, 0, G_OPTION_ARG_STRING, &wfd_stream_option, "Specify WFD stream type for testsource: audio, video, both or desktop capture", "(audio|video|both|desktop)"},
         { "hostname", 0, 0, G_OPTION_ARG_STRING, &hostname_option, "Specify optional hostname or ip address to stream to or listen on", "host"},
         { "port", 0, 0, G_OPTION_ARG_INT, &port, "Specify optional UDP port number to stream to or listen on", "port"},
+        { "encoder_profile", 0, 0, G_OPTION_ARG_STRING, &encoder_profile_option, "Specify video encoder settings for testsource", "(default|low-latency|intra-refresh)"},
+        { "bench", 0, 0, G_OPTION_ARG_INT, &bench_seconds, "Encode 720p30 at 4 Mbit/s with testsource for the given time, then print the encoder frame sizes, latency and CPU use", "seconds"},
         { NULL }
     };
 
-    context = g_option_context_new ("- WFD source/sink demo application\n\nExample:\ngst-test --device=testsource --stream=both --hostname=127.0.0.1 --port=5000\ngst-test --device=sink --port=5000");
+    context = g_option_context_new ("- WFD source/sink demo application\n\nExample:\ngst-test --device=testsource --stream=both --hostname=127.0.0.1 --port=5000\ngst-test --device=sink --port=5000\ngst-test --device=testsource --stream=desktop --encoder_profile=intra-refresh --bench=10");
     g_option_context_add_main_entries (context, main_entries, NULL);
     
    if (!g_option_context_parse (context, &argc, &argv, &error)) {
@@ -88,8 +116,17 @@ int main (int argc, char *argv[])
     if (hostname_option)
         hostname = hostname_option;
 
+    MiracEncoderProfile encoder_profile;
+    bool set_encoder_profile = encoder_profile_option != NULL;
+    if (encoder_profile_option &&
+        !mirac_encoder_profile(encoder_profile_option, &encoder_profile)) {
+        WDS_ERROR ("unknown encoder profile: %s", encoder_profile_option);
+        exit (1);
+    }
+
     g_free(wfd_stream_option);
     g_free(hostname_option);
+    g_free(encoder_profile_option);
 
     gst_init (&argc, &argv);
 
@@ -98,10 +135,17 @@ int main (int argc, char *argv[])
 
     if (g_strcmp0(wfd_device_option, "testsource") == 0) {
         source_pipeline.reset(new MiracGstTestSource(wfd_stream, hostname, port));
+        if (bench_seconds > 0 || set_encoder_profile) {
+            MiracVideoFormat format = {1280, 720, 30, "", "", 4000};
+            source_pipeline->SetVideoFormat(format, encoder_profile);
+        }
+        if (bench_seconds > 0)
+            source_pipeline->EnableEncoderStats();
         source_pipeline->SetState(GST_STATE_PLAYING);
         WDS_LOG("Source UDP port: %d", source_pipeline->UdpSourcePort());
     } else if (g_strcmp0(wfd_device_option, "sink") == 0) {
         sink_pipeline.reset(new MiracGstSink(hostname, port));
+        sink_pipeline->Play([](bool) {});
         WDS_LOG("Listening on port %d", sink_pipeline->sink_udp_port());
     }
 
@@ -110,9 +154,16 @@ int main (int argc, char *argv[])
     ml = g_main_loop_new(NULL, TRUE);
     g_unix_signal_add(SIGINT, _sig_handler, ml);
     g_unix_signal_add(SIGTERM, _sig_handler, ml);
+    if (source_pipeline && bench_seconds > 0)
+        g_timeout_add_seconds(bench_seconds, _sig_handler, ml);
 
+    double cpu = cpu_seconds();
     g_main_loop_run(ml);
 
+    if (source_pipeline && bench_seconds > 0)
+        print_encoder_stats(source_pipeline->GetEncoderStats(),
+                            cpu_seconds() - cpu, bench_seconds);
+
     g_main_loop_unref(ml);
     
     return 0;
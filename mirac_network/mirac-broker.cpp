@@ -68,13 +68,30 @@ gboolean MiracBroker::try_connect (gpointer data_ptr)
     return false;
 }
 
+/* static C callback wrapper */
+gboolean MiracBroker::close_cb (gpointer data_ptr)
+{
+    auto broker = static_cast<MiracBroker*> (data_ptr);
+    broker->close_id_ = 0;
+    if (broker->io_channel_) {
+        broker->io_channel_->close();
+        broker->io_channel_.reset();
+    }
+    broker->connection(NULL);
+    if (broker->connection_dropped_)
+        broker->connection_lost();
+    else if (broker->observer_)
+        broker->observer_->on_session_closed(broker);
+    return G_SOURCE_REMOVE;
+}
+
 gboolean MiracBroker::send_cb (gint fd, GIOCondition condition)
 {
     try {
         if (!connection_->Send())
             return G_SOURCE_CONTINUE;
     } catch (const MiracConnectionLostException &exception) {
-        on_connection_failure(CONNECTION_LOST);
+        connection_lost();
     } catch (const std::exception &x) {
         WDS_WARNING("exception: %s", x.what());
     }
@@ -91,16 +108,56 @@ gboolean MiracBroker::receive_cb (gint fd, GIOCondition condition)
             got_message (msg);
         }
     } catch (const MiracConnectionLostException &exception) {
-        on_connection_failure(CONNECTION_LOST);
+        connection_lost();
         return G_SOURCE_REMOVE;
     }
     return G_SOURCE_CONTINUE;
 }
 
+void MiracBroker::on_io_message(const std::string& data)
+{
+    WDS_VLOG("Received RTSP message:\n%s", data.c_str());
+    got_message(data);
+}
+
+void MiracBroker::on_io_closed()
+{
+    connection_lost();
+}
+
+void MiracBroker::use_io_thread(MiracIOThread *io_thread)
+{
+    if (!connection_ || io_channel_)
+        return;
+
+    peer_address_ = connection_->GetPeerAddress();
+    remove_sources(&connection_source_ptr_);
+    io_channel_ = io_thread->attach(connection_.release(), context_, this);
+}
+
+void MiracBroker::close_session()
+{
+    if (close_id_)
+        return;
+    GSource* source = g_idle_source_new();
+    g_source_set_callback(source, close_cb, this, NULL);
+    close_id_ = attach_source(source);
+}
+
+void MiracBroker::connection_lost()
+{
+    on_connection_failure(CONNECTION_LOST);
+    if (observer_)
+        observer_->on_session_closed(this);
+}
+
 gboolean MiracBroker::listen_cb (gint fd, GIOCondition condition)
 {
     try {
-        connection(network_->Accept());
+        MiracNetwork* accepted = network_->Accept();
+        if (!accepted)
+            return G_SOURCE_CONTINUE;
+        connection(accepted);
         WDS_LOG("connection from: %s", connection_->GetPeerAddress().c_str());
         on_connected();
     } catch (const std::exception &x) {
@@ -127,28 +184,58 @@ gboolean MiracBroker::connect_cb (gint fd, GIOCondition condition)
         if (elapsed + connect_wait_ > connect_timeout_) {
             on_connection_failure(CONNECTION_TIMEOUT);
         } else {
-            connect_wait_id_ = g_timeout_add (connect_wait_, try_connect, this);
+            GSource* source = g_timeout_source_new(connect_wait_);
+            g_source_set_callback(source, try_connect, this, NULL);
+            connect_wait_id_ = attach_source(source);
         }
     }
     return G_SOURCE_REMOVE;
 }
 
+uint MiracBroker::attach_source(GSource *source)
+{
+    uint id = g_source_attach(source, context_);
+    g_source_unref(source);
+    return id;
+}
+
+void MiracBroker::add_fd_watch(gint fd, GIOCondition condition,
+                               GUnixFDSourceFunc func, MiracBroker **data_ptr)
+{
+    GSource *source = g_unix_fd_source_new(fd, condition);
+    g_source_set_callback(source, reinterpret_cast<GSourceFunc>(func),
+                          data_ptr, NULL);
+    attach_source(source);
+}
+
+void MiracBroker::remove_source(uint id)
+{
+    GSource *source = g_main_context_find_source_by_id(context_, id);
+    if (source)
+        g_source_destroy(source);
+}
+
+void MiracBroker::remove_sources(MiracBroker **data_ptr)
+{
+    GSource *source;
+    while ((source = g_main_context_find_source_by_user_data(context_, data_ptr)))
+        g_source_destroy(source);
+}
+
 void MiracBroker::network(MiracNetwork *connection)
 {
-    while (g_source_remove_by_user_data(&network_source_ptr_))
-        ;
+    remove_sources(&network_source_ptr_);
     network_.reset(connection);
 }
 
 void MiracBroker::connection(MiracNetwork *connection)
 {
-    while (g_source_remove_by_user_data(&connection_source_ptr_))
-        ;
+    remove_sources(&connection_source_ptr_);
     connection_.reset(connection);
 
     if (connection_)
-        g_unix_fd_add(connection_->GetHandle(), G_IO_IN,
-                      receive_cb, &connection_source_ptr_);
+        add_fd_watch(connection_->GetHandle(), G_IO_IN,
+                     receive_cb, &connection_source_ptr_);
 }
 
 void MiracBroker::try_connect()
@@ -159,11 +246,11 @@ void MiracBroker::try_connect()
     network(new MiracNetwork());
 
     if (network_->Connect(peer_address_.c_str(), peer_port_.c_str())) {
-        g_unix_fd_add(network_->GetHandle(), G_IO_OUT,
-                      MiracBroker::send_cb, &network_source_ptr_);
+        add_fd_watch(network_->GetHandle(), G_IO_OUT,
+                     MiracBroker::send_cb, &network_source_ptr_);
     } else {
-        g_unix_fd_add(network_->GetHandle(), G_IO_OUT,
-                      MiracBroker::connect_cb, &network_source_ptr_);
+        add_fd_watch(network_->GetHandle(), G_IO_OUT,
+                     MiracBroker::connect_cb, &network_source_ptr_);
     }
 }
 
@@ -174,11 +261,20 @@ unsigned short MiracBroker::get_host_port() const
 
 std::string MiracBroker::get_peer_address() const
 {
+    if (!connection_)
+        return peer_address_;
     return connection_->GetPeerAddress();
 }
 
 MiracBroker::MiracBroker (const std::string& listen_port):
-    connect_timer_(NULL)
+    context_(g_main_context_ref_thread_default()),
+    send_cseq_(0),
+    observer_(NULL),
+    connect_timer_(NULL),
+    connect_wait_id_(0),
+    connect_timeout_(0),
+    close_id_(0),
+    connection_dropped_(false)
 {
     network_source_ptr_ = this;
     connection_source_ptr_ = this;
@@ -186,14 +282,20 @@ MiracBroker::MiracBroker (const std::string& listen_port):
     network(new MiracNetwork());
 
     network_->Bind(NULL, listen_port.c_str());
-    g_unix_fd_add(network_->GetHandle(), G_IO_IN,
-                  MiracBroker::listen_cb, &network_source_ptr_);
+    add_fd_watch(network_->GetHandle(), G_IO_IN,
+                 MiracBroker::listen_cb, &network_source_ptr_);
 }
 
 MiracBroker::MiracBroker(const std::string& peer_address, const std::string& peer_port, uint timeout):
+    context_(g_main_context_ref_thread_default()),
+    send_cseq_(0),
+    observer_(NULL),
     peer_address_(peer_address),
     peer_port_(peer_port),
-    connect_timeout_(timeout)
+    connect_wait_id_(0),
+    connect_timeout_(timeout),
+    close_id_(0),
+    connection_dropped_(false)
 {
     network_source_ptr_ = this;
     connection_source_ptr_ = this;
@@ -201,8 +303,28 @@ MiracBroker::MiracBroker(const std::string& peer_address, const std::string& pee
     try_connect();
 }
 
+MiracBroker::MiracBroker(MiracNetwork* connection):
+    context_(g_main_context_ref_thread_default()),
+    send_cseq_(0),
+    observer_(NULL),
+    connect_timer_(NULL),
+    connect_wait_id_(0),
+    connect_timeout_(0),
+    close_id_(0),
+    connection_dropped_(false)
+{
+    network_source_ptr_ = this;
+    connection_source_ptr_ = this;
+
+    /* on_connected() is left to the owner: it cannot be
+     * dispatched to the subclass from here */
+    this->connection(connection);
+}
+
 MiracBroker::~MiracBroker ()
 {
+    if (io_channel_)
+        io_channel_->close();
     network(NULL);
     connection(NULL);
 
@@ -212,19 +334,38 @@ MiracBroker::~MiracBroker ()
     }
 
     if (connect_wait_id_ > 0) {
-        g_source_remove(connect_wait_id_);
+        remove_source(connect_wait_id_);
         connect_wait_id_ = 0;
     }
+    if (close_id_ > 0) {
+        remove_source(close_id_);
+        close_id_ = 0;
+    }
     while (!timers_.empty())
-        g_source_remove(timers_.front());
+        remove_source(timers_.front());
+
+    g_main_context_unref(context_);
 }
 
 void MiracBroker::SendRTSPData(const std::string& data) {
   WDS_VLOG("Sending RTSP message:\n%s", data.c_str());
 
+  if (connection_dropped_)
+      return;
+
+  if (io_channel_) {
+      if (!io_channel_->send(data)) {
+          /* called by the peer, which must not be torn down from here */
+          WDS_WARNING("I/O thread send queue full, dropping connection");
+          connection_dropped_ = true;
+          close_session();
+      }
+      return;
+  }
+
   if (connection_ && !connection_->Send(data))
-      g_unix_fd_add(connection_->GetHandle(), G_IO_OUT,
-                    send_cb, &connection_source_ptr_);
+      add_fd_watch(connection_->GetHandle(), G_IO_OUT,
+                   send_cb, &connection_source_ptr_);
 }
 
 std::string MiracBroker::GetLocalIPAddress() const {
@@ -252,12 +393,9 @@ void MiracBroker::OnTimeout(uint timer_id) {
 
 uint MiracBroker::CreateTimer(int seconds) {
   TimerCallbackData* data = new TimerCallbackData(this);
-  uint timer_id = g_timeout_add_seconds_full(
-                        G_PRIORITY_DEFAULT,
-                        seconds,
-                        on_timeout,
-                        data,
-                        on_timeout_remove);
+  GSource* source = g_timeout_source_new_seconds(seconds);
+  g_source_set_callback(source, on_timeout, data, on_timeout_remove);
+  uint timer_id = attach_source(source);
   if (timer_id > 0) {
     data->timer_id_ = timer_id;
     timers_.push_back(timer_id);
@@ -272,12 +410,11 @@ void MiracBroker::ReleaseTimer(uint timer_id) {
   if (timer_id > 0) {
     auto it = std::find(timers_.begin(), timers_.end(), timer_id);
     if (it != timers_.end() )
-      g_source_remove(*it);
+      remove_source(*it);
   }
 }
 
 int MiracBroker::GetNextCSeq(int* initial_peer_cseq) const {
-  static int send_cseq_;
   ++send_cseq_;
   if (initial_peer_cseq && send_cseq_ == *initial_peer_cseq)
     send_cseq_ *= 2;
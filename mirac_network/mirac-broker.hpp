@@ -24,19 +24,49 @@
 #define MIRAC_BROKER_HPP
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <memory>
 #include <map>
 #include <vector>
 
 #include "libwds/public/peer.h"
+#include "mirac-io-thread.hpp"
 #include "mirac-network.hpp"
 
-class MiracBroker : public wds::Peer::Delegate
+class MiracBroker : public wds::Peer::Delegate, private MiracIOChannel::Delegate
 {
     public:
+        class Observer {
+            public:
+                /* called from the broker's own event callback: the
+                 * broker must not be destroyed before it returns */
+                virtual void on_session_closed(MiracBroker *broker) {}
+
+            protected:
+                virtual ~Observer() {}
+        };
+
         MiracBroker (const std::string& listen_port);
         MiracBroker(const std::string& peer_address, const std::string& peer_port, uint timeout = 3000);
+        /* takes ownership of an already accepted connection,
+         * see MiracSessionManager */
+        explicit MiracBroker(MiracNetwork* connection);
+
+        /* all the constructors attach the broker's event sources and
+         * timers to the thread-default main context of the calling
+         * thread; the broker must only be used from the thread
+         * running that context */
         virtual ~MiracBroker ();
+
+        void set_observer(Observer* observer) {
+            observer_ = observer;
+        }
+
+        /* moves the socket reads and writes of the established
+         * connection to io_thread, messages are still handled on
+         * the broker's own context */
+        void use_io_thread(MiracIOThread* io_thread);
+
         unsigned short get_host_port() const;
         std::string get_peer_address() const;
         virtual wds::Peer* Peer() const = 0;
@@ -59,12 +89,20 @@ class MiracBroker : public wds::Peer::Delegate
         virtual void on_connected() {};
         virtual void on_connection_failure(ConnectionFailure failure) {};
 
+        /* closes the connection and reports the session closed to the
+         * observer from an idle callback, so that it can be called from
+         * within the peer */
+        void close_session();
+
     private:
+        friend class MiracSessionManager;
+
         static gboolean send_cb (gint fd, GIOCondition condition, gpointer data_ptr);
         static gboolean receive_cb (gint fd, GIOCondition condition, gpointer data_ptr);
         static gboolean listen_cb (gint fd, GIOCondition condition, gpointer data_ptr);
         static gboolean connect_cb (gint fd, GIOCondition condition, gpointer data_ptr);
         static gboolean try_connect(gpointer data_ptr);
+        static gboolean close_cb(gpointer data_ptr);
         static void on_timeout_remove(gpointer user_data);
 
         gboolean send_cb (gint fd, GIOCondition condition);
@@ -73,8 +111,19 @@ class MiracBroker : public wds::Peer::Delegate
         gboolean connect_cb (gint fd, GIOCondition condition);
         void try_connect();
 
+        uint attach_source(GSource *source);
+        void add_fd_watch(gint fd, GIOCondition condition,
+                          GUnixFDSourceFunc func, MiracBroker **data_ptr);
+        void remove_source(uint id);
+        void remove_sources(MiracBroker **data_ptr);
+
+        // MiracIOChannel::Delegate
+        void on_io_message(const std::string& data) override;
+        void on_io_closed() override;
+
         void handle_body(const std::string msg);
         void handle_header(const std::string msg);
+        void connection_lost();
 
         void network(MiracNetwork* connection);
         std::unique_ptr<MiracNetwork> network_;
@@ -83,8 +132,12 @@ class MiracBroker : public wds::Peer::Delegate
         void connection(MiracNetwork* connection);
         std::unique_ptr<MiracNetwork> connection_;
         MiracBroker *connection_source_ptr_;
+        std::shared_ptr<MiracIOChannel> io_channel_;
 
+        GMainContext *context_;
         std::vector<uint> timers_;
+        mutable int send_cseq_;
+        Observer* observer_;
 
         std::string peer_address_;
         std::string peer_port_;
@@ -92,6 +145,9 @@ class MiracBroker : public wds::Peer::Delegate
         GTimer *connect_timer_;
         uint connect_wait_id_;
         uint connect_timeout_;
+        uint close_id_;
+        /* the connection is closed as lost by close_cb() */
+        bool connection_dropped_;
         static const uint connect_wait_ = 200;
 };
 
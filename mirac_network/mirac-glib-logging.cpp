@@ -22,6 +22,8 @@
 #include "mirac-glib-logging.hpp"
 
 #include <glib.h>
+#include <glib-unix.h>
+#include <cstring>
 
 namespace {
 
@@ -53,6 +55,19 @@ void MiracGlibError(const char* format, ...) {
     va_end(va);
 }
 
+void MiracGlibDump(void* /*user_data*/, wds::LogLevel level,
+                   const char* message) {
+    static const char* names[] = { "ERROR", "WARNING", "INFO", "VERBOSE" };
+    g_printerr("%s: %s\n", names[level], message);
+}
+
+gboolean dump_ring_buffer(gpointer /*data_ptr*/) {
+    g_printerr("--- log ring buffer ---\n");
+    wds::LogSystem::dump_ring_buffer(&MiracGlibDump, NULL);
+    g_printerr("--- end of log ring buffer ---\n");
+    return G_SOURCE_CONTINUE;
+}
+
 }  // namespace
 
 void InitGlibLogging() {
@@ -60,5 +75,18 @@ void InitGlibLogging() {
     wds::LogSystem::set_vlog_func(&MiracGlibVLog);
     wds::LogSystem::set_warning_func(&MiracGlibWarning);
     wds::LogSystem::set_error_func(&MiracGlibError);
+
+    /* the default GLib handler drops the "rtsp" debug messages unless
+     * G_MESSAGES_DEBUG asks for them: skip formatting them at all */
+    const gchar* debug_domains = g_getenv("G_MESSAGES_DEBUG");
+    if (!debug_domains || (!strstr(debug_domains, "rtsp") &&
+                           !strstr(debug_domains, "all")))
+        wds::LogSystem::set_log_level(wds::LogLevelInfo);
+}
+
+void EnableLogRingBuffer(gsize size)
+{
+    wds::LogSystem::set_ring_buffer(size);
+    g_unix_signal_add(SIGUSR1, dump_ring_buffer, NULL);
 }
 
@@ -23,9 +23,15 @@
 #ifndef MIRAC_LOGGING_HPP
 #define MIRAC_LOGGING_HPP
 
+#include <glib.h>
+
 #include "libwds/public/logging.h"
 
 void InitGlibLogging();
 
+/* keeps the last |size| bytes of log messages, verbose ones included,
+ * in memory and prints them to stderr on SIGUSR1 */
+void EnableLogRingBuffer(gsize size);
+
 #endif  // MIRAC_LOGGING_HPP
 
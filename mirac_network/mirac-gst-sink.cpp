@@ -24,97 +24,347 @@
 #include "libwds/public/logging.h"
 
 #include <cassert>
+#include <cstring>
 
-void _set_udp_caps(GstElement *playbin, GstElement *source, gpointer    user_data)
+/* the decoders are tried in this order */
+static const char* const h264_decoders[] = {"avdec_h264", "vaapih264dec", "openh264dec", NULL};
+static const char* const h265_decoders[] = {"avdec_h265", "libde265dec", "vaapih265dec", NULL};
+
+static const char* find_video_decoder (wfd_video_codec_t video_codec)
 {
-    GstCaps* caps = gst_caps_new_simple ("application/x-rtp",
-        "media", G_TYPE_STRING, "video",
-        "clock-rate", G_TYPE_INT, 1,
-        "encoding-name", G_TYPE_STRING, "MP2T",
-        NULL);
+    const char* const* names = video_codec == WFD_VIDEO_H265 ? h265_decoders : h264_decoders;
+    for (; *names; ++names) {
+        GstElementFactory *factory = gst_element_factory_find (*names);
+        if (factory) {
+            gst_object_unref (factory);
+            return *names;
+        }
+    }
+    return NULL;
+}
 
-    g_object_set(source, "caps", caps, NULL);
-    gst_caps_unref(caps);
+bool MiracGstSink::IsVideoCodecAvailable(wfd_video_codec_t video_codec)
+{
+    return find_video_decoder (video_codec) != NULL;
 }
 
-MiracGstSink::MiracGstSink (std::string hostname, int port) {
-  // todo (shalamov): move out pipeline initialization
-  // from constructor, otherwise we can't check error conditions
-  std::string gst_pipeline;
+MiracGstSink::MiracGstSink (std::string hostname, int port)
+  : hostname(hostname),
+    video_codec(WFD_VIDEO_H264),
+    gst_elem(NULL),
+    pending_state(GST_STATE_VOID_PENDING),
+    damage_interval(0),
+    last_damage_time(0),
+    first_frame_pending(false),
+    first_frame_time(-1),
+    loss_posted(false),
+    stream_restarted(false),
+    first_frame_timer_start(0) {
+  create_pipeline(port);
+}
 
-  std::string url =  "udp://" + (!hostname.empty() ? hostname  : "::") + (port > 0 ? ":" + std::to_string(port) : ":");
-  gst_pipeline = "playbin uri=" + url;
+void MiracGstSink::create_pipeline(int port) {
+  const char* decoder = find_video_decoder (video_codec);
+  if (decoder == NULL) {
+    WDS_ERROR("No %s decoder", video_codec == WFD_VIDEO_H265 ? "H.265" : "H.264");
+    return;
+  }
+  std::string video_caps = video_codec == WFD_VIDEO_H265 ? "video/x-h265" : "video/x-h264";
+  std::string parser = video_codec == WFD_VIDEO_H265 ? "h265parse" : "h264parse";
+
+  /* linked up front rather than autoplugged by playbin once the stream
+   * arrives; the audio branch is added by demux_pad_added_cb() */
+  std::string gst_pipeline =
+      "udpsrc name=src address=" + (!hostname.empty() ? hostname : "::") +
+      " port=" + std::to_string(port > 0 ? port : 0) +
+      " caps=\"application/x-rtp,media=video,clock-rate=90000,encoding-name=MP2T\" ! "
+      "rtpmp2tdepay ! tsdemux name=demux "
+      "demux. ! " + video_caps + " ! " + parser + " ! " + decoder + " ! "
+      "queue ! videoconvert ! autovideosink name=videosink";
 
   GError *err = NULL;
   gst_elem = gst_parse_launch(gst_pipeline.c_str(), &err);
   if (err != NULL) {
       WDS_ERROR("Cannot initialize gstreamer pipeline: [%s] %s", g_quark_to_string(err->domain), err->message);
+      g_error_free(err);
   }
+  if (gst_elem == NULL)
+      return;
+
+  GstBus* bus = gst_pipeline_get_bus (GST_PIPELINE (gst_elem));
+  gst_bus_add_watch (bus, bus_cb, this);
+  gst_object_unref (bus);
 
+  GstElement *demux = gst_bin_get_by_name (GST_BIN (gst_elem), "demux");
+  g_signal_connect(demux, "pad-added", G_CALLBACK(demux_pad_added_cb), this);
+  gst_object_unref (demux);
+
+  stream_monitor.Reset();
+  GstElement *source = gst_bin_get_by_name (GST_BIN (gst_elem), "src");
+  GstPad *pad = gst_element_get_static_pad (source, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, udp_packet_cb, this, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (source);
+
+  /* binds the port */
+  gst_element_set_state (gst_elem, GST_STATE_READY);
+}
+
+void MiracGstSink::destroy_pipeline() {
+  if (state_callback)
+    complete_state_change(false);
   if (gst_elem) {
-      GstBus* bus = gst_pipeline_get_bus (GST_PIPELINE (gst_elem));
-      bus_watch_id = gst_bus_add_watch (bus, mirac_gstbus_callback, this);
-      gst_object_unref (bus);
+    gst_element_set_state (gst_elem, GST_STATE_NULL);
+    /* the watch is in the thread-default context of the pipeline */
+    GstBus* bus = gst_pipeline_get_bus (GST_PIPELINE (gst_elem));
+    gst_bus_remove_watch (bus);
+    gst_object_unref (bus);
+    gst_object_unref (GST_OBJECT (gst_elem));
+    gst_elem = NULL;
+  }
+  loss_posted = false;
+  first_frame_pending = false;
+}
 
-      g_signal_connect(gst_elem, "source-setup", G_CALLBACK(_set_udp_caps), NULL);
+void MiracGstSink::Prepare(wfd_video_codec_t codec) {
+  if (codec != video_codec || gst_elem == NULL) {
+    /* the sink has told the source its port already */
+    int port = sink_udp_port();
+    GstState state = gst_elem ? GST_STATE (gst_elem) : GST_STATE_NULL;
+    destroy_pipeline();
+    video_codec = codec;
+    create_pipeline(port);
+    if (gst_elem && state == GST_STATE_PLAYING)
       gst_element_set_state (gst_elem, GST_STATE_PLAYING);
   }
+  if (gst_elem && GST_STATE (gst_elem) != GST_STATE_PLAYING) {
+    /* a live pipeline does not preroll, but all of its elements are
+     * set up and wait for the first packet */
+    gst_element_set_state (gst_elem, GST_STATE_PAUSED);
+  }
+}
+
+void MiracGstSink::demux_pad_added_cb (GstElement *demux, GstPad *pad, gpointer data) {
+  auto sink = static_cast<MiracGstSink*> (data);
+  /* the video pad is linked by the pipeline description */
+  if (gst_pad_is_linked (pad))
+    return;
+
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  if (caps == NULL)
+    return;
+  bool audio = g_str_has_prefix (gst_structure_get_name (gst_caps_get_structure (caps, 0)), "audio/");
+  gst_caps_unref (caps);
+  if (!audio)
+    return;
+
+  GError *err = NULL;
+  GstElement *branch = gst_parse_bin_from_description (
+      "queue ! decodebin ! audioconvert ! audioresample ! autoaudiosink", TRUE, &err);
+  if (err != NULL) {
+    WDS_WARNING("Cannot play the audio: [%s] %s", g_quark_to_string(err->domain), err->message);
+    g_error_free(err);
+  }
+  if (branch == NULL)
+    return;
+  gst_bin_add (GST_BIN (sink->gst_elem), branch);
+  gst_element_sync_state_with_parent (branch);
+  GstPad *branch_pad = gst_element_get_static_pad (branch, "sink");
+  gst_pad_link (pad, branch_pad);
+  gst_object_unref (branch_pad);
 }
 
 int MiracGstSink::sink_udp_port() {
     if (gst_elem == NULL)
         return 0;
 
-    GstElement* source = NULL;
-    g_object_get(gst_elem, "source", &source, NULL);
-
+    GstElement* source = gst_bin_get_by_name (GST_BIN (gst_elem), "src");
     if (source == NULL)
         return 0;
 
     gint port = 0;
     g_object_get(source, "port", &port, NULL);
+    gst_object_unref (source);
     return port;
 }
 
-void MiracGstSink::Play() {
-  assert(gst_elem);
-  if(!IsInState(GST_STATE_PLAYING)) {
-    gst_element_set_state(gst_elem, GST_STATE_PLAYING);
-    IsInState(GST_STATE_PLAYING);
-  }
+void MiracGstSink::SetDamageCallback(std::function<void()> callback,
+                                     guint interval_ms) {
+  damage_callback = callback;
+  damage_interval = interval_ms;
+}
+
+void MiracGstSink::StartFirstFrameTimer() {
+  if (gst_elem == NULL)
+    return;
+  first_frame_timer_start = g_get_monotonic_time ();
+  if (first_frame_pending)
+    return;
+
+  GstElement *video_sink = gst_bin_get_by_name (GST_BIN (gst_elem), "videosink");
+  GstPad *pad = gst_element_get_static_pad (video_sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, first_frame_cb, this, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (video_sink);
+  first_frame_pending = true;
 }
 
-void MiracGstSink::Pause() {
-  assert(gst_elem);
-  if(!IsPaused()) {
-    gst_element_set_state(gst_elem, GST_STATE_PAUSED);
-    IsPaused();
+GstPadProbeReturn MiracGstSink::first_frame_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+  auto sink = static_cast<MiracGstSink*> (data);
+  gint64 elapsed = g_get_monotonic_time () - sink->first_frame_timer_start;
+  gst_element_post_message (sink->gst_elem,
+      gst_message_new_application (GST_OBJECT (sink->gst_elem),
+          gst_structure_new ("mirac-first-frame", "elapsed", G_TYPE_INT64, elapsed, NULL)));
+  return GST_PAD_PROBE_REMOVE;
+}
+
+GstPadProbeReturn MiracGstSink::udp_packet_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+  auto sink = static_cast<MiracGstSink*> (data);
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstMapInfo map;
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return GST_PAD_PROBE_OK;
+  if (sink->stream_restarted.exchange (false))
+    sink->stream_monitor.Reset ();
+  bool loss = sink->stream_monitor.CheckRtpPacket (map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+
+  /* one message until the bus watch has seen it, however many
+   * packets are lost meanwhile */
+  if (loss && !sink->loss_posted.exchange (true)) {
+    gst_element_post_message (sink->gst_elem,
+        gst_message_new_application (GST_OBJECT (sink->gst_elem),
+                                     gst_structure_new_empty ("mirac-packet-loss")));
   }
+  return GST_PAD_PROBE_OK;
+}
+
+/* static C callback wrapper */
+gboolean MiracGstSink::bus_cb (GstBus *bus, GstMessage *message, gpointer data) {
+  auto sink = static_cast<MiracGstSink*> (data);
+  sink->handle_bus_message(message);
+  return mirac_gstbus_callback(bus, message, data);
+}
+
+static bool is_video_decoder (GstObject *object) {
+  if (!GST_IS_ELEMENT (object))
+    return false;
+  GstElementFactory *factory = gst_element_get_factory (GST_ELEMENT (object));
+  if (factory == NULL)
+    return false;
+  const gchar *klass = gst_element_factory_get_metadata (factory, GST_ELEMENT_METADATA_KLASS);
+  return klass && strstr (klass, "Decoder") && strstr (klass, "Video");
 }
 
-void MiracGstSink::Teardown() {
-  assert(gst_elem);
-  if(!IsInState(GST_STATE_READY)) {
-    gst_element_set_state(gst_elem, GST_STATE_READY);
-    IsInState(GST_STATE_READY);
+void MiracGstSink::handle_bus_message(GstMessage *message) {
+  switch (GST_MESSAGE_TYPE (message)) {
+  case GST_MESSAGE_STATE_CHANGED: {
+    if (!state_callback || GST_MESSAGE_SRC (message) != GST_OBJECT (gst_elem))
+      break;
+    GstState new_state;
+    gst_message_parse_state_changed (message, NULL, &new_state, NULL);
+    if (new_state == pending_state)
+      complete_state_change (true);
+    break;
   }
+  case GST_MESSAGE_APPLICATION: {
+    const GstStructure *structure = gst_message_get_structure (message);
+    if (gst_structure_has_name (structure, "mirac-packet-loss")) {
+      loss_posted = false;
+      report_damage ("packet loss");
+    } else if (gst_structure_has_name (structure, "mirac-first-frame")) {
+      gint64 elapsed = 0;
+      gst_structure_get_int64 (structure, "elapsed", &elapsed);
+      first_frame_pending = false;
+      first_frame_time = elapsed;
+      WDS_LOG ("Time to first frame: %" G_GINT64_FORMAT " ms", elapsed / G_TIME_SPAN_MILLISECOND);
+    }
+    break;
+  }
+  case GST_MESSAGE_ERROR:
+    if (state_callback)
+      complete_state_change (false);
+    /* fall through */
+  case GST_MESSAGE_WARNING:
+    /* decoders warn about undecodable frames before giving up */
+    if (is_video_decoder (GST_MESSAGE_SRC (message)))
+      report_damage ("decoder error");
+    break;
+  default:
+    break;
+  }
+}
+
+void MiracGstSink::report_damage(const char *reason) {
+  if (!damage_callback)
+    return;
+  gint64 now = g_get_monotonic_time ();
+  if (last_damage_time > 0 &&
+      now - last_damage_time < damage_interval * G_TIME_SPAN_MILLISECOND)
+    return;
+  last_damage_time = now;
+  WDS_VLOG ("Picture damaged by %s", reason);
+  damage_callback();
+}
+
+void MiracGstSink::Play(std::function<void(bool)> callback) {
+  /* the source may have rebuilt its pipeline meanwhile */
+  if (target_state() != GST_STATE_PLAYING)
+    stream_restarted = true;
+  /* the live udpsrc cannot preroll, so PLAYING is only reached once
+   * the first frame is rendered */
+  set_state(GST_STATE_PLAYING, callback);
+}
+
+void MiracGstSink::Pause(std::function<void(bool)> callback) {
+  set_state(GST_STATE_PAUSED, callback);
+}
+
+void MiracGstSink::Teardown(std::function<void(bool)> callback) {
+  set_state(GST_STATE_READY, callback);
 }
 
 bool MiracGstSink::IsPaused() const {
-  return IsInState(GST_STATE_PAUSED);
+  return target_state() == GST_STATE_PAUSED;
+}
+
+void MiracGstSink::set_state(GstState state, std::function<void(bool)> callback) {
+  if (state_callback)
+    complete_state_change(false);
+
+  if (!gst_elem) {
+    callback(false);
+    return;
+  }
+  switch (gst_element_set_state (gst_elem, state)) {
+  case GST_STATE_CHANGE_FAILURE:
+    callback(false);
+    break;
+  case GST_STATE_CHANGE_ASYNC:
+    pending_state = state;
+    state_callback = callback;
+    break;
+  default:
+    callback(true);
+    break;
+  }
+}
+
+void MiracGstSink::complete_state_change(bool success) {
+  std::function<void(bool)> callback;
+  callback.swap(state_callback);
+  pending_state = GST_STATE_VOID_PENDING;
+  callback(success);
 }
 
-bool MiracGstSink::IsInState(GstState state) const {
-  assert(gst_elem);
-  GstState current_state;
-  gst_element_get_state(gst_elem, &current_state, NULL, GST_CLOCK_TIME_NONE);
-  return current_state == state;
+GstState MiracGstSink::target_state() const {
+  if (!gst_elem)
+    return GST_STATE_NULL;
+  GstState current, pending;
+  gst_element_get_state (gst_elem, &current, &pending, 0);
+  return pending != GST_STATE_VOID_PENDING ? pending : current;
 }
 
 MiracGstSink::~MiracGstSink () {
-  if (gst_elem) {
-    gst_element_set_state (gst_elem, GST_STATE_NULL);
-    g_source_remove (bus_watch_id);
-    gst_object_unref (GST_OBJECT (gst_elem));
-  }
+  destroy_pipeline();
 }
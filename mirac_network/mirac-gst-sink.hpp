@@ -19,29 +19,87 @@
  * 02110-1301 USA
  */
 
+
 #ifndef MIRAC_GST_SINK_HPP
 #define MIRAC_GST_SINK_HPP
 
 #include <gst/gst.h>
+#include <atomic>
+#include <functional>
 #include <string>
 
+#include "mirac-gst-test-source.hpp"
+#include "mirac-stream-monitor.hpp"
+
 class MiracGstSink
 {
 public:
+    /* the UDP port is bound right away, the pipeline decodes H.264
+     * until Prepare() is called with another codec */
     MiracGstSink(std::string hostname, int port);
     ~MiracGstSink ();
 
-    void Play();
-    void Pause();
+    /* links the pipeline for the negotiated codec and takes it to
+     * PAUSED, so that nothing is left to set up once the stream comes */
+    void Prepare(wfd_video_codec_t video_codec);
+
+    /* the state changes do not wait for the pipeline: callback is called
+     * once it has reached the state, from the bus watch if the change
+     * completes asynchronously, e.g. PLAYING once the first frame is
+     * rendered. A newer request supersedes a pending one, which is
+     * reported as failed. */
+    void Play(std::function<void(bool)> callback);
+    void Pause(std::function<void(bool)> callback);
+    void Teardown(std::function<void(bool)> callback);
+    /* the state the pipeline is in or is going to */
     bool IsPaused() const;
-    void Teardown();
 
     int sink_udp_port();
 
+    /* callback is called from the bus watch when packets were lost or
+     * the decoder failed, so that the picture stays damaged until the
+     * next keyframe. It is not called again within interval_ms. */
+    void SetDamageCallback(std::function<void()> callback, guint interval_ms);
+
+    /* measures the time from now until the next frame is rendered, e.g.
+     * when PLAY is requested; it is logged and kept for
+     * time_to_first_frame() */
+    void StartFirstFrameTimer();
+    /* microseconds, -1 if not measured yet */
+    gint64 time_to_first_frame() const { return first_frame_time; }
+
+    /* true if the video of the codec can be decoded */
+    static bool IsVideoCodecAvailable(wfd_video_codec_t video_codec);
+
 private:
-    bool IsInState(GstState state) const;
+    void create_pipeline(int port);
+    void destroy_pipeline();
+    void set_state(GstState state, std::function<void(bool)> callback);
+    void complete_state_change(bool success);
+    GstState target_state() const;
+    static gboolean bus_cb (GstBus *bus, GstMessage *message, gpointer data);
+    void handle_bus_message(GstMessage *message);
+    void report_damage(const char *reason);
+    static void demux_pad_added_cb (GstElement *demux, GstPad *pad, gpointer data);
+    static GstPadProbeReturn udp_packet_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn first_frame_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data);
+
+    std::string hostname;
+    wfd_video_codec_t video_codec;
     GstElement* gst_elem;
-    guint bus_watch_id;
+    std::function<void()> damage_callback;
+    GstState pending_state;
+    std::function<void(bool)> state_callback;
+    guint damage_interval;
+    gint64 last_damage_time;
+    bool first_frame_pending;
+    gint64 first_frame_time;
+    /* updated from the streaming thread */
+    MiracStreamMonitor stream_monitor;
+    std::atomic<bool> loss_posted;
+    /* set when the source may restart the stream */
+    std::atomic<bool> stream_restarted;
+    std::atomic<gint64> first_frame_timer_start;
 };
 
 #endif
@@ -21,6 +21,7 @@
  * 02110-1301 USA
  */
 
+#include <algorithm>
 #include <iostream>
 #include <gio/gio.h>
 
@@ -28,21 +29,63 @@
 #include "mirac-gst-bus-handler.hpp"
 #include "libwds/public/logging.h"
 
-MiracGstTestSource::MiracGstTestSource (wfd_test_stream_t wfd_stream_type, std::string hostname, int port)
+static const char* video_encoder_name (wfd_video_codec_t video_codec)
+{
+    return video_codec == WFD_VIDEO_H265 ? "x265enc" : "x264enc";
+}
+
+bool mirac_encoder_profile(const std::string& name, MiracEncoderProfile* profile)
+{
+    *profile = MiracEncoderProfile();
+    if (name == "default")
+        return true;
+
+    profile->sliced_threads = true;
+    profile->keyframe_interval = 1000;
+    if (name == "low-latency")
+        return true;
+
+    if (name == "intra-refresh") {
+        /* without keyframe bursts a frame fits a one frame VBV */
+        profile->intra_refresh = true;
+        profile->vbv_frames = 1;
+        return true;
+    }
+    return false;
+}
+
+bool MiracGstTestSource::IsVideoCodecAvailable(wfd_video_codec_t video_codec)
+{
+    GstElementFactory *factory = gst_element_factory_find (video_encoder_name (video_codec));
+    if (!factory)
+        return false;
+    gst_object_unref (factory);
+    return true;
+}
+
+MiracGstTestSource::MiracGstTestSource (wfd_test_stream_t wfd_stream_type, std::string hostname, int port,
+                                        wfd_video_codec_t video_codec)
+    : video_codec(video_codec),
+      pending_state(GST_STATE_VOID_PENDING),
+      key_unit_count(0),
+      encoder_stats()
 {
     std::string gst_pipeline;
+    std::string encoder = video_encoder_name (video_codec);
 
     std::string hostname_port = (!hostname.empty() ? "host=" + hostname + " ": " ") + (port > 0 ? "port=" + std::to_string(port) : "");
 
     if (wfd_stream_type == WFD_TEST_BOTH) {
-        gst_pipeline = "videotestsrc ! videoconvert ! video/x-raw,format=I420 ! x264enc ! muxer.  audiotestsrc ! avenc_ac3 ! muxer.  mpegtsmux name=muxer ! rtpmp2tpay ! udpsink name=sink " +
+        gst_pipeline = "videotestsrc ! videoconvert ! video/x-raw,format=I420 ! " + encoder + " name=encoder ! muxer.  audiotestsrc ! avenc_ac3 ! muxer.  mpegtsmux name=muxer ! rtpmp2tpay ! udpsink name=sink " +
             hostname_port;
     } else if (wfd_stream_type == WFD_TEST_AUDIO) {
         gst_pipeline = "audiotestsrc ! avenc_ac3 ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
     } else if (wfd_stream_type == WFD_TEST_VIDEO) {
-        gst_pipeline = "videotestsrc ! videoconvert ! video/x-raw,format=I420 ! x264enc ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
+        gst_pipeline = "videotestsrc ! videoconvert ! video/x-raw,format=I420 ! " + encoder + " name=encoder ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
     } else if (wfd_stream_type == WFD_DESKTOP) {
-        gst_pipeline = "ximagesrc ! videoconvert ! video/x-raw,format=I420 ! x264enc tune=zerolatency ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
+        /* the capsfilters are set to the negotiated format by SetVideoFormat() */
+        gst_pipeline = "ximagesrc ! videoconvert ! videoscale ! videorate ! capsfilter name=videocaps caps=video/x-raw,format=I420 ! " +
+            encoder + " name=encoder tune=zerolatency ! capsfilter name=enccaps ! mpegtsmux ! rtpmp2tpay ! udpsink name=sink " + hostname_port;
     }
 
     GError *err = NULL;
@@ -53,7 +96,9 @@ MiracGstTestSource::MiracGstTestSource (wfd_test_stream_t wfd_stream_type, std::
 
     if (gst_elem) {
         GstBus* bus = gst_pipeline_get_bus (GST_PIPELINE (gst_elem));
-        bus_watch_id = gst_bus_add_watch (bus, mirac_gstbus_callback, this);
+        /* attached to the thread-default context, which is the context
+         * of a shard when the sessions are sharded */
+        gst_bus_add_watch (bus, bus_cb, this);
         gst_object_unref (bus);
     }
 }
@@ -65,6 +110,97 @@ void MiracGstTestSource::SetState(GstState state)
     }
 }
 
+void MiracGstTestSource::SetState(GstState state, std::function<void(bool)> callback)
+{
+    if (state_callback)
+        complete_state_change(false);
+
+    if (!gst_elem) {
+        callback(false);
+        return;
+    }
+
+    switch (gst_element_set_state (gst_elem, state)) {
+    case GST_STATE_CHANGE_FAILURE:
+        callback(false);
+        break;
+    case GST_STATE_CHANGE_ASYNC:
+        pending_state = state;
+        state_callback = callback;
+        break;
+    default:
+        callback(true);
+        break;
+    }
+}
+
+GstState MiracGstTestSource::GetTargetState() const
+{
+    if (!gst_elem)
+        return GST_STATE_NULL;
+    GstState current, pending;
+    gst_element_get_state (gst_elem, &current, &pending, 0);
+    return pending != GST_STATE_VOID_PENDING ? pending : current;
+}
+
+/* static C callback wrapper */
+gboolean MiracGstTestSource::bus_cb (GstBus *bus, GstMessage *message, gpointer data)
+{
+    auto source = static_cast<MiracGstTestSource*> (data);
+    source->handle_bus_message(message);
+    return mirac_gstbus_callback(bus, message, data);
+}
+
+void MiracGstTestSource::handle_bus_message(GstMessage *message)
+{
+    switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_STATE_CHANGED: {
+        if (!state_callback || GST_MESSAGE_SRC (message) != GST_OBJECT (gst_elem))
+            break;
+        GstState new_state;
+        gst_message_parse_state_changed (message, NULL, &new_state, NULL);
+        if (new_state == pending_state)
+            complete_state_change(true);
+        break;
+    }
+    case GST_MESSAGE_ERROR:
+        if (state_callback)
+            complete_state_change(false);
+        complete_key_units(false);
+        break;
+    case GST_MESSAGE_APPLICATION: {
+        const GstStructure *structure = gst_message_get_structure (message);
+        if (gst_structure_has_name (structure, "mirac-key-unit")) {
+            complete_key_units(true);
+        } else if (gst_structure_has_name (structure, "mirac-first-packet") &&
+                   first_packet_callback) {
+            gint64 timestamp = 0;
+            gst_structure_get_int64 (structure, "timestamp", &timestamp);
+            first_packet_callback(timestamp);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void MiracGstTestSource::complete_state_change(bool success)
+{
+    std::function<void(bool)> callback;
+    callback.swap(state_callback);
+    pending_state = GST_STATE_VOID_PENDING;
+    callback(success);
+}
+
+void MiracGstTestSource::complete_key_units(bool success)
+{
+    std::vector<std::function<void(bool)>> callbacks;
+    callbacks.swap(key_unit_callbacks);
+    for (auto &callback : callbacks)
+        callback(success);
+}
+
 GstState MiracGstTestSource::GetState() const
 {
     if (!gst_elem)
@@ -95,11 +231,213 @@ int MiracGstTestSource::UdpSourcePort()
     return port;
 }
 
+void MiracGstTestSource::SetPort(int port)
+{
+    if (gst_elem == NULL)
+        return;
+
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(gst_elem), "sink");
+    if (sink == NULL)
+        return;
+
+    g_object_set(sink, "port", port, NULL);
+    gst_object_unref(sink);
+}
+
+static void set_caps (GstElement *pipeline, const char *name, const std::string &caps_string)
+{
+    GstElement *filter = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    if (filter == NULL)
+        return;
+
+    GstCaps *caps = gst_caps_from_string (caps_string.c_str());
+    g_object_set (filter, "caps", caps, NULL);
+    gst_caps_unref (caps);
+    gst_object_unref (filter);
+}
+
+void MiracGstTestSource::SetVideoFormat(const MiracVideoFormat& format,
+                                        const MiracEncoderProfile& profile)
+{
+    if (gst_elem == NULL)
+        return;
+
+    /* letterboxed rather than stretched when the aspect ratio differs */
+    set_caps (gst_elem, "videocaps",
+        "video/x-raw,format=I420,pixel-aspect-ratio=1/1"
+        ",width=" + std::to_string(format.width) +
+        ",height=" + std::to_string(format.height) +
+        ",framerate=" + std::to_string(format.framerate) + "/1");
+
+    std::string encoder_caps = video_codec == WFD_VIDEO_H265 ? "video/x-h265" : "video/x-h264";
+    if (!format.profile.empty())
+        encoder_caps += ",profile=" + format.profile;
+    if (!format.level.empty())
+        encoder_caps += ",level=(string)" + format.level;
+    set_caps (gst_elem, "enccaps", encoder_caps);
+
+    GstElement *encoder = gst_bin_get_by_name (GST_BIN (gst_elem), "encoder");
+    if (encoder == NULL)
+        return;
+
+    g_object_set (encoder, "bitrate", format.bitrate, NULL);
+    if (profile.keyframe_interval > 0) {
+        gint key_int_max = std::max (1u, profile.keyframe_interval * format.framerate / 1000);
+        g_object_set (encoder, "key-int-max", key_int_max, NULL);
+    }
+    if (video_codec == WFD_VIDEO_H264) {
+        guint vbv_buffer = std::max (1u, profile.vbv_frames * 1000 / format.framerate);
+        g_object_set (encoder,
+                      "vbv-buf-capacity", vbv_buffer,
+                      "sliced-threads", (gboolean) profile.sliced_threads,
+                      "intra-refresh", (gboolean) profile.intra_refresh,
+                      NULL);
+    }
+    gst_object_unref (encoder);
+}
+
+void MiracGstTestSource::ForceKeyUnit(std::function<void(bool)> callback)
+{
+    if (!key_unit_callbacks.empty()) {
+        key_unit_callbacks.push_back(callback);
+        return;
+    }
+
+    GstElement *encoder = gst_elem ? gst_bin_get_by_name (GST_BIN (gst_elem), "encoder") : NULL;
+    if (encoder == NULL) {
+        callback(false);
+        return;
+    }
+
+    /* the probe goes first not to miss a keyframe made right away */
+    GstPad *pad = gst_element_get_static_pad (encoder, "src");
+    gulong probe_id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, key_unit_cb, this, NULL);
+
+    /* the upstream force key unit event of the video library, which
+     * would only be linked for it */
+    GstStructure *structure = gst_structure_new ("GstForceKeyUnit",
+        "running-time", GST_TYPE_CLOCK_TIME, GST_CLOCK_TIME_NONE,
+        "all-headers", G_TYPE_BOOLEAN, TRUE,
+        "count", G_TYPE_UINT, ++key_unit_count,
+        NULL);
+    if (gst_pad_send_event (pad, gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, structure))) {
+        key_unit_callbacks.push_back(callback);
+    } else {
+        WDS_WARNING ("The encoder does not take keyframe requests");
+        gst_pad_remove_probe (pad, probe_id);
+        callback(false);
+    }
+    gst_object_unref (pad);
+    gst_object_unref (encoder);
+}
+
+GstPadProbeReturn MiracGstTestSource::key_unit_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+        return GST_PAD_PROBE_OK;
+
+    /* handed over to the bus watch, which runs with the session */
+    auto source = static_cast<MiracGstTestSource*> (data);
+    gst_element_post_message (source->gst_elem,
+        gst_message_new_application (GST_OBJECT (source->gst_elem),
+                                     gst_structure_new_empty ("mirac-key-unit")));
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void MiracGstTestSource::SetFirstPacketCallback(std::function<void(gint64)> callback)
+{
+    bool probed = static_cast<bool>(first_packet_callback);
+    first_packet_callback = callback;
+    if (probed || !callback || gst_elem == NULL)
+        return;
+
+    GstElement *sink = gst_bin_get_by_name (GST_BIN (gst_elem), "sink");
+    if (sink == NULL)
+        return;
+
+    GstPad *pad = gst_element_get_static_pad (sink, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, first_packet_cb, this, NULL);
+    gst_object_unref (pad);
+    gst_object_unref (sink);
+}
+
+GstPadProbeReturn MiracGstTestSource::first_packet_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    /* stamped here rather than when the bus watch gets to it */
+    auto source = static_cast<MiracGstTestSource*> (data);
+    gst_element_post_message (source->gst_elem,
+        gst_message_new_application (GST_OBJECT (source->gst_elem),
+            gst_structure_new ("mirac-first-packet",
+                               "timestamp", G_TYPE_INT64, g_get_monotonic_time (),
+                               NULL)));
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void MiracGstTestSource::EnableEncoderStats()
+{
+    if (gst_elem == NULL)
+        return;
+
+    GstElement *encoder = gst_bin_get_by_name (GST_BIN (gst_elem), "encoder");
+    if (encoder == NULL)
+        return;
+
+    GstPad *pad = gst_element_get_static_pad (encoder, "sink");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, encoder_input_cb, this, NULL);
+    gst_object_unref (pad);
+    pad = gst_element_get_static_pad (encoder, "src");
+    gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, encoder_output_cb, this, NULL);
+    gst_object_unref (pad);
+    gst_object_unref (encoder);
+}
+
+MiracEncoderStats MiracGstTestSource::GetEncoderStats()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return encoder_stats;
+}
+
+GstPadProbeReturn MiracGstTestSource::encoder_input_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    auto source = static_cast<MiracGstTestSource*> (data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    std::lock_guard<std::mutex> lock(source->stats_mutex);
+    source->encoder_input_times[GST_BUFFER_PTS (buffer)] = gst_util_get_timestamp ();
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn MiracGstTestSource::encoder_output_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+    auto source = static_cast<MiracGstTestSource*> (data);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+    guint64 size = gst_buffer_get_size (buffer);
+    std::lock_guard<std::mutex> lock(source->stats_mutex);
+    MiracEncoderStats &stats = source->encoder_stats;
+    stats.frames++;
+    stats.bytes += size;
+    stats.max_frame_bytes = std::max (stats.max_frame_bytes, size);
+
+    auto it = source->encoder_input_times.find (GST_BUFFER_PTS (buffer));
+    if (it != source->encoder_input_times.end()) {
+        GstClockTime latency = gst_util_get_timestamp () - it->second;
+        stats.total_latency += latency;
+        stats.max_latency = std::max (stats.max_latency, latency);
+        /* the frames before it were dropped by the encoder */
+        source->encoder_input_times.erase (source->encoder_input_times.begin(), ++it);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
 MiracGstTestSource::~MiracGstTestSource ()
 {
     if (gst_elem) {
         gst_element_set_state (gst_elem, GST_STATE_NULL);
-        g_source_remove (bus_watch_id);
+        /* g_source_remove() would look the watch up in the default
+         * context only */
+        GstBus* bus = gst_pipeline_get_bus (GST_PIPELINE (gst_elem));
+        gst_bus_remove_watch (bus);
+        gst_object_unref (bus);
         gst_object_unref (GST_OBJECT (gst_elem));
     }
 }
@@ -24,25 +24,119 @@
 #ifndef MIRAC_GST_TEST_SOURCE_HPP
 #define MIRAC_GST_TEST_SOURCE_HPP
 
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <gst/gst.h>
 
 enum wfd_test_stream_t {WFD_TEST_AUDIO, WFD_TEST_VIDEO, WFD_TEST_BOTH, WFD_DESKTOP, WFD_UNKNOWN_STREAM};
+enum wfd_video_codec_t {WFD_VIDEO_H264, WFD_VIDEO_H265};
+
+/* the format the desktop is encoded in, see SetVideoFormat() */
+struct MiracVideoFormat {
+    int width;
+    int height;
+    int framerate;
+    std::string profile;    /* encoder caps profile, e.g. "high", or empty */
+    std::string level;      /* encoder caps level, e.g. "4.1", or empty */
+    unsigned bitrate;       /* kbit/s */
+};
+
+/* encoder settings trading quality for latency, the default one only
+ * tunes the encoder for zero latency, see mirac_encoder_profile() */
+struct MiracEncoderProfile {
+    MiracEncoderProfile()
+        : sliced_threads(false), intra_refresh(false),
+          keyframe_interval(0), vbv_frames(2), min_idr_interval(500) {}
+
+    bool sliced_threads;        /* the threads encode slices of one frame, not several frames */
+    bool intra_refresh;         /* a moving column of intra blocks instead of keyframes, H.264 only */
+    unsigned keyframe_interval; /* ms between keyframes or refresh cycles, 0 for the encoder default */
+    unsigned vbv_frames;        /* VBV buffer in frames, H.264 only */
+    unsigned min_idr_interval;  /* ms at least between keyframes forced by IDR requests */
+};
+
+/* looks up a profile by name: "default", "low-latency" or "intra-refresh" */
+bool mirac_encoder_profile(const std::string& name, MiracEncoderProfile* profile);
+
+/* what the encoder produced, see EnableEncoderStats() */
+struct MiracEncoderStats {
+    guint64 frames;
+    guint64 bytes;
+    guint64 max_frame_bytes;
+    GstClockTime total_latency;     /* from encoder input to output */
+    GstClockTime max_latency;
+};
 
 
 class MiracGstTestSource
 {
 public:
-    MiracGstTestSource(wfd_test_stream_t wfd_stream, std::string hostname, int port);
+    MiracGstTestSource(wfd_test_stream_t wfd_stream, std::string hostname, int port,
+                       wfd_video_codec_t video_codec = WFD_VIDEO_H264);
     ~MiracGstTestSource ();
 
     void SetState(GstState state);
+    /* callback is called once the pipeline has reached the state, from
+     * the bus watch if the change completes asynchronously. A newer
+     * request supersedes a pending one, which is reported as failed. */
+    void SetState(GstState state, std::function<void(bool)> callback);
     GstState GetState() const;
+    /* the state the pipeline is in or changing to, without waiting */
+    GstState GetTargetState() const;
 
     int UdpSourcePort();
+    /* sets the port the stream is sent to, e.g. when it was not known
+     * yet when the pipeline was built */
+    void SetPort(int port);
+
+    /* scales the desktop to the format and constrains the encoder to it
+     * with the settings of the profile, before the pipeline is started */
+    void SetVideoFormat(const MiracVideoFormat& format,
+                        const MiracEncoderProfile& profile = MiracEncoderProfile());
+
+    /* asks the encoder for a keyframe with the stream headers. callback
+     * is called from the bus watch once a keyframe has left the encoder,
+     * or right away with false if the request could not be sent. Requests
+     * made in the meantime are answered by the same keyframe. */
+    void ForceKeyUnit(std::function<void(bool)> callback);
+
+    /* callback is called from the bus watch with the monotonic time
+     * (g_get_monotonic_time()) the first packet was handed to udpsink */
+    void SetFirstPacketCallback(std::function<void(gint64)> callback);
+
+    /* counts the encoded frames from now on, for benchmarking */
+    void EnableEncoderStats();
+    MiracEncoderStats GetEncoderStats();
+
+    /* true if the video can be encoded with the codec */
+    static bool IsVideoCodecAvailable(wfd_video_codec_t video_codec);
 
 private:
+    static gboolean bus_cb (GstBus *bus, GstMessage *message, gpointer data);
+    void handle_bus_message(GstMessage *message);
+    void complete_state_change(bool success);
+    static GstPadProbeReturn encoder_input_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn encoder_output_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn key_unit_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    static GstPadProbeReturn first_packet_cb (GstPad *pad, GstPadProbeInfo *info, gpointer data);
+    void complete_key_units(bool success);
+
     GstElement* gst_elem;
-    guint bus_watch_id;
+    wfd_video_codec_t video_codec;
+    GstState pending_state;
+    std::function<void(bool)> state_callback;
+    std::vector<std::function<void(bool)>> key_unit_callbacks;
+    guint key_unit_count;
+    std::function<void(gint64)> first_packet_callback;
+
+    /* updated from the streaming thread */
+    std::mutex stats_mutex;
+    MiracEncoderStats encoder_stats;
+    /* input time of the frames being encoded, by PTS */
+    std::map<GstClockTime, GstClockTime> encoder_input_times;
 };
 
 #endif
@@ -0,0 +1,439 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "mirac-io-thread.hpp"
+#include "mirac-exception.hpp"
+#include "mirac-glib-logging.hpp"
+
+namespace {
+
+const size_t queue_capacity = 64;
+
+/* splits the first complete RTSP message off the buffer */
+bool next_message (std::string &buffer, std::string &message)
+{
+    size_t header_length = buffer.find("\r\n\r\n");
+    if (header_length == std::string::npos)
+        return false;
+    header_length += 4;
+
+    std::string header = buffer.substr(0, header_length);
+    std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+    size_t content_length = 0;
+    size_t pos = header.find("\ncontent-length:");
+    if (pos != std::string::npos)
+        content_length = strtoul(header.c_str() + pos + 16, NULL, 10);
+
+    if (buffer.size() < header_length + content_length)
+        return false;
+
+    message = buffer.substr(0, header_length + content_length);
+    buffer.erase(0, header_length + content_length);
+    return true;
+}
+
+}
+
+MiracIOChannel::MiracIOChannel (MiracIOThread *io_thread, MiracNetwork *connection,
+                                GMainContext *session_context, Delegate *delegate):
+    io_thread_(io_thread),
+    delegate_(delegate),
+    session_context_(g_main_context_ref(session_context)),
+    connection_(connection),
+    reading_closed_(false),
+    in_source_(NULL),
+    out_source_(NULL),
+    event_source_(NULL),
+    in_queue_(queue_capacity),
+    out_queue_(queue_capacity),
+    receive_stalled_(false),
+    peer_closed_(false)
+{
+    in_event_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    out_event_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (in_event_ < 0 || out_event_ < 0)
+        throw MiracException(errno, "eventfd()", __FUNCTION__);
+
+    GUnixFDSourceFunc func = session_event_cb;
+    session_source_ = g_unix_fd_source_new(in_event_, G_IO_IN);
+    g_source_set_callback(session_source_, reinterpret_cast<GSourceFunc>(func),
+                          this, NULL);
+    g_source_attach(session_source_, session_context_);
+}
+
+MiracIOChannel::~MiracIOChannel ()
+{
+    if (session_source_) {
+        g_source_destroy(session_source_);
+        g_source_unref(session_source_);
+    }
+    g_main_context_unref(session_context_);
+    if (in_event_ >= 0)
+        ::close(in_event_);
+    if (out_event_ >= 0)
+        ::close(out_event_);
+}
+
+void MiracIOChannel::signal(int event_fd)
+{
+    uint64_t value = 1;
+    if (write(event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        WDS_WARNING("eventfd write failed: %d", errno);
+}
+
+void MiracIOChannel::drain(int event_fd)
+{
+    uint64_t value;
+    while (read(event_fd, &value, sizeof(value)) > 0)
+        ;
+}
+
+bool MiracIOChannel::send(const std::string& data)
+{
+    Message message { data, g_get_monotonic_time() };
+    if (!out_queue_.push(std::move(message)))
+        return false;
+    signal(out_event_);
+    return true;
+}
+
+void MiracIOChannel::close()
+{
+    delegate_ = NULL;
+    if (session_source_) {
+        g_source_destroy(session_source_);
+        g_source_unref(session_source_);
+        session_source_ = NULL;
+    }
+
+    g_main_context_invoke_full(io_thread_->context_, G_PRIORITY_DEFAULT,
+                               detach_cb,
+                               new std::shared_ptr<MiracIOChannel>(shared_from_this()),
+                               channel_free);
+}
+
+/* static C callback wrapper */
+gboolean MiracIOChannel::session_event_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+{
+    /* the delegate may close the channel while it handles a message,
+     * the I/O thread could then drop it before deliver() returns */
+    auto channel = static_cast<MiracIOChannel*> (data_ptr)->shared_from_this();
+    channel->deliver();
+    return G_SOURCE_CONTINUE;
+}
+
+void MiracIOChannel::deliver()
+{
+    drain(in_event_);
+
+    /* checked first: every message queued before the flag was
+     * set is popped below */
+    bool closed = peer_closed_.load(std::memory_order_acquire);
+
+    Message message;
+    while (delegate_ && in_queue_.pop(message)) {
+        io_thread_->record(MiracIOThread::RECEIVE_QUEUE, message.queued_us);
+        gint64 taken_us = g_get_monotonic_time();
+        delegate_->on_io_message(message.data);
+        io_thread_->record(MiracIOThread::RECEIVE_HANDLE, taken_us);
+    }
+
+    if (receive_stalled_.exchange(false))
+        signal(out_event_);
+
+    if (closed && delegate_) {
+        Delegate *delegate = delegate_;
+        delegate_ = NULL;
+        delegate->on_io_closed();
+    }
+}
+
+GSource *MiracIOChannel::add_io_watch(gint fd, GIOCondition condition, GUnixFDSourceFunc func)
+{
+    GSource *source = g_unix_fd_source_new(fd, condition);
+    g_source_set_callback(source, reinterpret_cast<GSourceFunc>(func), this, NULL);
+    g_source_attach(source, io_thread_->context_);
+    return source;
+}
+
+gboolean MiracIOChannel::attach_cb (gpointer data_ptr)
+{
+    auto channel = *static_cast<std::shared_ptr<MiracIOChannel>*> (data_ptr);
+
+    /* the I/O thread keeps the channel alive until detach_cb() */
+    channel->self_ = channel;
+    channel->event_source_ = channel->add_io_watch(channel->out_event_, G_IO_IN, io_event_cb);
+    channel->in_source_ = channel->add_io_watch(channel->connection_->GetHandle(), G_IO_IN, socket_in_cb);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean MiracIOChannel::detach_cb (gpointer data_ptr)
+{
+    auto channel = *static_cast<std::shared_ptr<MiracIOChannel>*> (data_ptr);
+
+    /* what the session sent before closing, e.g. the reply to M8,
+     * is written if the socket takes it right away */
+    Message message;
+    while (channel->out_queue_.pop(message))
+        channel->send_buf_.append(message.data);
+    if (!channel->send_buf_.empty() && channel->connection_)
+        channel->write_socket();
+
+    channel->stop_reading();
+    for (GSource **source : { &channel->out_source_, &channel->event_source_ }) {
+        if (*source) {
+            g_source_destroy(*source);
+            g_source_unref(*source);
+            *source = NULL;
+        }
+    }
+    channel->connection_.reset();
+    channel->self_.reset();
+    return G_SOURCE_REMOVE;
+}
+
+void MiracIOChannel::channel_free (gpointer data_ptr)
+{
+    delete static_cast<std::shared_ptr<MiracIOChannel>*> (data_ptr);
+}
+
+/* static C callback wrapper */
+gboolean MiracIOChannel::socket_in_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+{
+    auto channel = static_cast<MiracIOChannel*> (data_ptr);
+    channel->read_socket();
+    return G_SOURCE_CONTINUE;
+}
+
+/* static C callback wrapper */
+gboolean MiracIOChannel::socket_out_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+{
+    auto channel = static_cast<MiracIOChannel*> (data_ptr);
+    channel->write_socket();
+    return G_SOURCE_CONTINUE;
+}
+
+/* static C callback wrapper */
+gboolean MiracIOChannel::io_event_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+{
+    auto channel = static_cast<MiracIOChannel*> (data_ptr);
+    drain(channel->out_event_);
+
+    Message message;
+    while (channel->out_queue_.pop(message)) {
+        channel->io_thread_->record(MiracIOThread::SEND_QUEUE, message.queued_us);
+        channel->unsent_.push_back(g_get_monotonic_time());
+        channel->send_buf_.append(message.data);
+    }
+    if (!channel->unsent_.empty())
+        channel->write_socket();
+
+    if (!channel->received_.empty())
+        channel->flush_received();
+    return G_SOURCE_CONTINUE;
+}
+
+void MiracIOChannel::stop_reading()
+{
+    if (in_source_) {
+        g_source_destroy(in_source_);
+        g_source_unref(in_source_);
+        in_source_ = NULL;
+    }
+}
+
+void MiracIOChannel::read_socket()
+{
+    bool lost = false;
+    try {
+        connection_->Receive(receive_buf_);
+    } catch (const MiracConnectionLostException &exception) {
+        lost = true;
+    } catch (const std::exception &x) {
+        WDS_WARNING("exception: %s", x.what());
+        lost = true;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    std::string data;
+    while (next_message(receive_buf_, data))
+        received_.push_back(Message { std::move(data), now });
+
+    if (lost)
+        peer_closed();
+    flush_received();
+}
+
+void MiracIOChannel::write_socket()
+{
+    try {
+        std::string data;
+        data.swap(send_buf_);
+        if (!connection_ || !connection_->Send(data)) {
+            if (!out_source_ && connection_)
+                out_source_ = add_io_watch(connection_->GetHandle(), G_IO_OUT, socket_out_cb);
+            return;
+        }
+    } catch (const std::exception &x) {
+        /* reported through the receiving side */
+        WDS_WARNING("exception: %s", x.what());
+    }
+
+    for (gint64 taken_us : unsent_)
+        io_thread_->record(MiracIOThread::SEND_WRITE, taken_us);
+    unsent_.clear();
+
+    if (out_source_) {
+        g_source_destroy(out_source_);
+        g_source_unref(out_source_);
+        out_source_ = NULL;
+    }
+}
+
+void MiracIOChannel::flush_received()
+{
+    bool pushed = false;
+    for (;;) {
+        while (!received_.empty() && in_queue_.push(std::move(received_.front()))) {
+            received_.pop_front();
+            pushed = true;
+        }
+        if (received_.empty())
+            break;
+        /* the session may have drained the queue before it
+         * could see the flag: try once more after setting it */
+        if (receive_stalled_.exchange(true))
+            break;
+    }
+
+    /* stop reading while the session is not keeping up,
+     * TCP flow control takes over */
+    if (!received_.empty())
+        stop_reading();
+    else if (!in_source_ && !reading_closed_ && connection_)
+        in_source_ = add_io_watch(connection_->GetHandle(), G_IO_IN, socket_in_cb);
+
+    if (received_.empty() && reading_closed_ && !peer_closed_) {
+        peer_closed_.store(true, std::memory_order_release);
+        pushed = true;
+    }
+    if (pushed)
+        signal(in_event_);
+}
+
+void MiracIOChannel::peer_closed()
+{
+    reading_closed_ = true;
+    stop_reading();
+}
+
+MiracIOThread::MiracIOThread ()
+{
+    for (auto &stats : stats_) {
+        stats.count = 0;
+        stats.total_us = 0;
+        stats.max_us = 0;
+    }
+
+    context_ = g_main_context_new();
+    loop_ = g_main_loop_new(context_, FALSE);
+    thread_ = g_thread_new("mirac-io", thread_func, this);
+}
+
+MiracIOThread::~MiracIOThread ()
+{
+    g_main_context_invoke(context_, quit_cb, loop_);
+    g_thread_join(thread_);
+    g_main_loop_unref(loop_);
+    g_main_context_unref(context_);
+}
+
+gpointer MiracIOThread::thread_func (gpointer data_ptr)
+{
+    auto io_thread = static_cast<MiracIOThread*> (data_ptr);
+    g_main_context_push_thread_default(io_thread->context_);
+    g_main_loop_run(io_thread->loop_);
+    g_main_context_pop_thread_default(io_thread->context_);
+    return NULL;
+}
+
+gboolean MiracIOThread::quit_cb (gpointer data_ptr)
+{
+    g_main_loop_quit(static_cast<GMainLoop*> (data_ptr));
+    return G_SOURCE_REMOVE;
+}
+
+std::shared_ptr<MiracIOChannel> MiracIOThread::attach(MiracNetwork *connection,
+                                                      GMainContext *session_context,
+                                                      MiracIOChannel::Delegate *delegate)
+{
+    std::shared_ptr<MiracIOChannel> channel(
+        new MiracIOChannel(this, connection, session_context, delegate));
+    g_main_context_invoke_full(context_, G_PRIORITY_DEFAULT,
+                               MiracIOChannel::attach_cb,
+                               new std::shared_ptr<MiracIOChannel>(channel),
+                               MiracIOChannel::channel_free);
+    return channel;
+}
+
+void MiracIOThread::record(Hop hop, gint64 since_us)
+{
+    uint64_t elapsed = std::max<gint64>(g_get_monotonic_time() - since_us, 0);
+    AtomicHopStats &stats = stats_[hop];
+
+    stats.count.fetch_add(1, std::memory_order_relaxed);
+    stats.total_us.fetch_add(elapsed, std::memory_order_relaxed);
+    uint64_t max = stats.max_us.load(std::memory_order_relaxed);
+    while (elapsed > max &&
+           !stats.max_us.compare_exchange_weak(max, elapsed, std::memory_order_relaxed))
+        ;
+}
+
+MiracIOThread::HopStats MiracIOThread::hop_stats(Hop hop) const
+{
+    const AtomicHopStats &stats = stats_[hop];
+    return HopStats { stats.count.load(std::memory_order_relaxed),
+                      stats.total_us.load(std::memory_order_relaxed),
+                      stats.max_us.load(std::memory_order_relaxed) };
+}
+
+const char *MiracIOThread::hop_name(Hop hop)
+{
+    switch (hop) {
+        case RECEIVE_QUEUE:
+            return "receive queue";
+        case RECEIVE_HANDLE:
+            return "receive handle";
+        case SEND_QUEUE:
+            return "send queue";
+        case SEND_WRITE:
+            return "send write";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,175 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_IO_THREAD_HPP
+#define MIRAC_IO_THREAD_HPP
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "mirac-network.hpp"
+#include "mirac-spsc-queue.hpp"
+
+class MiracIOThread;
+
+/* One connection served by a MiracIOThread. The I/O thread reads the
+ * socket, splits the stream into RTSP messages and passes them to the
+ * session's main context; data sent by the session goes the other
+ * way. Each direction is a bounded MiracSpscQueue with an eventfd to
+ * wake up the consumer. */
+class MiracIOChannel : public std::enable_shared_from_this<MiracIOChannel>
+{
+    public:
+        class Delegate {
+            public:
+                /* called on the session context for every message */
+                virtual void on_io_message(const std::string& data) = 0;
+                /* called on the session context once the peer closed
+                 * the connection and all its messages were delivered */
+                virtual void on_io_closed() = 0;
+
+            protected:
+                virtual ~Delegate() {}
+        };
+
+        ~MiracIOChannel ();
+
+        /* session thread: returns false if the outgoing queue is full */
+        bool send(const std::string& data);
+        /* session thread: no delegate method is called after this */
+        void close();
+
+    private:
+        friend class MiracIOThread;
+
+        struct Message {
+            std::string data;
+            gint64 queued_us;
+        };
+
+        MiracIOChannel (MiracIOThread *io_thread, MiracNetwork *connection,
+                        GMainContext *session_context, Delegate *delegate);
+
+        /* session context */
+        static gboolean session_event_cb (gint fd, GIOCondition condition, gpointer data_ptr);
+        void deliver();
+
+        /* I/O thread */
+        static gboolean attach_cb (gpointer data_ptr);
+        static gboolean detach_cb (gpointer data_ptr);
+        static void channel_free (gpointer data_ptr);
+        static gboolean socket_in_cb (gint fd, GIOCondition condition, gpointer data_ptr);
+        static gboolean socket_out_cb (gint fd, GIOCondition condition, gpointer data_ptr);
+        static gboolean io_event_cb (gint fd, GIOCondition condition, gpointer data_ptr);
+        void stop_reading();
+        void read_socket();
+        void write_socket();
+        void flush_received();
+        void peer_closed();
+        GSource *add_io_watch(gint fd, GIOCondition condition, GUnixFDSourceFunc func);
+
+        static void signal(int event_fd);
+        static void drain(int event_fd);
+
+        MiracIOThread *io_thread_;
+        Delegate *delegate_;
+        GMainContext *session_context_;
+        GSource *session_source_;
+
+        /* owned by the I/O thread */
+        std::shared_ptr<MiracIOChannel> self_;
+        std::unique_ptr<MiracNetwork> connection_;
+        std::string receive_buf_;
+        std::string send_buf_;
+        std::deque<Message> received_;
+        std::deque<gint64> unsent_;
+        bool reading_closed_;
+        GSource *in_source_;
+        GSource *out_source_;
+        GSource *event_source_;
+
+        MiracSpscQueue<Message> in_queue_;
+        MiracSpscQueue<Message> out_queue_;
+        int in_event_;
+        int out_event_;
+        std::atomic<bool> receive_stalled_;
+        std::atomic<bool> peer_closed_;
+};
+
+/* Thread doing the socket I/O of MiracBrokers that were moved to it
+ * with MiracBroker::use_io_thread(). Keeps the time spent by messages
+ * at each hop between the socket and the session. */
+class MiracIOThread
+{
+    public:
+        enum Hop {
+            RECEIVE_QUEUE,  /* framed on the I/O thread -> taken by the session */
+            RECEIVE_HANDLE, /* taken by the session -> handled by the peer */
+            SEND_QUEUE,     /* sent by the session -> taken by the I/O thread */
+            SEND_WRITE,     /* taken by the I/O thread -> written to the socket */
+            HOP_COUNT
+        };
+
+        struct HopStats {
+            uint64_t count;
+            uint64_t total_us;
+            uint64_t max_us;
+        };
+
+        MiracIOThread ();
+        ~MiracIOThread ();
+
+        /* called on the session context that will receive the
+         * messages, takes ownership of the connection */
+        std::shared_ptr<MiracIOChannel> attach(MiracNetwork *connection,
+                                               GMainContext *session_context,
+                                               MiracIOChannel::Delegate *delegate);
+
+        HopStats hop_stats(Hop hop) const;
+        static const char *hop_name(Hop hop);
+
+    private:
+        friend class MiracIOChannel;
+
+        struct AtomicHopStats {
+            std::atomic<uint64_t> count;
+            std::atomic<uint64_t> total_us;
+            std::atomic<uint64_t> max_us;
+        };
+
+        static gpointer thread_func (gpointer data_ptr);
+        static gboolean quit_cb (gpointer data_ptr);
+        void record(Hop hop, gint64 since_us);
+
+        GMainContext *context_;
+        GMainLoop *loop_;
+        GThread *thread_;
+        AtomicHopStats stats_[HOP_COUNT];
+};
+
+
+#endif  /* MIRAC_IO_THREAD_HPP */
@@ -128,7 +128,7 @@ void MiracNetwork::Bind (const char *address, const char *service)
     }
     freeaddrinfo(addr_res);
 
-    if (listen(handle, 1))
+    if (listen(handle, SOMAXCONN))
         throw MiracException(errno, "listen()", __FUNCTION__);
 }
 
@@ -140,7 +140,13 @@ MiracNetwork * MiracNetwork::Accept ()
 
     ch = accept(handle, NULL, NULL);
     if (ch < 0)
+    {
+        /* the listening socket is non-blocking: pending connections
+         * are drained until there are none left */
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return NULL;
         throw MiracException(errno, "accept()", __FUNCTION__);
+    }
     if (ioctl(ch, FIONBIO, &nonblock))
         throw MiracException(errno, "ioctl(FIONBIO)", __FUNCTION__);
     return new MiracNetwork(ch);
@@ -0,0 +1,345 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include <glib-unix.h>
+
+#include "mirac-session-manager.hpp"
+#include "mirac-glib-logging.hpp"
+
+class MiracSessionManager::Shard : public MiracBroker::Observer
+{
+    public:
+        Shard (MiracSessionManager *manager, bool worker);
+        ~Shard ();
+
+        GMainContext *context() const { return context_; }
+        size_t session_count() const { return session_count_; }
+
+        void hand_over(MiracNetwork *connection);
+        void foreach_session(const std::function<void(MiracBroker*)>& func);
+        void stop();
+
+    private:
+        struct Handover {
+            Shard *shard;
+            MiracNetwork *connection;
+        };
+        struct Visit {
+            Shard *shard;
+            std::function<void(MiracBroker*)> func;
+        };
+
+        static gpointer thread_func (gpointer data_ptr);
+        static gboolean handover_cb (gpointer data_ptr);
+        static void handover_free (gpointer data_ptr);
+        static gboolean visit_cb (gpointer data_ptr);
+        static void visit_free (gpointer data_ptr);
+        static gboolean reap_cb (gpointer data_ptr);
+        static gboolean stop_cb (gpointer data_ptr);
+
+        /* MiracBroker::Observer */
+        void on_session_closed(MiracBroker *broker) override;
+
+        void add_session(MiracNetwork *connection);
+        void reap();
+        void clear();
+
+        MiracSessionManager *manager_;
+        GMainContext *context_;
+        GMainLoop *loop_;
+        GThread *thread_;
+
+        /* only accessed from the shard's own thread */
+        std::unordered_map<MiracBroker*, std::unique_ptr<MiracBroker>> sessions_;
+        std::vector<std::unique_ptr<MiracBroker>> closed_sessions_;
+        uint reap_source_id_;
+
+        std::atomic<size_t> session_count_;
+};
+
+MiracSessionManager::Shard::Shard (MiracSessionManager *manager, bool worker):
+    manager_(manager),
+    loop_(NULL),
+    thread_(NULL),
+    reap_source_id_(0),
+    session_count_(0)
+{
+    if (!worker) {
+        context_ = g_main_context_ref_thread_default();
+        return;
+    }
+
+    context_ = g_main_context_new();
+    loop_ = g_main_loop_new(context_, FALSE);
+    thread_ = g_thread_new("mirac-shard", thread_func, this);
+}
+
+MiracSessionManager::Shard::~Shard ()
+{
+    stop();
+    if (loop_)
+        g_main_loop_unref(loop_);
+    /* drops the handovers that were never dispatched */
+    g_main_context_unref(context_);
+}
+
+gpointer MiracSessionManager::Shard::thread_func (gpointer data_ptr)
+{
+    auto shard = static_cast<Shard*> (data_ptr);
+
+    /* brokers and their gstreamer bus watches attach to the
+     * thread-default context */
+    g_main_context_push_thread_default(shard->context_);
+    g_main_loop_run(shard->loop_);
+    g_main_context_pop_thread_default(shard->context_);
+    return NULL;
+}
+
+void MiracSessionManager::Shard::hand_over(MiracNetwork *connection)
+{
+    Handover *handover = new Handover { this, connection };
+    g_main_context_invoke_full(context_, G_PRIORITY_DEFAULT,
+                               handover_cb, handover, handover_free);
+}
+
+gboolean MiracSessionManager::Shard::handover_cb (gpointer data_ptr)
+{
+    auto handover = static_cast<Handover*> (data_ptr);
+    handover->shard->add_session(handover->connection);
+    handover->connection = NULL;
+    return G_SOURCE_REMOVE;
+}
+
+void MiracSessionManager::Shard::handover_free (gpointer data_ptr)
+{
+    auto handover = static_cast<Handover*> (data_ptr);
+    delete handover->connection;
+    delete handover;
+}
+
+void MiracSessionManager::Shard::add_session(MiracNetwork *connection)
+{
+    MiracBroker* session = nullptr;
+    try {
+        session = manager_->create_session(connection);
+    } catch (const std::exception &x) {
+        WDS_WARNING("exception: %s", x.what());
+    }
+    if (!session) {
+        delete connection;
+        return;
+    }
+
+    sessions_[session].reset(session);
+    ++session_count_;
+    if (manager_->io_thread_)
+        session->use_io_thread(manager_->io_thread_.get());
+    start_session(session, this);
+}
+
+void MiracSessionManager::Shard::on_session_closed(MiracBroker *broker)
+{
+    auto it = sessions_.find(broker);
+    if (it == sessions_.end())
+        return;
+
+    /* we are called from within the broker's callbacks,
+     * so it is deleted later from an idle callback */
+    closed_sessions_.push_back(std::move(it->second));
+    sessions_.erase(it);
+    --session_count_;
+
+    if (!reap_source_id_) {
+        GSource *source = g_idle_source_new();
+        g_source_set_callback(source, reap_cb, this, NULL);
+        reap_source_id_ = g_source_attach(source, context_);
+        g_source_unref(source);
+    }
+}
+
+gboolean MiracSessionManager::Shard::reap_cb (gpointer data_ptr)
+{
+    auto shard = static_cast<Shard*> (data_ptr);
+    shard->reap();
+    return G_SOURCE_REMOVE;
+}
+
+void MiracSessionManager::Shard::reap()
+{
+    reap_source_id_ = 0;
+    WDS_VLOG("releasing %zu closed session(s), %zu left",
+             closed_sessions_.size(), sessions_.size());
+    closed_sessions_.clear();
+}
+
+void MiracSessionManager::Shard::foreach_session(const std::function<void(MiracBroker*)>& func)
+{
+    Visit *visit = new Visit { this, func };
+    g_main_context_invoke_full(context_, G_PRIORITY_DEFAULT,
+                               visit_cb, visit, visit_free);
+}
+
+gboolean MiracSessionManager::Shard::visit_cb (gpointer data_ptr)
+{
+    auto visit = static_cast<Visit*> (data_ptr);
+    /* the callback may close sessions: take a snapshot first */
+    std::vector<MiracBroker*> sessions;
+    sessions.reserve(visit->shard->sessions_.size());
+    for (const auto& session : visit->shard->sessions_)
+        sessions.push_back(session.first);
+    for (auto session : sessions)
+        visit->func(session);
+    return G_SOURCE_REMOVE;
+}
+
+void MiracSessionManager::Shard::visit_free (gpointer data_ptr)
+{
+    delete static_cast<Visit*> (data_ptr);
+}
+
+void MiracSessionManager::Shard::clear()
+{
+    if (reap_source_id_) {
+        GSource *source = g_main_context_find_source_by_id(context_, reap_source_id_);
+        if (source)
+            g_source_destroy(source);
+        reap_source_id_ = 0;
+    }
+
+    sessions_.clear();
+    closed_sessions_.clear();
+    session_count_ = 0;
+}
+
+gboolean MiracSessionManager::Shard::stop_cb (gpointer data_ptr)
+{
+    auto shard = static_cast<Shard*> (data_ptr);
+    shard->clear();
+    g_main_loop_quit(shard->loop_);
+    return G_SOURCE_REMOVE;
+}
+
+void MiracSessionManager::Shard::stop()
+{
+    if (!thread_) {
+        if (!loop_)
+            clear();
+        return;
+    }
+
+    g_main_context_invoke(context_, stop_cb, this);
+    g_thread_join(thread_);
+    thread_ = NULL;
+}
+
+void MiracSessionManager::start_session(MiracBroker *session, MiracBroker::Observer *observer)
+{
+    session->set_observer(observer);
+    session->on_connected();
+}
+
+/* static C callback wrapper */
+gboolean MiracSessionManager::listen_cb (gint fd, GIOCondition condition, gpointer data_ptr)
+{
+    auto manager = static_cast<MiracSessionManager*> (data_ptr);
+    return manager->listen_cb(fd, condition);
+}
+
+gboolean MiracSessionManager::listen_cb (gint fd, GIOCondition condition)
+{
+    /* accept everything that is pending so that a burst of
+     * connections does not cost one main loop iteration each */
+    for (;;) {
+        MiracNetwork* connection;
+        try {
+            connection = network_->Accept();
+        } catch (const std::exception &x) {
+            WDS_WARNING("exception: %s", x.what());
+            break;
+        }
+        if (!connection)
+            break;
+
+        WDS_LOG("connection from: %s", connection->GetPeerAddress().c_str());
+        shards_[connection->GetHandle() % shards_.size()]->hand_over(connection);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+size_t MiracSessionManager::session_count() const
+{
+    size_t count = 0;
+    for (const auto& shard : shards_)
+        count += shard->session_count();
+    return count;
+}
+
+void MiracSessionManager::foreach_session(const std::function<void(MiracBroker*)>& func)
+{
+    for (const auto& shard : shards_)
+        shard->foreach_session(func);
+}
+
+unsigned short MiracSessionManager::get_host_port() const
+{
+    return network_->GetHostPort();
+}
+
+void MiracSessionManager::stop_shards()
+{
+    if (listen_source_id_) {
+        GSource *source = g_main_context_find_source_by_id(
+            shards_[0]->context(), listen_source_id_);
+        if (source)
+            g_source_destroy(source);
+        listen_source_id_ = 0;
+    }
+
+    for (const auto& shard : shards_)
+        shard->stop();
+}
+
+MiracSessionManager::MiracSessionManager (const std::string& listen_port, uint shards,
+                                          bool io_thread)
+{
+    if (io_thread)
+        io_thread_.reset(new MiracIOThread());
+
+    shards_.emplace_back(new Shard(this, false));
+    for (uint i = 1; i < shards; ++i)
+        shards_.emplace_back(new Shard(this, true));
+
+    network_.reset(new MiracNetwork());
+    network_->Bind(NULL, listen_port.c_str());
+
+    GUnixFDSourceFunc func = listen_cb;
+    GSource *source = g_unix_fd_source_new(network_->GetHandle(), G_IO_IN);
+    g_source_set_callback(source, reinterpret_cast<GSourceFunc>(func),
+                          this, NULL);
+    listen_source_id_ = g_source_attach(source, shards_[0]->context());
+    g_source_unref(source);
+}
+
+MiracSessionManager::~MiracSessionManager ()
+{
+    stop_shards();
+}
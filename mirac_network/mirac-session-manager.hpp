@@ -0,0 +1,93 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_SESSION_MANAGER_HPP
+#define MIRAC_SESSION_MANAGER_HPP
+
+#include <glib.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "mirac-broker.hpp"
+#include "mirac-io-thread.hpp"
+#include "mirac-network.hpp"
+
+/* Accepts any number of RTSP connections on a single listening port.
+ * Every accepted connection gets its own MiracBroker (and thereby its
+ * own wds::Peer, CSeq counter and timers) created by create_session().
+ *
+ * Sessions are spread over a number of shards, each with its own main
+ * context. Shard 0 is the thread-default context of the thread that
+ * creates the manager, the others run on worker threads started by the
+ * manager. Connections are accepted on shard 0 and handed over to shard
+ * (fd % shards), where the session stays for its whole lifetime, so one
+ * session blocking its thread does not delay the sessions of the other
+ * shards.
+ *
+ * Optionally the socket I/O of all sessions is done by a single
+ * MiracIOThread, leaving only RTSP handling to the shards. */
+class MiracSessionManager
+{
+    public:
+        MiracSessionManager (const std::string& listen_port, uint shards = 1,
+                             bool io_thread = false);
+        virtual ~MiracSessionManager ();
+
+        unsigned short get_host_port() const;
+        uint shard_count() const { return shards_.size(); }
+        size_t session_count() const;
+        MiracIOThread* io_thread() const { return io_thread_.get(); }
+
+        /* calls func for every session on the thread running it: the
+         * sessions of shard 0 are visited before returning if called
+         * from its thread, the other shards are visited asynchronously */
+        void foreach_session(const std::function<void(MiracBroker*)>& func);
+
+    protected:
+        /* returns a new broker adopting the accepted connection,
+         * or NULL to reject it; called on the thread of the shard
+         * the session is pinned to */
+        virtual MiracBroker* create_session(MiracNetwork* connection) = 0;
+
+        /* stops and joins the worker threads, destroying their sessions
+         * on their own threads; subclasses call this in their destructor
+         * so that create_session() is not called after they are gone */
+        void stop_shards();
+
+    private:
+        class Shard;
+
+        static void start_session(MiracBroker *session, MiracBroker::Observer *observer);
+        static gboolean listen_cb (gint fd, GIOCondition condition, gpointer data_ptr);
+        gboolean listen_cb (gint fd, GIOCondition condition);
+
+        std::unique_ptr<MiracNetwork> network_;
+        std::unique_ptr<MiracIOThread> io_thread_;
+        std::vector<std::unique_ptr<Shard>> shards_;
+        uint listen_source_id_;
+};
+
+
+#endif  /* MIRAC_SESSION_MANAGER_HPP */
@@ -0,0 +1,84 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef MIRAC_SPSC_QUEUE_HPP
+#define MIRAC_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/* Bounded lock-free queue for exactly one producer thread and one
+ * consumer thread. The capacity is rounded up to a power of two. */
+template <typename T>
+class MiracSpscQueue
+{
+    public:
+        explicit MiracSpscQueue (size_t capacity):
+            slots_(round_up(capacity)),
+            mask_(slots_.size() - 1),
+            head_(0),
+            tail_(0)
+        { }
+
+        /* producer side, returns false if the queue is full */
+        bool push (T &&item)
+        {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == slots_.size())
+                return false;
+            slots_[tail & mask_] = std::move(item);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /* consumer side, returns false if the queue is empty */
+        bool pop (T &item)
+        {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire))
+                return false;
+            item = std::move(slots_[head & mask_]);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        static size_t round_up (size_t capacity)
+        {
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            return size;
+        }
+
+        std::vector<T> slots_;
+        const size_t mask_;
+        /* consumer and producer indices are kept on separate
+         * cache lines */
+        std::atomic<size_t> head_;
+        char padding_[64 - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> tail_;
+};
+
+
+#endif  /* MIRAC_SPSC_QUEUE_HPP */
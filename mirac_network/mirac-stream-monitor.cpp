@@ -0,0 +1,135 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "mirac-stream-monitor.hpp"
+
+#define RTP_HEADER_SIZE     12
+#define TS_PACKET_SIZE      188
+#define TS_SYNC_BYTE        0x47
+#define TS_NULL_PID         0x1fff
+
+/* RFC 3550 A.1: the largest gap taken for lost packets, and the most
+ * a packet may come late, any other jump restarts the sequence */
+#define RTP_SEQ_MOD         (1 << 16)
+#define MAX_DROPOUT         3000
+#define MAX_MISORDER        100
+
+MiracStreamMonitor::MiracStreamMonitor ()
+{
+    Reset();
+}
+
+void MiracStreamMonitor::Reset ()
+{
+    have_sequence = false;
+    max_sequence = 0;
+    bad_sequence = RTP_SEQ_MOD + 1;
+    continuity_counters.clear();
+}
+
+bool MiracStreamMonitor::CheckRtpPacket (const guint8 *data, gsize size)
+{
+    if (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2)
+        return false;
+
+    bool loss = false;
+    if (!update_sequence ((data[2] << 8) | data[3], &loss))
+        return false;
+
+    /* the payload follows the CSRCs and the header extension */
+    gsize offset = RTP_HEADER_SIZE + 4 * (data[0] & 0x0f);
+    if (data[0] & 0x10) {
+        if (size < offset + 4)
+            return loss;
+        offset += 4 + 4 * ((data[offset + 2] << 8) | data[offset + 3]);
+    }
+    gsize end = size;
+    if ((data[0] & 0x20) && data[size - 1] <= size)
+        end -= data[size - 1];
+
+    for (; offset + TS_PACKET_SIZE <= end; offset += TS_PACKET_SIZE) {
+        if (check_ts_packet (data + offset))
+            loss = true;
+    }
+    return loss;
+}
+
+/* returns false for the packets not to check any further: late and
+ * duplicate packets, which are not losses, nor are the TS packets in
+ * them out of sequence, and the first packet after a jump */
+bool MiracStreamMonitor::update_sequence (guint16 sequence, bool *loss)
+{
+    if (!have_sequence) {
+        have_sequence = true;
+        max_sequence = sequence;
+        return true;
+    }
+
+    guint16 delta = sequence - max_sequence;
+    if (delta == 0)
+        return false;
+    if (delta < MAX_DROPOUT) {
+        *loss = delta > 1;
+        max_sequence = sequence;
+        return true;
+    }
+    if (delta <= RTP_SEQ_MOD - MAX_MISORDER) {
+        /* a jump taken by two packets in a row is a new stream, e.g.
+         * from a rebuilt pipeline with another seqnum-offset */
+        if (sequence != bad_sequence) {
+            bad_sequence = (sequence + 1) & (RTP_SEQ_MOD - 1);
+            return false;
+        }
+        Reset ();
+        have_sequence = true;
+        max_sequence = sequence;
+        return true;
+    }
+    return false;
+}
+
+bool MiracStreamMonitor::check_ts_packet (const guint8 *packet)
+{
+    /* out of sync, or marked as damaged by the link layer */
+    if (packet[0] != TS_SYNC_BYTE || (packet[1] & 0x80))
+        return true;
+
+    guint16 pid = ((packet[1] & 0x1f) << 8) | packet[2];
+    if (pid == TS_NULL_PID)
+        return false;
+
+    guint8 adaptation_field_control = (packet[3] >> 4) & 0x03;
+    guint8 counter = packet[3] & 0x0f;
+    bool discontinuity = (adaptation_field_control & 0x02) &&
+                         packet[4] > 0 && (packet[5] & 0x80);
+
+    bool loss = false;
+    auto it = continuity_counters.find (pid);
+    if (it != continuity_counters.end() && !discontinuity) {
+        /* the counter only goes up with a payload, and a packet may
+         * be sent twice */
+        guint8 expected = (adaptation_field_control & 0x01) ?
+                          (it->second + 1) & 0x0f : it->second;
+        loss = counter != expected && counter != it->second;
+    }
+    continuity_counters[pid] = counter;
+    return loss;
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef MIRAC_STREAM_MONITOR_HPP
+#define MIRAC_STREAM_MONITOR_HPP
+
+#include <glib.h>
+#include <map>
+
+/* Finds the packets lost on the way from the source in the RTP packets
+ * of an MPEG-TS stream: gaps in the RTP sequence numbers, and in the
+ * continuity counters of the TS packets, which also show losses before
+ * the RTP packetizer. */
+class MiracStreamMonitor
+{
+public:
+    MiracStreamMonitor ();
+
+    /* returns true if packets were lost before this one */
+    bool CheckRtpPacket (const guint8 *data, gsize size);
+    /* forgets the stream, e.g. when the source restarts it */
+    void Reset ();
+
+private:
+    bool update_sequence (guint16 sequence, bool *loss);
+    bool check_ts_packet (const guint8 *packet);
+
+    bool have_sequence;
+    /* highest sequence number seen */
+    guint16 max_sequence;
+    /* the sequence number that confirms a jump, see update_sequence() */
+    guint32 bad_sequence;
+    /* last continuity counter by PID */
+    std::map<guint16, guint8> continuity_counters;
+};
+
+#endif
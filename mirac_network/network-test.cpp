@@ -91,6 +91,8 @@ static gboolean _listen_cb (gint fd, GIOCondition condition, gpointer data_ptr)
         MiracNetwork *ctx;
 
         ctx = listener->Accept();
+        if (!ctx)
+            return G_SOURCE_CONTINUE;
         g_message("connection from: %s", ctx->GetPeerAddress().c_str());
         g_unix_fd_add(ctx->GetHandle(), G_IO_IN, _receive_cb, ctx);
     }
@@ -0,0 +1,362 @@
+/*
+ * This file is part of Wireless Display Software for Linux OS
+ *
+ * Copyright (C) 2016 Intel Corporation.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+/* Session scaling benchmark for MiracSessionManager.
+ *
+ * A child process connects N sinks to the source port; the parent
+ * serves them all from one MiracSessionManager, optionally sharded
+ * over several event loop threads and with a dedicated I/O thread.
+ * It reports how long it took until every session reached PLAY,
+ * the CPU time that cost (as sessions per core second), the
+ * resident memory held per idle, established session and, with
+ * the I/O thread, the latency of each hop a message goes through.
+ *
+ * Media managers are no-ops so that only the RTSP session
+ * machinery is measured. */
+
+#include <glib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "libwds/public/media_manager.h"
+#include "libwds/public/sink.h"
+#include "libwds/public/source.h"
+
+#include "mirac-broker.hpp"
+#include "mirac-session-manager.hpp"
+
+namespace {
+
+wds::RateAndResolutionsBitmap AllRates(wds::RateAndResolution first,
+                                       wds::RateAndResolution last) {
+    wds::RateAndResolutionsBitmap bitmap;
+    for (wds::RateAndResolution i = first; i <= last; ++i)
+        bitmap.set(i);
+    return bitmap;
+}
+
+wds::H264VideoCodec BenchCodec() {
+    return wds::H264VideoCodec(wds::CHP, wds::k4_2,
+            AllRates(wds::CEA640x480p60, wds::CEA1920x1080p24),
+            AllRates(wds::VESA800x600p30, wds::VESA1920x1200p30),
+            AllRates(wds::HH800x480p30, wds::HH848x480p60));
+}
+
+class NullSourceMediaManager : public wds::SourceMediaManager {
+  public:
+    explicit NullSourceMediaManager(std::atomic<uint>* play_count)
+        : play_count_(play_count), paused_(true) {}
+
+    void Play() override { paused_ = false; ++*play_count_; }
+    void Pause() override { paused_ = true; }
+    void Teardown() override { paused_ = true; }
+    bool IsPaused() const override { return paused_; }
+    std::string GetSessionId() const override { return "bench"; }
+    wds::SessionType GetSessionType() const override { return wds::VideoSession; }
+    void SetSinkRtpPorts(int port1, int port2) override { ports_ = {port1, port2}; }
+    std::pair<int,int> GetSinkRtpPorts() const override { return ports_; }
+    int GetLocalRtpPort() const override { return 0; }
+
+    bool InitOptimalVideoFormat(
+            const wds::NativeVideoFormat& sink_native_format,
+            const std::vector<wds::H264VideoCodec>& sink_supported_codecs) override {
+        format_ = wds::FindOptimalVideoFormat(sink_native_format,
+                                              {BenchCodec()},
+                                              sink_supported_codecs);
+        return true;
+    }
+    wds::H264VideoFormat GetOptimalVideoFormat() const override { return format_; }
+    bool InitOptimalAudioFormat(const std::vector<wds::AudioCodec>&) override { return false; }
+    wds::AudioCodec GetOptimalAudioFormat() const override { return wds::AudioCodec(); }
+    void SendIDRPicture() override {}
+
+  private:
+    std::atomic<uint>* play_count_;
+    bool paused_;
+    std::pair<int,int> ports_;
+    wds::H264VideoFormat format_;
+};
+
+class NullSinkMediaManager : public wds::SinkMediaManager {
+  public:
+    NullSinkMediaManager() : paused_(true) {}
+
+    void Play() override { paused_ = false; }
+    void Pause() override { paused_ = true; }
+    void Teardown() override { paused_ = true; }
+    bool IsPaused() const override { return paused_; }
+    std::string GetSessionId() const override { return session_; }
+    std::pair<int,int> GetLocalRtpPorts() const override { return {1028, 0}; }
+    void SetPresentationUrl(const std::string& url) override { url_ = url; }
+    std::string GetPresentationUrl() const override { return url_; }
+    void SetSessionId(const std::string& session) override { session_ = session; }
+    std::vector<wds::H264VideoCodec> GetSupportedH264VideoCodecs() const override {
+        return {BenchCodec()};
+    }
+    wds::NativeVideoFormat GetNativeVideoFormat() const override {
+        return wds::NativeVideoFormat(wds::CEA1920x1080p60);
+    }
+    bool SetOptimalVideoFormat(const wds::H264VideoFormat&) override { return true; }
+    wds::ConnectorType GetConnectorType() const override { return wds::ConnectorTypeNone; }
+
+  private:
+    bool paused_;
+    std::string url_;
+    std::string session_;
+};
+
+class BenchSession : public MiracBroker {
+  public:
+    BenchSession(MiracNetwork* connection, std::atomic<uint>* play_count)
+        : MiracBroker(connection), media_manager_(play_count) {}
+
+    wds::Peer* Peer() const override { return source_.get(); }
+
+  private:
+    void got_message(const std::string& message) override {
+        source_->RTSPDataReceived(message);
+    }
+    void on_connected() override {
+        source_.reset(wds::Source::Create(this, &media_manager_));
+        source_->Start();
+    }
+
+    NullSourceMediaManager media_manager_;
+    std::unique_ptr<wds::Source> source_;
+};
+
+class BenchSessionManager : public MiracSessionManager {
+  public:
+    BenchSessionManager(uint shards, bool io_thread)
+        : MiracSessionManager("0", shards, io_thread), play_count_(0) {}
+    ~BenchSessionManager() { stop_shards(); }
+
+    uint play_count() const { return play_count_; }
+
+  private:
+    MiracBroker* create_session(MiracNetwork* connection) override {
+        return new BenchSession(connection, &play_count_);
+    }
+
+    std::atomic<uint> play_count_;
+};
+
+class BenchSink : public MiracBroker {
+  public:
+    explicit BenchSink(unsigned short port)
+        : MiracBroker("127.0.0.1", std::to_string(port), 60000) {}
+
+    wds::Peer* Peer() const override { return sink_.get(); }
+
+  private:
+    void got_message(const std::string& message) override {
+        sink_->RTSPDataReceived(message);
+    }
+    void on_connected() override {
+        sink_.reset(wds::Sink::Create(this, &media_manager_));
+        sink_->Start();
+    }
+
+    NullSinkMediaManager media_manager_;
+    std::unique_ptr<wds::Sink> sink_;
+};
+
+struct BenchState {
+    BenchSessionManager* manager;
+    GMainLoop* loop;
+    uint sessions;
+    bool done;
+};
+
+gboolean check_done(gpointer data_ptr) {
+    auto state = static_cast<BenchState*>(data_ptr);
+    if (state->manager->play_count() < state->sessions)
+        return G_SOURCE_CONTINUE;
+    state->done = true;
+    g_main_loop_quit(state->loop);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean quit_loop(gpointer data_ptr) {
+    g_main_loop_quit(static_cast<GMainLoop*>(data_ptr));
+    return G_SOURCE_REMOVE;
+}
+
+long rss_kb() {
+    long size = 0, resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+double cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                  usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+void raise_fd_limit(uint sessions) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit))
+        return;
+    rlim_t wanted = 2 * sessions + 64;
+    if (limit.rlim_cur < wanted) {
+        limit.rlim_cur = std::min(wanted, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+void run_sinks(unsigned short port, uint sessions) {
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    std::vector<std::unique_ptr<BenchSink>> sinks;
+    sinks.reserve(sessions);
+    for (uint i = 0; i < sessions; ++i)
+        sinks.emplace_back(new BenchSink(port));
+    g_main_loop_run(loop);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    uint sessions = 1000;
+    uint timeout_s = 60;
+    uint shards = 1;
+    gboolean io_thread = FALSE;
+
+    GOptionEntry main_entries[] =
+    {
+        { "sessions", 'n', 0, G_OPTION_ARG_INT, &sessions, "Number of concurrent sessions, 1000 by default", "N"},
+        { "shards", 's', 0, G_OPTION_ARG_INT, &shards, "Number of event loop threads serving sessions, 1 by default", "N"},
+        { "io-thread", 'i', 0, G_OPTION_ARG_NONE, &io_thread, "Do the socket I/O on a dedicated thread and report per hop latency", NULL},
+        { "timeout", 't', 0, G_OPTION_ARG_INT, &timeout_s, "Give up after this many seconds, 60 by default", "seconds"},
+        { NULL }
+    };
+
+    GOptionContext* context = g_option_context_new ("- RTSP session scaling benchmark");
+    g_option_context_add_main_entries (context, main_entries, NULL);
+    GError* error = NULL;
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("option parsing failed: %s\n", error->message);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    raise_fd_limit(sessions);
+
+    /* fork before any shard thread exists; the child learns the
+     * listening port through a pipe */
+    int port_pipe[2];
+    if (pipe(port_pipe)) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (child == 0) {
+        unsigned short port = 0;
+        close(port_pipe[1]);
+        if (read(port_pipe[0], &port, sizeof(port)) != sizeof(port))
+            _exit(1);
+        run_sinks(port, sessions);
+        _exit(0);
+    }
+    close(port_pipe[0]);
+
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    std::unique_ptr<BenchSessionManager> manager(new BenchSessionManager(std::max(shards, 1u), io_thread));
+    unsigned short port = manager->get_host_port();
+
+    /* settle allocations made by the listener before taking the baseline */
+    g_idle_add(quit_loop, loop);
+    g_main_loop_run(loop);
+    long rss_before = rss_kb();
+
+    if (write(port_pipe[1], &port, sizeof(port)) != sizeof(port)) {
+        perror("write");
+        kill(child, SIGTERM);
+        return 1;
+    }
+    close(port_pipe[1]);
+
+    BenchState state = { manager.get(), loop, sessions, false };
+    double cpu_before = cpu_seconds();
+    gint64 start = g_get_monotonic_time();
+
+    g_timeout_add(10, check_done, &state);
+    uint timeout_id = g_timeout_add_seconds(timeout_s, quit_loop, loop);
+    g_main_loop_run(loop);
+    if (state.done)
+        g_source_remove(timeout_id);
+
+    double wall = (g_get_monotonic_time() - start) / 1e6;
+    double cpu = cpu_seconds() - cpu_before;
+    long rss_after = rss_kb();
+
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+
+    if (!state.done) {
+        g_printerr("only %u of %u sessions reached PLAY within %u s\n",
+                   manager->play_count(), sessions, timeout_s);
+        return 1;
+    }
+
+    g_print("sessions:             %u\n", sessions);
+    g_print("shards:               %u\n", manager->shard_count());
+    g_print("setup wall time:      %.3f s\n", wall);
+    g_print("setup cpu time:       %.3f s\n", cpu);
+    g_print("sessions/core-second: %.0f\n", cpu > 0 ? sessions / cpu : 0.0);
+    g_print("rss per idle session: %.1f KiB\n",
+            double(rss_after - rss_before) / sessions);
+
+    if (MiracIOThread* io = manager->io_thread()) {
+        for (int hop = 0; hop < MiracIOThread::HOP_COUNT; ++hop) {
+            auto stats = io->hop_stats(static_cast<MiracIOThread::Hop>(hop));
+            g_print("%-15s       %8lu messages, avg %6.1f us, max %6lu us\n",
+                    MiracIOThread::hop_name(static_cast<MiracIOThread::Hop>(hop)),
+                    (unsigned long) stats.count,
+                    stats.count ? double(stats.total_us) / stats.count : 0.0,
+                    (unsigned long) stats.max_us);
+        }
+    }
+
+    manager.reset();
+    g_main_loop_unref(loop);
+    return 0;
+}
@@ -137,6 +137,16 @@ const int InformationElement::get_rtsp_port() const
     return dev_info->session_management_control_port;
 }
 
+const int InformationElement::get_maximum_throughput() const
+{
+    auto it = subelements_.find (DEVICE_INFORMATION);
+    if (it == subelements_.end())
+        return 0;
+
+    auto dev_info = (P2P::DeviceInformationSubelement*)(*it).second;
+    return ntohs(dev_info->maximum_throughput);
+}
+
 std::unique_ptr<InformationElementArray> InformationElement::serialize () const
 {
     uint8_t pos = 0;
@@ -150,6 +150,8 @@ class InformationElement {
     void add_subelement(P2P::Subelement* subelement);
     const DeviceType get_device_type() const;
     const int get_rtsp_port() const;
+    /* in Mbps, 0 if not advertised */
+    const int get_maximum_throughput() const;
 
     std::unique_ptr<InformationElementArray> serialize () const;
     std::string to_string() const;
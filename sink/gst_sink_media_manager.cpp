@@ -21,20 +21,49 @@
 
 #include "gst_sink_media_manager.h"
 
+namespace {
+
+// Not more often than the source sends IDR pictures on request by default.
+const guint kPictureDamageInterval = 500;  // ms
+
+std::function<void(bool)> Completer(wds::MediaCompletionPtr completion) {
+  return [completion](bool success) { completion->Complete(success); };
+}
+
+}
+
 GstSinkMediaManager::GstSinkMediaManager(const std::string& hostname)
   : gst_pipeline_(new MiracGstSink(hostname, 0)) {
 }
 
 void GstSinkMediaManager::Play() {
-  gst_pipeline_->Play();
+  PlayAsync();
 }
 
 void GstSinkMediaManager::Pause() {
-  gst_pipeline_->Pause();
+  PauseAsync();
 }
 
 void GstSinkMediaManager::Teardown() {
-  gst_pipeline_->Teardown();
+  TeardownAsync();
+}
+
+wds::MediaCompletionPtr GstSinkMediaManager::PlayAsync() {
+  wds::MediaCompletionPtr completion = wds::MediaCompletion::Create();
+  gst_pipeline_->Play(Completer(completion));
+  return completion;
+}
+
+wds::MediaCompletionPtr GstSinkMediaManager::PauseAsync() {
+  wds::MediaCompletionPtr completion = wds::MediaCompletion::Create();
+  gst_pipeline_->Pause(Completer(completion));
+  return completion;
+}
+
+wds::MediaCompletionPtr GstSinkMediaManager::TeardownAsync() {
+  wds::MediaCompletionPtr completion = wds::MediaCompletion::Create();
+  gst_pipeline_->Teardown(Completer(completion));
+  return completion;
 }
 
 bool GstSinkMediaManager::IsPaused() const {
@@ -79,6 +108,17 @@ GstSinkMediaManager::GetSupportedH264VideoCodecs() const {
           wds::H264VideoCodec(wds::CBP, wds::k4_2, cea_rr, vesa_rr, hh_rr)};
 }
 
+std::vector<wds::H265VideoCodec>
+GstSinkMediaManager::GetSupportedH265VideoCodecs() const {
+  if (!MiracGstSink::IsVideoCodecAvailable(WFD_VIDEO_H265))
+    return std::vector<wds::H265VideoCodec>();
+
+  // The same formats as in H.264.
+  const wds::H264VideoCodec& h264 = GetSupportedH264VideoCodecs().front();
+  return {wds::H265VideoCodec(wds::H265Main, wds::kH265_5_1,
+                              h264.cea_rr, h264.vesa_rr, h264.hh_rr)};
+}
+
 wds::NativeVideoFormat GstSinkMediaManager::GetNativeVideoFormat() const {
   // pick the maximum possible resolution, let gstreamer deal with it
   // TODO: get the actual screen size of the system
@@ -86,9 +126,25 @@ wds::NativeVideoFormat GstSinkMediaManager::GetNativeVideoFormat() const {
 }
 
 bool GstSinkMediaManager::SetOptimalVideoFormat(const wds::H264VideoFormat& optimal_format) {
+  // The pipeline is ready before PLAY is sent.
+  gst_pipeline_->Prepare(WFD_VIDEO_H264);
   return true;
 }
 
+bool GstSinkMediaManager::SetOptimalH265VideoFormat(const wds::H265VideoFormat& optimal_format) {
+  gst_pipeline_->Prepare(WFD_VIDEO_H265);
+  return true;
+}
+
+void GstSinkMediaManager::SetPictureDamageCallback(
+    std::function<void()> callback) {
+  gst_pipeline_->SetDamageCallback(callback, kPictureDamageInterval);
+}
+
+void GstSinkMediaManager::OnPlayRequested() {
+  gst_pipeline_->StartFirstFrameTimer();
+}
+
 wds::ConnectorType GstSinkMediaManager::GetConnectorType() const {
   return wds::ConnectorTypeNone;
 }
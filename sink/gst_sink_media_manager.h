@@ -22,6 +22,7 @@
 #ifndef GST_SINK_MEDIA_MANAGER_H_
 #define GST_SINK_MEDIA_MANAGER_H_
 
+#include <functional>
 #include <memory>
 
 #include "libwds/public/media_manager.h"
@@ -35,6 +36,11 @@ class GstSinkMediaManager : public wds::SinkMediaManager {
   void Pause() override;
   void Teardown() override;
   bool IsPaused() const override;
+  // Completed from the bus watch once the pipeline reaches the state,
+  // the main loop is not blocked meanwhile.
+  wds::MediaCompletionPtr PlayAsync() override;
+  wds::MediaCompletionPtr PauseAsync() override;
+  wds::MediaCompletionPtr TeardownAsync() override;
   std::pair<int,int> GetLocalRtpPorts() const override;
   void SetPresentationUrl(const std::string& url) override;
   std::string GetPresentationUrl() const override;
@@ -42,10 +48,20 @@ class GstSinkMediaManager : public wds::SinkMediaManager {
   std::string GetSessionId() const override;
 
   std::vector<wds::H264VideoCodec> GetSupportedH264VideoCodecs() const override;
+  std::vector<wds::H265VideoCodec> GetSupportedH265VideoCodecs() const override;
   wds::NativeVideoFormat GetNativeVideoFormat() const override;
   bool SetOptimalVideoFormat(const wds::H264VideoFormat& optimal_format) override;
+  bool SetOptimalH265VideoFormat(const wds::H265VideoFormat& optimal_format) override;
   wds::ConnectorType GetConnectorType() const override;
 
+  // |callback| is called when packet loss or a decoder error has damaged
+  // the picture, e.g. to request an IDR picture.
+  void SetPictureDamageCallback(std::function<void()> callback);
+
+  // Starts measuring the time to the first rendered frame, to be called
+  // when PLAY (M7) is sent.
+  void OnPlayRequested();
+
  private:
   std::string hostname_;
   std::string presentation_url_;
@@ -54,6 +54,10 @@ static void parse_input_and_call_sink(
         sink->Play();
         return;
     }
+    if (command == "idr\n") {
+        sink->RequestIDR();
+        return;
+    }
     std::cout << "Received unknown command: " << command << std::endl;
 }
 
@@ -88,11 +92,13 @@ int main (int argc, char *argv[])
     InitGlibLogging();
     char* hostname = NULL;
     int port = 7236;
+    int log_buffer = 0;
     std::unique_ptr<SinkApp> app;
 
     GOptionEntry main_entries[] = {
         { "hostname", 0, 0, G_OPTION_ARG_STRING, &hostname, "Specify remote hostname (for debugging purposes)", "host"},
         { "rtsp_port", 0, 0, G_OPTION_ARG_INT, &port, "Specify remote RTSP port number (for debugging purposes), 7236 by default", "rtsp_port"},
+        { "log_buffer", 0, 0, G_OPTION_ARG_INT, &log_buffer, "Keep the last KiB of log messages, verbose ones included, in memory and print them on SIGUSR1", "KiB"},
         { NULL }
     };
 
@@ -108,6 +114,9 @@ int main (int argc, char *argv[])
     }
     g_option_context_free(context);
 
+    if (log_buffer > 0)
+        EnableLogRingBuffer(log_buffer * 1024);
+
     if (hostname) {
         app.reset(new SinkApp(std::string(hostname), port));
         g_free (hostname);
@@ -37,7 +37,9 @@ void Sink::got_message(const std::string& message) {
 
 void Sink::on_connected() {
   media_manager_.reset(new GstSinkMediaManager(local_host_));
-  wfd_sink_.reset(wds::Sink::Create(this, media_manager_.get()));
+  // Recovers in a round trip rather than at the next keyframe.
+  media_manager_->SetPictureDamageCallback([this] { RequestIDR(); });
+  wfd_sink_.reset(wds::Sink::Create(this, media_manager_.get(), this));
   wfd_sink_->Start();
 }
 
@@ -62,7 +64,17 @@ void Sink::Teardown() {
   wfd_sink_->Teardown();
 }
 
+void Sink::RequestIDR() {
+  if (!wfd_sink_->RequestIDR())
+    std::cout << "* IDR request not sent" << std::endl;
+}
+
 wds::Peer* Sink::Peer() const {
   return wfd_sink_.get();
 }
 
+void Sink::TimelineEventOccurred(const wds::TimelineEvent& event) {
+  if (event.type == wds::TimelineEvent::RequestSent && event.message == 7)
+    media_manager_->OnPlayRequested();
+}
+
@@ -24,12 +24,13 @@
 
 #include <memory>
 
-#include "libwds/public/media_manager.h"
 #include "libwds/public/sink.h"
 
 #include "mirac-broker.hpp"
 
-class Sink : public MiracBroker {
+class GstSinkMediaManager;
+
+class Sink : public MiracBroker, public wds::Peer::Observer {
  public:
   explicit Sink(const std::string& remote_host, int remote_rtsp_port, const std::string& local_host);
   ~Sink();
@@ -37,6 +38,7 @@ class Sink : public MiracBroker {
   void Play();
   void Pause();
   void Teardown();
+  void RequestIDR();
 
  protected:
   virtual wds::Peer* Peer() const override;
@@ -46,7 +48,10 @@ class Sink : public MiracBroker {
   virtual void on_connected() override;
   void on_connection_failure(ConnectionFailure failure) override;
 
-  std::unique_ptr<wds::SinkMediaManager> media_manager_;
+  // wds::Peer::Observer
+  void TimelineEventOccurred(const wds::TimelineEvent& event) override;
+
+  std::unique_ptr<GstSinkMediaManager> media_manager_;
   std::unique_ptr<wds::Sink> wfd_sink_;
   std::string local_host_;
 };